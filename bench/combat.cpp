@@ -0,0 +1,172 @@
+// Hit detection benchmark. Crowds of fighters (three hurtboxes each, a
+// quarter of them swinging) and fast projectiles move around an arena, every
+// tick their shapes go through fight::CollisionWorld. Times the broadphase
+// and the narrowphase apart, each with SSE and scalar on the same ticks, and
+// checks both give the same contacts. "resorted" is the share of ticks where
+// the broadphase sorted from scratch instead of fixing last tick's order.
+//
+// usage: glitch_bench_combat [ticks]
+
+#include <glm/glm.hpp>
+
+#include <glitch/combat.h>
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+const float TICK_RATE = 120.0f;
+
+struct Mover {
+    Player::State from;
+    Player::State to;
+    glm::vec3 velocity;
+};
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool sameContacts(const std::vector<fight::Contact>& a, const std::vector<fight::Contact>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (unsigned int i = 0; i < a.size(); i++) {
+        if (a[i].hitbox != b[i].hitbox || a[i].hurtbox != b[i].hurtbox || a[i].time != b[i].time) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// walk on the ground inside the arena, turning now and then
+void stepMover(Mover& mover, float half_arena, std::mt19937& rng) {
+    std::uniform_real_distribution<float> turn(-30.0f, 30.0f);
+    mover.from = mover.to;
+    mover.to.position += mover.velocity / TICK_RATE;
+    for (int axis = 0; axis < 3; axis += 2) {
+        if (std::fabs(mover.to.position[axis]) > half_arena) {
+            mover.velocity[axis] = -mover.velocity[axis];
+        }
+    }
+    if (rng() % 32 == 0) {
+        mover.to.yaw += turn(rng);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const unsigned int n_ticks = (argc > 1) ? std::atoi(argv[1]) : 240;
+    const unsigned int fighter_counts[] = { 64, 256, 1024, 4096 };
+    // square meters of arena per fighter, spread out and a packed brawl
+    const float densities[] = { 9.0f, 1.0f };
+
+    // body, head and legs, and the swing in front
+    const fight::BoxShape hurtboxes[] = {
+        { glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.3f, 0.3f, 0.25f) },
+        { glm::vec3(0.0f, 0.45f, 0.0f), glm::vec3(0.15f) },
+        { glm::vec3(0.0f, -0.6f, 0.0f), glm::vec3(0.25f, 0.3f, 0.2f) },
+    };
+    const fight::BoxShape swing = { glm::vec3(0.6f, 0.1f, 0.0f), glm::vec3(0.3f, 0.1f, 0.1f) };
+    const fight::BoxShape projectile = { glm::vec3(0.0f), glm::vec3(0.1f) };
+
+    std::cout << std::setw(6) << "m2" << std::setw(9) << "fighters" << std::setw(12) << "projectiles" << std::setw(8) << "shapes"
+              << std::setw(11) << "candidates" << std::setw(10) << "contacts" << std::setw(8) << "swaps" << std::setw(10) << "resorted"
+              << std::setw(12) << "broad ms" << std::setw(8) << "sse" << std::setw(9) << "speedup"
+              << std::setw(12) << "narrow ms" << std::setw(8) << "sse" << std::setw(9) << "speedup" << std::endl;
+
+    for (float area : densities)
+    for (unsigned int n_fighters : fighter_counts) {
+        const unsigned int n_projectiles = 2 * n_fighters;
+        const float half_arena = 0.5f * std::sqrt(area * n_fighters);
+        std::mt19937 rng(n_fighters);
+        std::uniform_real_distribution<float> position(-half_arena, half_arena);
+        std::uniform_real_distribution<float> yaw(-180.0f, 180.0f);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+        std::vector<Mover> fighters(n_fighters);
+        for (Mover& fighter : fighters) {
+            fighter.to = Player::State { glm::vec3(position(rng), 0.9f, position(rng)), yaw(rng), 0.0f };
+            fighter.velocity = 2.5f * glm::vec3(unit(rng), 0.0f, unit(rng));
+        }
+        // 40 m/s, a third of a meter per tick, more than a projectile or a head is wide
+        std::vector<Mover> projectiles(n_projectiles);
+        std::vector<uint32_t> shooters(n_projectiles);
+        for (unsigned int i = 0; i < n_projectiles; i++) {
+            Mover& shot = projectiles[i];
+            shot.to = Player::State { glm::vec3(position(rng), 0.5f + unit(rng) * 0.5f, position(rng)), yaw(rng), 0.0f };
+            const float direction = glm::radians(shot.to.yaw);
+            shot.velocity = 40.0f * glm::vec3(std::cos(direction), 0.0f, std::sin(direction));
+            shooters[i] = rng() % n_fighters;
+        }
+
+        fight::CollisionWorld world;
+        std::vector<fight::Contact> contacts, reference;
+        // [scalar, sse] per phase
+        double broad_ms[2] = { 0.0, 0.0 };
+        double narrow_ms[2] = { 0.0, 0.0 };
+        unsigned long n_shapes = 0, n_candidates = 0, n_contacts = 0, n_swaps = 0, n_resorted = 0;
+        for (unsigned int tick = 0; tick < n_ticks; tick++) {
+            for (Mover& fighter : fighters) {
+                stepMover(fighter, half_arena, rng);
+            }
+            for (Mover& shot : projectiles) {
+                stepMover(shot, half_arena, rng);
+            }
+
+            world.clear();
+            for (unsigned int i = 0; i < n_fighters; i++) {
+                for (const fight::BoxShape& hurtbox : hurtboxes) {
+                    world.addHurtbox(i, fighters[i].from, fighters[i].to, hurtbox);
+                }
+                // a quarter of them swinging at any time
+                if ((i + tick / 30) % 4 == 0) {
+                    world.addHitbox(i, fighters[i].from, fighters[i].to, swing);
+                }
+            }
+            for (unsigned int i = 0; i < n_projectiles; i++) {
+                world.addHitbox(shooters[i], projectiles[i].from, projectiles[i].to, projectile);
+            }
+
+            // alternate which goes first, the first one pays for re-sorting
+            for (unsigned int pass = 0; pass < 2; pass++) {
+                const bool sse = (pass + tick) % 2 == 0;
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                world.broadphase(sse);
+                broad_ms[sse] += millisecondsSince(start);
+                if (pass == 0) {
+                    n_swaps += world.stats().n_swaps;
+                    n_resorted += world.stats().resorted;
+                }
+                start = std::chrono::steady_clock::now();
+                world.narrowphase(sse);
+                narrow_ms[sse] += millisecondsSince(start);
+                world.finish(sse ? contacts : reference);
+            }
+
+            if (!sameContacts(contacts, reference)) {
+                std::cout << "MISMATCH between scalar and sse contacts on tick " << tick << std::endl;
+                return 1;
+            }
+            n_shapes += world.stats().n_shapes;
+            n_candidates += world.stats().n_candidates;
+            n_contacts += contacts.size();
+        }
+
+        std::cout << std::setw(6) << std::setprecision(0) << std::fixed << area
+                  << std::setw(9) << n_fighters << std::setw(12) << n_projectiles
+                  << std::setw(8) << n_shapes / n_ticks << std::setw(11) << n_candidates / n_ticks
+                  << std::setw(10) << n_contacts / n_ticks << std::setw(8) << n_swaps / n_ticks
+                  << std::setprecision(2) << std::setw(10) << double(n_resorted) / n_ticks
+                  << std::setprecision(3)
+                  << std::setw(12) << broad_ms[0] / n_ticks << std::setw(8) << broad_ms[1] / n_ticks
+                  << std::setw(9) << broad_ms[0] / broad_ms[1]
+                  << std::setw(12) << narrow_ms[0] / n_ticks << std::setw(8) << narrow_ms[1] / n_ticks
+                  << std::setw(9) << narrow_ms[0] / narrow_ms[1] << std::endl;
+    }
+    return 0;
+}
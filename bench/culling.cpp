@@ -0,0 +1,79 @@
+// Frustum culling microbenchmark: scalar reference vs the path gfx::cull
+// was compiled for, printed first
+// usage: glitch_bench_culling [n_runs]
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <glitch/culling.h>
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+
+typedef void (*CullFunction)(const gfx::Frustum&, const gfx::CullingBoxes&, std::vector<unsigned int>&);
+
+// best of n_runs, in milliseconds
+double timeCull(CullFunction cull, const gfx::Frustum& frustum, const gfx::CullingBoxes& boxes, std::vector<unsigned int>& visible, int n_runs) {
+    double best = 1e30;
+    for (int run = 0; run < n_runs; run++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        cull(frustum, boxes, visible);
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char** argv)
+{
+    const int n_runs = (argc > 1) ? std::atoi(argv[1]) : 20;
+    const unsigned int counts[] = { 10000, 100000, 1000000 };
+
+    // same camera setup as the game, looking into a field of blocks
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 2.0f, 0.0f), glm::vec3(0.0f, 2.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    gfx::Frustum frustum = gfx::Frustum::fromMatrix(projection * view);
+
+    const char* simd_name = gfx::cullPath();
+    std::cout << "cull path: " << simd_name;
+#ifndef GLITCH_CULL_AVX
+    std::cout << " (the eight box cullAvx is left out, see GLITCH_NATIVE)";
+#endif
+    std::cout << std::endl;
+
+    std::cout << std::setw(10) << "boxes" << std::setw(10) << "visible"
+              << std::setw(14) << "scalar ms" << std::setw(14) << simd_name << " ms"
+              << std::setw(10) << "speedup" << std::endl;
+
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> position(-200.0f, 200.0f);
+    std::uniform_real_distribution<float> size(0.5f, 4.0f);
+
+    for (unsigned int n_boxes : counts) {
+        gfx::CullingBoxes boxes;
+        for (unsigned int i = 0; i < n_boxes; i++) {
+            glm::vec3 min(position(rng), position(rng) * 0.1f, position(rng));
+            boxes.add(min, min + glm::vec3(size(rng), size(rng), size(rng)));
+        }
+
+        std::vector<unsigned int> visible_scalar, visible_simd;
+        double scalar_ms = timeCull(gfx::cullScalar, frustum, boxes, visible_scalar, n_runs);
+        double simd_ms = timeCull(gfx::cull, frustum, boxes, visible_simd, n_runs);
+
+        if (visible_scalar != visible_simd) {
+            std::cout << "MISMATCH between scalar and " << simd_name << " results" << std::endl;
+            return 1;
+        }
+
+        std::cout << std::setw(10) << n_boxes << std::setw(10) << visible_simd.size()
+                  << std::fixed << std::setprecision(3)
+                  << std::setw(14) << scalar_ms << std::setw(17) << simd_ms
+                  << std::setw(10) << scalar_ms / simd_ms << std::endl;
+    }
+    return 0;
+}
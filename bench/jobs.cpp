@@ -0,0 +1,253 @@
+// Job system scaling benchmark. Runs synthetic frame work on
+// jobs::Scheduler with 1 to N threads and reports the speedup over one:
+//   even     parallelFor over model matrices, the same cost per item
+//   uneven   parallelFor where item cost varies 1 to 64x, so workers run out
+//            of their own chunks at different times and have to steal
+//   graph    four stages of small jobs, each stage queued with runAfter on
+//            the previous one and reading all of its output
+//   cull     gfx::cullParallel over a field of boxes, a visible list per chunk
+//   xforms   marking every gfx::Transforms dirty and updating them per dirty
+//            chunk on the scheduler
+// Every result is checked against a serial run.
+//
+// usage: glitch_bench_jobs [n_runs] [max_threads]
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <glitch/jobs.h>
+#include <glitch/transforms.h>
+#include <glitch/culling.h>
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <cmath>
+#include <cstdlib>
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+const unsigned int N_EVEN = 200000;
+const unsigned int N_UNEVEN = 20000;
+const unsigned int N_STAGES = 4;
+const unsigned int N_STAGE_JOBS = 256;
+const unsigned int STAGE_WORK = 2000;
+const unsigned int N_CULL = 1000000;
+const unsigned int CULL_GRAIN = 16384;
+const unsigned int N_TRANSFORMS = 200000;
+
+// the cull and xforms inputs, made once in main
+gfx::Frustum cull_frustum;
+gfx::CullingBoxes cull_boxes;
+gfx::Transforms transforms;
+
+// stands in for the instance data of an InstancedBatch
+struct Models {
+    std::vector<glm::mat4> models;
+
+    glm::mat4& model(unsigned int instance) {
+        return models[instance];
+    }
+};
+
+glm::mat4 evenItem(unsigned int i) {
+    const float t = float(i);
+    return gfx::modelMatrix(glm::vec3(t, 0.5f * t, -t), 0.01f * t, glm::vec3(1.0f + 0.001f * t), glm::vec3(0.5f, 0.0f, 0.5f));
+}
+
+float unevenItem(unsigned int i) {
+    const unsigned int n_steps = 16 * (1 + (i * 2654435761u >> 26));
+    float x = float(i);
+    for (unsigned int k = 0; k < n_steps; k++) {
+        x = std::sin(x) * 0.5f + std::cos(x * 0.25f);
+    }
+    return x;
+}
+
+// stage job j of a stage mixes a value of every job of the stage before
+float stageItem(const std::vector<float>& previous, unsigned int j) {
+    float x = previous.empty() ? float(j) : 0.0f;
+    for (unsigned int k = 0; k < previous.size(); k++) {
+        x += previous[(j + k) % previous.size()] * 1e-3f;
+    }
+    for (unsigned int k = 0; k < STAGE_WORK; k++) {
+        x = std::sin(x) + 0.5f;
+    }
+    return x;
+}
+
+struct Results {
+    std::vector<glm::mat4> even;
+    std::vector<float> uneven;
+    std::vector<std::vector<float>> stages;
+    std::vector<std::vector<unsigned int>> visible; // per chunk
+    Models transformed;
+
+    Results():
+        even(N_EVEN),
+        uneven(N_UNEVEN),
+        stages(N_STAGES, std::vector<float>(N_STAGE_JOBS))
+    {
+        transformed.models.resize(N_TRANSFORMS);
+    }
+};
+
+void runEven(jobs::Scheduler& scheduler, Results& results) {
+    scheduler.parallelFor(0, N_EVEN, 1024, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int i = begin; i < end; i++) {
+            results.even[i] = evenItem(i);
+        }
+    });
+}
+
+void runUneven(jobs::Scheduler& scheduler, Results& results) {
+    scheduler.parallelFor(0, N_UNEVEN, 64, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int i = begin; i < end; i++) {
+            results.uneven[i] = unevenItem(i);
+        }
+    });
+}
+
+void runGraph(jobs::Scheduler& scheduler, Results& results) {
+    static const std::vector<float> none;
+    // all stages queued up front, each waits on the counter of the one before
+    std::vector<jobs::Counter> counters(N_STAGES);
+    for (unsigned int stage = 0; stage < N_STAGES; stage++) {
+        for (unsigned int j = 0; j < N_STAGE_JOBS; j++) {
+            std::function<void()> job = [&results, stage, j]() {
+                results.stages[stage][j] = stageItem(stage ? results.stages[stage - 1] : none, j);
+            };
+            if (stage == 0) {
+                scheduler.run(job, &counters[stage]);
+            } else {
+                scheduler.runAfter(counters[stage - 1], job, &counters[stage]);
+            }
+        }
+    }
+    scheduler.wait(counters[N_STAGES - 1]);
+}
+
+void runCull(jobs::Scheduler& scheduler, Results& results) {
+    gfx::cullParallel(cull_frustum, cull_boxes, scheduler, CULL_GRAIN, results.visible);
+}
+
+void markTransforms() {
+    for (unsigned int i = 0; i < N_TRANSFORMS; i++) {
+        transforms.setYaw(i, 0.001f * i);
+    }
+}
+
+void runTransforms(jobs::Scheduler& scheduler, Results& results) {
+    markTransforms();
+    transforms.update(results.transformed, scheduler);
+}
+
+bool sameResults(const Results& a, const Results& b) {
+    for (unsigned int i = 0; i < N_EVEN; i++) {
+        if (a.even[i] != b.even[i]) {
+            return false;
+        }
+    }
+    for (unsigned int i = 0; i < N_TRANSFORMS; i++) {
+        if (a.transformed.models[i] != b.transformed.models[i]) {
+            return false;
+        }
+    }
+    // the chunks' lists in order are the serial list
+    std::vector<unsigned int> a_visible, b_visible;
+    for (const std::vector<unsigned int>& chunk : a.visible) {
+        a_visible.insert(a_visible.end(), chunk.begin(), chunk.end());
+    }
+    for (const std::vector<unsigned int>& chunk : b.visible) {
+        b_visible.insert(b_visible.end(), chunk.begin(), chunk.end());
+    }
+    return a.uneven == b.uneven && a.stages == b.stages && a_visible == b_visible;
+}
+
+int main(int argc, char** argv)
+{
+    const int n_runs = (argc > 1) ? std::atoi(argv[1]) : 10;
+    const unsigned int max_threads = (argc > 2) ? std::atoi(argv[2]) : std::max(std::thread::hardware_concurrency(), 1u);
+
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 2.0f, 0.0f), glm::vec3(0.0f, 2.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    cull_frustum = gfx::Frustum::fromMatrix(projection * view);
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> position(-200.0f, 200.0f);
+    std::uniform_real_distribution<float> size(0.5f, 4.0f);
+    for (unsigned int i = 0; i < N_CULL; i++) {
+        glm::vec3 min(position(rng), position(rng) * 0.1f, position(rng));
+        cull_boxes.add(min, min + glm::vec3(size(rng), size(rng), size(rng)));
+    }
+    transforms.reserve(N_TRANSFORMS);
+    for (unsigned int i = 0; i < N_TRANSFORMS; i++) {
+        transforms.add(i, glm::vec3(position(rng), 0.0f, position(rng)), 0.0f, glm::vec3(size(rng)), glm::vec3(0.5f, 0.0f, 0.5f));
+    }
+
+    // serial reference
+    Results reference;
+    for (unsigned int i = 0; i < N_EVEN; i++) {
+        reference.even[i] = evenItem(i);
+    }
+    for (unsigned int i = 0; i < N_UNEVEN; i++) {
+        reference.uneven[i] = unevenItem(i);
+    }
+    for (unsigned int stage = 0; stage < N_STAGES; stage++) {
+        for (unsigned int j = 0; j < N_STAGE_JOBS; j++) {
+            reference.stages[stage][j] = stageItem(stage ? reference.stages[stage - 1] : std::vector<float>(), j);
+        }
+    }
+    reference.visible.resize(1);
+    gfx::cull(cull_frustum, cull_boxes, reference.visible[0]);
+    markTransforms();
+    transforms.update(reference.transformed);
+
+    std::vector<unsigned int> thread_counts;
+    for (unsigned int n = 1; n < max_threads; n *= 2) {
+        thread_counts.push_back(n);
+    }
+    thread_counts.push_back(max_threads);
+
+    const char* names[] = { "even", "uneven", "graph", "cull", "xforms" };
+    void (*workloads[])(jobs::Scheduler&, Results&) = { runEven, runUneven, runGraph, runCull, runTransforms };
+    const unsigned int n_workloads = sizeof(workloads) / sizeof(workloads[0]);
+
+    std::cout << std::setw(8) << "threads";
+    for (const char* name : names) {
+        std::cout << std::setw(10) << name << " ms" << std::setw(9) << "speedup";
+    }
+    std::cout << std::endl;
+
+    std::vector<double> one_thread_ms(n_workloads, 0.0);
+    for (unsigned int n_threads : thread_counts) {
+        jobs::Scheduler scheduler(n_threads);
+        Results results;
+        std::cout << std::setw(8) << n_threads << std::fixed << std::setprecision(3);
+        for (unsigned int w = 0; w < n_workloads; w++) {
+            double best_ms = 1e30;
+            for (int run = 0; run < n_runs; run++) {
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                workloads[w](scheduler, results);
+                best_ms = std::min(best_ms, millisecondsSince(start));
+            }
+            if (n_threads == 1) {
+                one_thread_ms[w] = best_ms;
+            }
+            std::cout << std::setw(13) << best_ms << std::setw(9) << one_thread_ms[w] / best_ms;
+        }
+        std::cout << std::endl;
+
+        if (!sameResults(results, reference)) {
+            std::cout << "MISMATCH between " << n_threads << " threads and serial" << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,418 @@
+// Headless rendering benchmark. Renders a synthetic scene of blocks along a
+// fixed camera path into an offscreen framebuffer, using an EGL surfaceless
+// context so it also runs on software rasterisers (llvmpipe) without a GPU.
+// Run from the repository root so the shader paths resolve.
+//
+// --mode shaders instead builds the game's shader programs through a
+// gfx::ShaderLibrary caching into --shader-cache DIR and reports how long
+// that took. Run it twice for cold and warm startup; a driver with its own
+// shader cache (Mesa's) needs it cleared too for a cold run, e.g. by
+// pointing MESA_SHADER_CACHE_DIR at an empty directory.
+//
+// --mode terrain and --mode lod draw the game's voxel terrain instead of
+// blocks, from a camera circling above it, and report triangles per frame.
+//
+// usage: glitch_bench [--blocks N] [--frames F] [--mode naive|queued|instanced|streamed|culled|shaders|terrain|lod]
+//                     [--shader-cache DIR]
+
+#include <glad/glad.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <glitch/shader.h>
+#include <glitch/shader_library.h>
+#include <glitch/graphics.h>
+#include <glitch/culling.h>
+#include <glitch/render_queue.h>
+#include <glitch/voxel.h>
+#include <glitch/lod.h>
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+
+const unsigned int WIDTH = 800;
+const unsigned int HEIGHT = 600;
+
+// naive: one VAO and draw call per block, like main.cpp used to do
+// queued: the same draws sorted front to back by a RenderQueue
+// instanced: every block in one InstancedBatch
+// streamed: instanced, every instance rewritten to a StreamBuffer each frame
+// culled: instanced, drawing only what survives frustum culling
+// shaders: no frames, only the startup cost of building the shader programs
+// terrain: every voxel chunk's full mesh, out to the game's view distance
+// lod: the chunks at the level of detail main.cpp picks for them
+enum class Mode {
+    Naive,
+    Queued,
+    Instanced,
+    Streamed,
+    Culled,
+    Shaders,
+    Terrain,
+    Lod
+};
+
+struct Options {
+    unsigned int n_blocks = 10000;
+    unsigned int n_frames = 300;
+    Mode mode = Mode::Instanced;
+    std::string shader_cache = "shader_cache";
+};
+
+bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--blocks" && i + 1 < argc) {
+            options.n_blocks = std::atoi(argv[++i]);
+        } else if (arg == "--frames" && i + 1 < argc) {
+            options.n_frames = std::atoi(argv[++i]);
+        } else if (arg == "--mode" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "naive") options.mode = Mode::Naive;
+            else if (mode == "queued") options.mode = Mode::Queued;
+            else if (mode == "instanced") options.mode = Mode::Instanced;
+            else if (mode == "streamed") options.mode = Mode::Streamed;
+            else if (mode == "culled") options.mode = Mode::Culled;
+            else if (mode == "shaders") options.mode = Mode::Shaders;
+            else if (mode == "terrain") options.mode = Mode::Terrain;
+            else if (mode == "lod") options.mode = Mode::Lod;
+            else return false;
+        } else if (arg == "--shader-cache" && i + 1 < argc) {
+            options.shader_cache = argv[++i];
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// surfaceless EGL context with a 3.3 core profile, no window system needed
+bool createContext() {
+    EGLDisplay display = EGL_NO_DISPLAY;
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay) {
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    }
+    if (display == EGL_NO_DISPLAY) {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) {
+        std::cout << "Failed to initialize EGL" << std::endl;
+        return false;
+    }
+    eglBindAPI(EGL_OPENGL_API);
+
+    const EGLint config_attribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint n_configs = 0;
+    if (!eglChooseConfig(display, config_attribs, &config, 1, &n_configs) || n_configs == 0) {
+        std::cout << "Failed to choose an EGL config" << std::endl;
+        return false;
+    }
+
+    const EGLint context_attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs);
+    if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        std::cout << "Failed to create a surfaceless GL context" << std::endl;
+        return false;
+    }
+
+    if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// color + depth renderbuffers standing in for the window's back buffer
+unsigned int createFramebuffer() {
+    unsigned int fbo, color, depth;
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glGenRenderbuffers(1, &color);
+    glBindRenderbuffer(GL_RENDERBUFFER, color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, WIDTH, HEIGHT);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+    glGenRenderbuffers(1, &depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, WIDTH, HEIGHT);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+    glViewport(0, 0, WIDTH, HEIGHT);
+    return fbo;
+}
+
+// blocks on a square grid with deterministic sizes and colors
+std::vector<gfx::SolidColorBlock> syntheticScene(unsigned int n_blocks, std::vector<glm::vec4>& colors) {
+    std::vector<gfx::SolidColorBlock> blocks;
+    const unsigned int side = static_cast<unsigned int>(std::ceil(std::sqrt(static_cast<float>(n_blocks))));
+    const float spacing = 2.0f;
+    for (unsigned int i = 0; i < n_blocks; i++) {
+        float x = (i % side) * spacing - side * spacing / 2;
+        float z = (i / side) * spacing - side * spacing / 2;
+        float height = 0.5f + (i * 7919 % 13) * 0.1f;
+        blocks.push_back(gfx::SolidColorBlock(glm::vec3(x, 0.0f, z), glm::vec3(1.0f, height, 1.0f)));
+        colors.push_back(glm::vec4((i % 5) * 0.2f, (i % 7) * 0.14f, (i % 11) * 0.09f, 1.0f));
+    }
+    return blocks;
+}
+
+// the game's programs, as main.cpp builds them
+int benchShaders(const std::string& cache_directory) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    gfx::ShaderLibrary shaders(cache_directory);
+    shaders.add("src/shaders/v_instanced.glsl", "src/shaders/f_instanced_texture_array.glsl");
+    shaders.add("src/shaders/v_instanced.glsl", "src/shaders/f_instanced_color.glsl");
+    shaders.add("src/shaders/v_voxel.glsl", "src/shaders/f_dithered_color.glsl");
+    shaders.add("src/shaders/v_billboard.glsl", "src/shaders/f_dithered_color.glsl");
+    shaders.add("src/shaders/vertex.glsl", "src/shaders/f_color.glsl");
+    if (!shaders.compile()) {
+        return 1;
+    }
+    const double issued_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    const bool ready = shaders.ready();
+    if (!shaders.finish()) {
+        return 1;
+    }
+    // make sure the programs are usable, some drivers finish work on first use
+    for (unsigned int i = 0; i < shaders.stats().n_programs; i++) {
+        shaders.program(i).use();
+    }
+    glFinish();
+    const double total_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    const gfx::ShaderLibrary::Stats& stats = shaders.stats();
+    std::cout << std::fixed << std::setprecision(3)
+              << "shaders: " << stats.n_programs << " programs, " << stats.n_cached << " from the cache, " << stats.n_stale << " stale" << std::endl
+              << (stats.n_cached == stats.n_programs ? "warm" : "cold") << " startup ms: " << total_ms
+              << " (compile() returned after " << issued_ms << ", " << (ready ? "all ready" : "still building") << " then)" << std::endl;
+    shaders.deallocate();
+    return 0;
+}
+
+double percentile(std::vector<double> values, double p) {
+    std::sort(values.begin(), values.end());
+    unsigned int index = std::min<unsigned int>(values.size() - 1, static_cast<unsigned int>(p * values.size()));
+    return values[index];
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cout << "usage: glitch_bench [--blocks N] [--frames F] [--mode naive|queued|instanced|streamed|culled|shaders|terrain|lod] [--shader-cache DIR]" << std::endl;
+        return 1;
+    }
+    if (!createContext()) {
+        return 1;
+    }
+    createFramebuffer();
+    gfx::GLState::instance().enable(GL_DEPTH_TEST);
+
+    std::cout << "renderer: " << glGetString(GL_RENDERER) << std::endl;
+    if (options.mode == Mode::Shaders) {
+        return benchShaders(options.shader_cache);
+    }
+
+    std::vector<glm::vec4> colors;
+    std::vector<gfx::SolidColorBlock> blocks = syntheticScene(options.n_blocks, colors);
+
+    CameraUniforms camera_uniforms;
+    Shader naive_shader("src/shaders/vertex.glsl", "src/shaders/f_color.glsl");
+    Shader instanced_shader("src/shaders/v_instanced.glsl", "src/shaders/f_instanced_color.glsl");
+    Uniform<glm::mat4> model_uniform = naive_shader.uniform<glm::mat4>("model");
+    Uniform<glm::vec4> color_uniform = naive_shader.uniform<glm::vec4>("color");
+    gfx::RenderQueue render_queue;
+    gfx::RenderQueue::MaterialId block_material = render_queue.addMaterial(naive_shader);
+    gfx::StreamBuffer stream(options.n_blocks * sizeof(gfx::InstanceData) + 4096);
+
+    // the terrain modes' world and programs, with main.cpp's level of detail settings
+    const bool terrain = options.mode == Mode::Terrain || options.mode == Mode::Lod;
+    const float view_distance = 1000.0f;
+    vox::VoxelWorld voxels({
+        glm::vec4(0.0f),
+        glm::vec4(0.35f, 0.7f, 0.3f, 1.0f),
+        glm::vec4(0.55f, 0.4f, 0.25f, 1.0f),
+        glm::vec4(0.5f, 0.5f, 0.55f, 1.0f),
+    });
+    gfx::LodSelector lod(gfx::LodSettings { { 120.0f, 48.0f }, 0.15f, 0.3f, view_distance });
+    Shader voxel_shader("src/shaders/v_voxel.glsl", "src/shaders/f_dithered_color.glsl");
+    Shader impostor_shader("src/shaders/v_billboard.glsl", "src/shaders/f_dithered_color.glsl");
+    gfx::RenderQueue::MaterialId voxel_material = render_queue.addMaterial(voxel_shader);
+    gfx::RenderQueue::MaterialId impostor_material = render_queue.addMaterial(impostor_shader);
+    if (terrain) {
+        // main.cpp's hills, centered on the camera
+        vox::generateHills(voxels, glm::ivec3(-384, 0, -384), 768, 768);
+        voxels.remeshDirty();
+        vox::MeshStats mesh_stats = voxels.stats();
+        std::cout << "terrain: " << voxels.chunkCount() << " chunks, " << mesh_stats.n_triangles << " triangles, "
+                  << mesh_stats.n_proxy_triangles << " as proxies, meshed in " << mesh_stats.mesh_ms << " ms" << std::endl;
+        render_queue.setMaxDepth(view_distance);
+    }
+
+    // build the scene for the chosen mode
+    std::vector<gfx::VAO> vaos;
+    gfx::InstancedBatch batch(gfx::BlockLayout::SolidColor, options.n_blocks);
+    std::vector<gfx::InstancedBatch::InstanceId> instances;
+    gfx::CullingBoxes cull_boxes;
+    std::vector<unsigned int> visible;
+    for (unsigned int i = 0; i < blocks.size() && !terrain; i++) {
+        if (options.mode == Mode::Naive || options.mode == Mode::Queued) {
+            vaos.push_back(gfx::VAO());
+            vaos.back().initCube<gfx::SolidColorBlock::Layout>();
+        } else {
+            instances.push_back(batch.add(gfx::blockModel(blocks[i]), colors[i]));
+            cull_boxes.add(blocks[i].position(), blocks[i].position() + blocks[i].size());
+        }
+    }
+
+    // one GL_TIME_ELAPSED query per frame, read back after the run so it never stalls
+    std::vector<unsigned int> queries(options.n_frames);
+    glGenQueries(options.n_frames, queries.data());
+
+    const float fov_y = glm::radians(45.0f);
+    // the terrain gets main.cpp's third person near plane, for its depth range
+    const glm::mat4 projection = glm::perspective(fov_y, (float)WIDTH / (float)HEIGHT, terrain ? 1.0f : 0.1f, terrain ? view_distance : 100.0f);
+    const float orbit_radius = terrain ? 300.0f : std::max(10.0f, std::sqrt(static_cast<float>(options.n_blocks)));
+    std::vector<double> cpu_ms;
+    unsigned long long n_draw_calls = 0;
+    unsigned long long n_triangles[gfx::N_LODS] = { 0, 0, 0 };
+
+    glFinish();
+    gfx::GLState::instance().resetCounters();
+    for (unsigned int frame = 0; frame < options.n_frames; frame++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        glBeginQuery(GL_TIME_ELAPSED, queries[frame]);
+
+        // fixed path: one orbit around the scene over the run
+        float angle = glm::two_pi<float>() * frame / options.n_frames;
+        glm::vec3 eye(orbit_radius * std::cos(angle), terrain ? 60.0f : 8.0f, orbit_radius * std::sin(angle));
+        glm::mat4 view = glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        camera_uniforms.update(projection, view);
+
+        glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        if (options.mode == Mode::Naive) {
+            naive_shader.use();
+            for (unsigned int i = 0; i < blocks.size(); i++) {
+                vaos[i].bind();
+                naive_shader.set(model_uniform, gfx::blockModel(blocks[i]));
+                naive_shader.set(color_uniform, colors[i]);
+                vaos[i].drawElements(gfx::N_CUBE_DRAW_VERTICES);
+                n_draw_calls++;
+            }
+        } else if (options.mode == Mode::Queued) {
+            render_queue.clear();
+            for (unsigned int i = 0; i < blocks.size(); i++) {
+                gfx::DrawItem item(&vaos[i], gfx::N_CUBE_DRAW_VERTICES);
+                item.model = gfx::blockModel(blocks[i]);
+                item.color = colors[i];
+                render_queue.submit(block_material, item, glm::distance(eye, blocks[i].position()));
+            }
+            render_queue.flush();
+            n_draw_calls += render_queue.stats().n_items;
+        } else if (options.mode == Mode::Instanced) {
+            instanced_shader.use();
+            batch.draw();
+            n_draw_calls++;
+        } else if (options.mode == Mode::Streamed) {
+            instanced_shader.use();
+            stream.beginFrame();
+            batch.prepare(stream).draw();
+            stream.endFrame();
+            n_draw_calls++;
+        } else if (terrain) {
+            render_queue.clear();
+            if (options.mode == Mode::Terrain) {
+                voxels.forEachDraw(gfx::Frustum::fromMatrix(projection * view), [&](const gfx::DrawItem& item, glm::vec3 center) {
+                    render_queue.submit(voxel_material, item, glm::distance(eye, center));
+                    n_triangles[gfx::LOD_FULL] += item.n_indices / 3;
+                });
+            } else {
+                // a 60 Hz frame for the fades
+                lod.begin(eye, fov_y, (float)HEIGHT, 1.0f / 60.0f);
+                voxels.forEachLodDraw(lod, gfx::Frustum::fromMatrix(projection * view), [&](const gfx::DrawItem& item, unsigned int level, glm::vec3 center) {
+                    render_queue.submit(level == gfx::LOD_IMPOSTOR ? impostor_material : voxel_material, item, glm::distance(eye, center));
+                });
+                for (unsigned int level = 0; level < gfx::N_LODS; level++) {
+                    n_triangles[level] += lod.stats().n_triangles[level];
+                }
+            }
+            render_queue.flush();
+            n_draw_calls += render_queue.stats().n_items;
+        } else {
+            instanced_shader.use();
+            gfx::cull(gfx::Frustum::fromMatrix(projection * view), cull_boxes, visible);
+            batch.clearVisible();
+            for (unsigned int box : visible) {
+                batch.addVisible(instances[box]);
+            }
+            batch.drawVisible();
+            n_draw_calls++;
+        }
+
+        glEndQuery(GL_TIME_ELAPSED);
+        // stands in for the swap, the driver may queue at most a frame or so of work
+        glFlush();
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        cpu_ms.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    glFinish();
+
+    // median rather than mean, some drivers report junk for the first query
+    std::vector<double> gl_ms;
+    for (unsigned int query : queries) {
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+        gl_ms.push_back(ns / 1e6);
+    }
+
+    gfx::GLState::Counters gl_calls = gfx::GLState::instance().counters();
+    const char* mode_names[] = { "naive", "queued", "instanced", "streamed", "culled", "shaders", "terrain", "lod" };
+    std::cout << std::fixed << std::setprecision(3)
+              << "mode " << mode_names[static_cast<int>(options.mode)]
+              << ", " << options.n_blocks << " blocks, " << options.n_frames << " frames" << std::endl
+              << "cpu frame ms: p50 " << percentile(cpu_ms, 0.5)
+              << "  p90 " << percentile(cpu_ms, 0.9)
+              << "  p99 " << percentile(cpu_ms, 0.99)
+              << "  max " << percentile(cpu_ms, 1.0) << std::endl
+              << "draw calls per frame: " << static_cast<double>(n_draw_calls) / options.n_frames << std::endl
+              << "state calls per frame: " << static_cast<double>(gl_calls.issued) / options.n_frames
+              << " issued, " << static_cast<double>(gl_calls.skipped) / options.n_frames << " skipped" << std::endl
+              << "gl frame ms: p50 " << percentile(gl_ms, 0.5) << std::endl;
+    if (terrain) {
+        std::cout << "triangles per frame: full " << static_cast<double>(n_triangles[gfx::LOD_FULL]) / options.n_frames
+                  << ", proxy " << static_cast<double>(n_triangles[gfx::LOD_PROXY]) / options.n_frames
+                  << ", impostor " << static_cast<double>(n_triangles[gfx::LOD_IMPOSTOR]) / options.n_frames << std::endl;
+    }
+
+    glDeleteQueries(options.n_frames, queries.data());
+    for (gfx::VAO& vao : vaos) {
+        vao.deallocate();
+    }
+    batch.deallocate();
+    voxels.deallocate();
+    stream.deallocate();
+    camera_uniforms.deallocate();
+    return 0;
+}
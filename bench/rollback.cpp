@@ -0,0 +1,252 @@
+// Rollback benchmark. Plays a match between two rollback sessions connected
+// by loopback channels with artificial delay, jitter and loss, checks every
+// confirmed state against a reference run that knew all inputs up front,
+// then measures how many frames of resimulation fit in a 16 ms frame.
+//
+// usage: glitch_bench_rollback [--frames F] [--delay-ms D] [--jitter-ms J] [--loss P] [--input-delay N]
+
+#include <glm/glm.hpp>
+
+#include <glitch/fight.h>
+#include <glitch/rollback.h>
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
+typedef net::Session<fight::GameState, fight::Input, fight::N_PLAYERS> Session;
+
+const double TICK_RATE = 120.0;
+const double FRAME_BUDGET_MS = 16.0;
+
+struct Options {
+    unsigned int n_frames = 3000;
+    double delay_ms = 50.0;
+    double jitter_ms = 10.0;
+    float loss = 0.05f;
+    unsigned int input_delay = 2;
+};
+
+bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--frames" && i + 1 < argc) {
+            options.n_frames = std::atoi(argv[++i]);
+        } else if (arg == "--delay-ms" && i + 1 < argc) {
+            options.delay_ms = std::atof(argv[++i]);
+        } else if (arg == "--jitter-ms" && i + 1 < argc) {
+            options.jitter_ms = std::atof(argv[++i]);
+        } else if (arg == "--loss" && i + 1 < argc) {
+            options.loss = std::atof(argv[++i]);
+        } else if (arg == "--input-delay" && i + 1 < argc) {
+            options.input_delay = std::atoi(argv[++i]);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// the arena from main.cpp: ground, a few blocks, two spawns on the ground
+fight::Simulation::Config simulationConfig() {
+    fight::Simulation::Config config;
+    config.dt = static_cast<float>(1.0 / TICK_RATE);
+    config.hurtbox_size = glm::vec3(0.7f);
+    config.move_speed = 2.5f;
+    config.mouse_sensitivity = 0.1f;
+    config.gravity = 9.8f;
+    config.jump_speed = 4.0f;
+    config.kill_height = -10.0f;
+    return config;
+}
+
+void buildArena(fight::Simulation& simulation, unsigned int n_extra_boxes) {
+    simulation.addStaticBox(Aabb(glm::vec3(-2.5f, -1.0f, -2.5f), glm::vec3(2.5f, 0.0f, 2.5f)));
+    simulation.addStaticBox(Aabb(glm::vec3(-2.0f, 0.0f, 0.0f), glm::vec3(-1.2f, 0.8f, 0.8f)));
+    simulation.addStaticBox(Aabb(glm::vec3(-0.5f, 0.5f, -1.0f), glm::vec3(0.5f, 1.5f, 0.0f)));
+    simulation.addStaticBox(Aabb(glm::vec3(0.0f, 0.0f, 10.0f), glm::vec3(1.0f, 1.0f, 11.0f)));
+    simulation.addStaticBox(Aabb(glm::vec3(-10.0f, 0.0f, 0.0f), glm::vec3(-9.0f, 1.0f, 1.0f)));
+    simulation.addStaticBox(Aabb(glm::vec3(10.0f, 0.0f, 0.0f), glm::vec3(11.0f, 1.0f, 1.0f)));
+
+    // scattered platforms away from the fighters, only adding collision work
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> position(20.0f, 200.0f);
+    for (unsigned int i = 0; i < n_extra_boxes; i++) {
+        glm::vec3 min(position(rng), position(rng) * 0.1f, position(rng));
+        simulation.addStaticBox(Aabb(min, min + glm::vec3(2.0f)));
+    }
+
+    // body and head hurtboxes, a jab reaching in front
+    simulation.addHurtbox(fight::BoxShape { glm::vec3(0.0f, -0.1f, 0.0f), glm::vec3(0.35f, 0.25f, 0.35f) });
+    simulation.addHurtbox(fight::BoxShape { glm::vec3(0.0f, 0.25f, 0.0f), glm::vec3(0.15f) });
+    fight::Simulation::Attack jab;
+    jab.hitbox = fight::BoxShape { glm::vec3(0.6f, 0.1f, 0.0f), glm::vec3(0.25f, 0.1f, 0.1f) };
+    jab.active_ticks = 6;
+    jab.recovery_ticks = 18;
+    jab.hitstun_ticks = 30;
+    jab.knockback = 4.0f;
+    simulation.setAttack(jab);
+
+    simulation.addSpawn(glm::vec3(1.5f, 0.5f, 1.5f), -135.0f);
+    simulation.addSpawn(glm::vec3(1.0f, 0.5f, -1.5f), 135.0f);
+}
+
+// what player presses on frame, held for a while like a person would
+fight::Input scriptedInput(unsigned int player, unsigned int frame) {
+    uint32_t hash = (player + 1) * 2654435761u ^ (frame / 15) * 2246822519u;
+    hash = fight::nextRandom(hash);
+    fight::Input input;
+    input.buttons = hash & 0x3f;
+    input.look_x = static_cast<int16_t>((hash >> 8) % 9) - 4;
+    input.look_y = static_cast<int16_t>((hash >> 12) % 5) - 2;
+    return input;
+}
+
+fight::Input matchInput(unsigned int player, unsigned int frame, unsigned int input_delay) {
+    return frame < input_delay ? fight::Input() : scriptedInput(player, frame);
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cout << "usage: glitch_bench_rollback [--frames F] [--delay-ms D] [--jitter-ms J] [--loss P] [--input-delay N]" << std::endl;
+        return 1;
+    }
+
+    fight::Simulation simulation(simulationConfig());
+    buildArena(simulation, 0);
+    Session::Step step = [&](fight::GameState& state, const fight::Input* inputs) {
+        simulation.step(state, inputs);
+    };
+    const fight::GameState initial = simulation.initialState(7);
+
+    // reference states, reference[f] is the state at the start of frame f
+    std::vector<uint32_t> reference;
+    fight::GameState reference_state = initial;
+    auto referenceChecksum = [&](unsigned int frame) {
+        while (reference.size() <= frame) {
+            reference.push_back(net::checksum(reference_state));
+            fight::Input inputs[fight::N_PLAYERS];
+            for (unsigned int player = 0; player < fight::N_PLAYERS; player++) {
+                inputs[player] = matchInput(player, reference.size() - 1, options.input_delay);
+            }
+            simulation.step(reference_state, inputs);
+        }
+        return reference[frame];
+    };
+
+    // two peers, channel i carries packets to peer i
+    std::vector<Session> peers;
+    std::vector<net::LoopbackChannel<Session::Packet>> channels;
+    for (unsigned int player = 0; player < fight::N_PLAYERS; player++) {
+        peers.push_back(Session(initial, step, player, options.input_delay));
+        channels.push_back(net::LoopbackChannel<Session::Packet>(
+            options.delay_ms / 1000.0, options.jitter_ms / 1000.0, options.loss, 100 + player
+        ));
+    }
+
+    unsigned int n_checked = 0;
+    unsigned int n_desyncs = 0;
+    int checked_up_to[fight::N_PLAYERS] = { -1, -1 };
+    unsigned int n_ticks = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    while (peers[0].frame() < options.n_frames || peers[1].frame() < options.n_frames) {
+        const double now = n_ticks / TICK_RATE;
+        for (unsigned int player = 0; player < fight::N_PLAYERS; player++) {
+            Session& peer = peers[player];
+            channels[player].receive(now, [&](const Session::Packet& packet) {
+                peer.receive(packet);
+            });
+            if (peer.frame() < options.n_frames) {
+                peer.advance(matchInput(player, peer.localInputFrame(), options.input_delay));
+            }
+            channels[1 - player].send(peer.packetFor(1 - player), now);
+
+            // every input before this frame is final, so its state must match the
+            // reference. with input delay longer than the link the inputs can be
+            // confirmed ahead of the simulation, then check the newest state
+            const int confirmed = std::min(peer.confirmedFrame() + 1, static_cast<int>(peer.frame()));
+            fight::GameState state;
+            if (confirmed > checked_up_to[player] && peer.stateAt(confirmed, state)) {
+                if (net::checksum(state) != referenceChecksum(confirmed)) {
+                    n_desyncs++;
+                }
+                n_checked++;
+                checked_up_to[player] = confirmed;
+            }
+        }
+        n_ticks++;
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    std::cout << std::fixed << std::setprecision(3)
+              << "loopback: " << options.n_frames << " frames at " << TICK_RATE << " Hz, "
+              << options.delay_ms << " ms delay, " << options.jitter_ms << " ms jitter, "
+              << options.loss * 100.0f << "% loss, input delay " << options.input_delay << " frames" << std::endl;
+    for (unsigned int player = 0; player < fight::N_PLAYERS; player++) {
+        const Session::Stats& stats = peers[player].stats();
+        std::cout << "  peer " << player << ": " << stats.n_rollbacks << " rollbacks, "
+                  << stats.n_resimulated_frames << " frames resimulated (max " << stats.max_rollback_frames << " at once), "
+                  << stats.n_stalls << " stalled ticks, "
+                  << channels[player].stats().n_dropped << "/" << channels[player].stats().n_sent << " packets lost" << std::endl;
+    }
+    std::cout << "  " << n_checked << " confirmed states checked, " << n_desyncs << " desyncs, "
+              << std::chrono::duration<double, std::milli>(end - start).count() << " ms wall" << std::endl;
+
+    // cost of one resimulated frame: a snapshot save plus a step, and one restore per rollback
+    std::cout << std::setw(10) << "boxes" << std::setw(12) << "save ns" << std::setw(12) << "load ns"
+              << std::setw(12) << "step us" << std::setw(16) << "frames/16ms" << std::endl;
+    const unsigned int extra_boxes[] = { 0, 100, 1000, 10000 };
+    for (unsigned int n_extra : extra_boxes) {
+        fight::Simulation arena(simulationConfig());
+        buildArena(arena, n_extra);
+        net::SnapshotRing<fight::GameState, 16> ring;
+        fight::GameState state = arena.initialState(7);
+        const unsigned int n_steps = 20000;
+
+        std::chrono::steady_clock::time_point save_start = std::chrono::steady_clock::now();
+        for (unsigned int frame = 0; frame < n_steps; frame++) {
+            ring.save(frame, state);
+            state.tick++;
+        }
+        std::chrono::steady_clock::time_point save_end = std::chrono::steady_clock::now();
+        for (unsigned int frame = 0; frame < n_steps; frame++) {
+            ring.load(n_steps - 1 - frame % 16, state);
+        }
+        std::chrono::steady_clock::time_point load_end = std::chrono::steady_clock::now();
+        for (unsigned int frame = 0; frame < n_steps; frame++) {
+            fight::Input inputs[fight::N_PLAYERS] = { scriptedInput(0, frame), scriptedInput(1, frame) };
+            ring.save(frame, state);
+            arena.step(state, inputs);
+        }
+        std::chrono::steady_clock::time_point step_end = std::chrono::steady_clock::now();
+
+        const double save_ns = std::chrono::duration<double, std::nano>(save_end - save_start).count() / n_steps;
+        const double load_ns = std::chrono::duration<double, std::nano>(load_end - save_end).count() / n_steps;
+        const double frame_us = std::chrono::duration<double, std::micro>(step_end - load_end).count() / n_steps;
+        std::cout << std::setw(10) << n_extra + 6
+                  << std::setw(12) << std::setprecision(1) << save_ns
+                  << std::setw(12) << load_ns
+                  << std::setw(12) << std::setprecision(3) << frame_us
+                  << std::setw(16) << static_cast<unsigned long>(FRAME_BUDGET_MS * 1000.0 / frame_us) << std::endl;
+        // keep the loops from being optimized away
+        volatile uint32_t sink = net::checksum(state);
+        (void)sink;
+    }
+    std::cout << "snapshot: " << sizeof(fight::GameState) << " bytes" << std::endl;
+
+    // confirmations arrive in bursts so not every frame gets checked, but a
+    // run that checked few of them verified nothing
+    const unsigned int n_simulated = fight::N_PLAYERS * options.n_frames;
+    if (n_checked < n_simulated / 2) {
+        std::cout << "only " << n_checked << " of " << n_simulated << " simulated frames checked" << std::endl;
+        return 1;
+    }
+    return n_desyncs == 0 ? 0 : 1;
+}
@@ -0,0 +1,212 @@
+// Scene loading benchmark. Writes a city of blocks in the text and the
+// binary scene form, then times what the game does on load:
+//   text      parse and compile the text form
+//   binary    map the binary form and check it
+//   instances model matrices, colors and layers for the instance buffers,
+//             read straight from the mapped arrays
+//   world     a World entity per block and the tree over them, built in one go
+//   inserts   the same with a World::add, so a tree insert, per block
+// and the instance bytes that would then go to the GPU. Every loaded array
+// is checked against what was written, and queries on the built tree
+// against a scan of every block.
+//
+// usage: glitch_bench_scene [n_runs]
+
+#include <glm/glm.hpp>
+
+#include <glitch/scene.h>
+#include <glitch/transforms.h>
+#include <glitch/world.h>
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// what InstancedBatch keeps and uploads per instance
+struct Instance {
+    glm::mat4 model;
+    glm::vec4 color;
+    float layer;
+};
+
+struct Instances {
+    std::vector<Instance> instances;
+
+    glm::mat4& model(unsigned int instance) {
+        return instances[instance].model;
+    }
+};
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// blocks stacked into towers on a grid, one in eight textured
+scene::SceneDesc makeCity(unsigned int n_blocks) {
+    std::mt19937 rng(n_blocks);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    scene::SceneDesc desc;
+    desc.addTexture("src/images/container.jpg");
+    const unsigned int side = 64;
+    for (unsigned int i = 0; i < n_blocks; i++) {
+        const unsigned int tower = i / 16;
+        const glm::vec3 position(2.0f * (tower % side), float(i % 16), 2.0f * (tower / side));
+        const glm::vec3 size(1.0f + unit(rng), 1.0f, 1.0f + unit(rng));
+        const glm::vec4 color(unit(rng), unit(rng), unit(rng), 1.0f);
+        desc.addBlock(position, size, color, (i % 8 == 0) ? 0 : scene::NO_TEXTURE);
+    }
+    return desc;
+}
+
+bool writeText(const std::string& path, const scene::SceneDesc& desc) {
+    std::ofstream file(path.c_str());
+    file << std::setprecision(9);
+    for (unsigned int i = 0; i < desc.texture_paths.size(); i++) {
+        file << "texture t" << i << " " << desc.texture_paths[i] << "\n";
+    }
+    for (unsigned int i = 0; i < desc.blockCount(); i++) {
+        const glm::vec3& p = desc.positions[i];
+        const glm::vec3& s = desc.sizes[i];
+        const glm::vec4& c = desc.colors[i];
+        file << "block " << p.x << " " << p.y << " " << p.z << " " << s.x << " " << s.y << " " << s.z << " "
+             << c.x << " " << c.y << " " << c.z << " " << c.w;
+        if (desc.textures[i] != scene::NO_TEXTURE) {
+            file << " t" << desc.textures[i];
+        }
+        file << "\n";
+    }
+    return bool(file);
+}
+
+// blocks overlapping boxes spread over the city, from the tree and by scanning
+bool sameOverlaps(const World& world, const scene::Scene& level) {
+    std::vector<World::BlockId> found;
+    for (unsigned int q = 0; q < 64; q++) {
+        const glm::vec3 min(float(q % 8) * 16.0f, float(q % 4) * 4.0f, float(q / 8) * 16.0f);
+        const Aabb box(min, min + glm::vec3(5.0f));
+        world.overlapping(box, found);
+        unsigned int n_scanned = 0;
+        for (unsigned int i = 0; i < level.blockCount(); i++) {
+            n_scanned += Aabb(level.positions()[i], level.positions()[i] + level.sizes()[i]).overlaps(box);
+        }
+        if (found.size() != n_scanned) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool sameScene(const scene::Scene& level, const scene::SceneDesc& desc) {
+    if (level.blockCount() != desc.blockCount() || level.textureCount() != desc.texture_paths.size()) {
+        return false;
+    }
+    for (unsigned int i = 0; i < desc.blockCount(); i++) {
+        if (level.positions()[i] != desc.positions[i] || level.sizes()[i] != desc.sizes[i]
+            || level.colors()[i] != desc.colors[i] || level.textures()[i] != desc.textures[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    const int n_runs = (argc > 1) ? std::atoi(argv[1]) : 3;
+    const unsigned int counts[] = { 10000, 100000, 1000000 };
+    const std::string text_path = "glitch_bench_scene.scene";
+    const std::string binary_path = "glitch_bench_scene.glsc";
+
+    std::cout << std::setw(9) << "blocks" << std::setw(10) << "text MB" << std::setw(10) << "bin MB"
+              << std::setw(10) << "text ms" << std::setw(11) << "binary ms" << std::setw(14) << "instances ms"
+              << std::setw(10) << "world ms" << std::setw(12) << "inserts ms" << std::setw(11) << "upload MB" << std::endl;
+
+    for (unsigned int n_blocks : counts) {
+        const scene::SceneDesc desc = makeCity(n_blocks);
+        if (!writeText(text_path, desc) || !scene::save(binary_path, desc)) {
+            std::cout << "Failed to write the scenes" << std::endl;
+            return 1;
+        }
+
+        double text_ms = 1e30;
+        double binary_ms = 1e30;
+        double instances_ms = 1e30;
+        double world_ms = 1e30;
+        double inserts_ms = 1e30;
+        for (int run = 0; run < n_runs; run++) {
+            scene::Scene level;
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            if (!level.load(text_path)) {
+                return 1;
+            }
+            text_ms = std::min(text_ms, millisecondsSince(start));
+            if (!sameScene(level, desc)) {
+                std::cout << "MISMATCH between the text scene and what was written" << std::endl;
+                return 1;
+            }
+
+            start = std::chrono::steady_clock::now();
+            if (!level.load(binary_path)) {
+                return 1;
+            }
+            binary_ms = std::min(binary_ms, millisecondsSince(start));
+
+            start = std::chrono::steady_clock::now();
+            Instances instances;
+            instances.instances.resize(level.blockCount());
+            gfx::Transforms transforms;
+            transforms.reserve(level.blockCount());
+            const glm::vec3* positions = level.positions();
+            const glm::vec3* sizes = level.sizes();
+            const glm::vec4* colors = level.colors();
+            const int32_t* textures = level.textures();
+            for (unsigned int i = 0; i < level.blockCount(); i++) {
+                instances.instances[i].color = colors[i];
+                instances.instances[i].layer = float(textures[i] == scene::NO_TEXTURE ? 0 : textures[i]);
+                transforms.add(i, positions[i], 0.0f, sizes[i]);
+            }
+            transforms.update(instances);
+            instances_ms = std::min(instances_ms, millisecondsSince(start));
+
+            start = std::chrono::steady_clock::now();
+            World world;
+            std::vector<World::BlockId> ids;
+            world.addBlocks(positions, sizes, level.blockCount(), ids);
+            world_ms = std::min(world_ms, millisecondsSince(start));
+            if (!sameOverlaps(world, level)) {
+                std::cout << "MISMATCH between tree queries and a scan of the blocks" << std::endl;
+                return 1;
+            }
+
+            start = std::chrono::steady_clock::now();
+            World inserted;
+            for (unsigned int i = 0; i < level.blockCount(); i++) {
+                inserted.add(gfx::Block(positions[i], sizes[i]));
+            }
+            inserts_ms = std::min(inserts_ms, millisecondsSince(start));
+
+            if (!sameScene(level, desc)) {
+                std::cout << "MISMATCH between the binary scene and what was written" << std::endl;
+                return 1;
+            }
+        }
+
+        std::ifstream text_file(text_path.c_str(), std::ios::binary | std::ios::ate);
+        std::ifstream binary_file(binary_path.c_str(), std::ios::binary | std::ios::ate);
+        const double megabyte = 1024.0 * 1024.0;
+        std::cout << std::setw(9) << n_blocks << std::fixed << std::setprecision(1)
+                  << std::setw(10) << text_file.tellg() / megabyte << std::setw(10) << binary_file.tellg() / megabyte
+                  << std::setprecision(3)
+                  << std::setw(10) << text_ms << std::setw(11) << binary_ms << std::setw(14) << instances_ms
+                  << std::setw(10) << world_ms << std::setw(12) << inserts_ms
+                  << std::setprecision(1) << std::setw(11) << n_blocks * sizeof(Instance) / megabyte << std::endl;
+    }
+    std::remove(text_path.c_str());
+    std::remove(binary_path.c_str());
+    return 0;
+}
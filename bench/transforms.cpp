@@ -0,0 +1,161 @@
+// Model matrix microbenchmark: the per object glm path (translate, rotate,
+// translate, scale) vs gfx::Transforms computing the dirty ones in SIMD,
+// with every transform dirty and with one in ten dirty, then the
+// view_projection * model pass over all of them.
+// usage: glitch_bench_transforms [n_runs]
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <glitch/transforms.h>
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+// stands in for the instance data of an InstancedBatch
+struct Models {
+    std::vector<glm::mat4> models;
+
+    glm::mat4& model(unsigned int instance) {
+        return models[instance];
+    }
+};
+
+// what the per object path reads, one struct per object
+struct Object {
+    glm::vec3 position;
+    float yaw;
+    glm::vec3 scale;
+    glm::vec3 pivot;
+};
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// largest difference relative to the size of the element
+float maxError(const glm::mat4& a, const glm::mat4& b) {
+    float error = 0.0f;
+    for (int col = 0; col < 4; col++) {
+        for (int row = 0; row < 4; row++) {
+            error = std::max(error, std::fabs(a[col][row] - b[col][row]) / std::max(1.0f, std::fabs(a[col][row])));
+        }
+    }
+    return error;
+}
+
+int main(int argc, char** argv)
+{
+    const int n_runs = (argc > 1) ? std::atoi(argv[1]) : 20;
+    const unsigned int counts[] = { 10000, 100000, 1000000 };
+    const unsigned int dirty_every[] = { 1, 10 };
+    const float tolerance = 1e-5f;
+
+    const char* simd_name = gfx::transformPath();
+    std::cout << "transform path: " << simd_name;
+#ifndef GLITCH_TRANSFORM_AVX
+    std::cout << " (8 wide matrices need an avx build, e.g. GLITCH_NATIVE=ON)";
+#endif
+    std::cout << std::endl;
+
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 2.0f, 0.0f), glm::vec3(0.0f, 2.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    const glm::mat4 view_projection = projection * view;
+
+    std::cout << std::setw(10) << "objects" << std::setw(8) << "dirty"
+              << std::setw(12) << "glm ms" << std::setw(12) << simd_name << " ms"
+              << std::setw(10) << "speedup" << std::setw(14) << "mvp glm ms"
+              << std::setw(12) << "mvp " << simd_name << std::setw(10) << "speedup" << std::endl;
+
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> position(-200.0f, 200.0f);
+    std::uniform_real_distribution<float> size(0.5f, 4.0f);
+    std::uniform_real_distribution<float> angle(-10.0f, 10.0f);
+
+    for (unsigned int n_objects : counts) {
+        std::vector<Object> objects(n_objects);
+        gfx::Transforms transforms;
+        for (unsigned int i = 0; i < n_objects; i++) {
+            Object& object = objects[i];
+            object.position = glm::vec3(position(rng), position(rng) * 0.1f, position(rng));
+            object.yaw = angle(rng);
+            object.scale = glm::vec3(size(rng), size(rng), size(rng));
+            // half of them turn around their center like the player
+            object.pivot = (i % 2) ? glm::vec3(0.5f, 0.0f, 0.5f) : glm::vec3(0.0f);
+            transforms.add(i, object.position, object.yaw, object.scale, object.pivot);
+        }
+        Models glm_models, simd_models;
+        for (const Object& object : objects) {
+            glm_models.models.push_back(gfx::modelMatrix(object.position, object.yaw, object.scale, object.pivot));
+        }
+        simd_models.models.resize(n_objects);
+        transforms.update(simd_models);
+
+        for (unsigned int every : dirty_every) {
+            double glm_ms = 1e30;
+            double simd_ms = 1e30;
+            for (int run = 0; run < n_runs; run++) {
+                // turn the dirty objects a little, both paths see the same angles
+                for (unsigned int i = 0; i < n_objects; i += every) {
+                    objects[i].yaw += 0.01f;
+                    transforms.setYaw(i, objects[i].yaw);
+                }
+
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                for (unsigned int i = 0; i < n_objects; i += every) {
+                    const Object& object = objects[i];
+                    glm_models.model(i) = gfx::modelMatrix(object.position, object.yaw, object.scale, object.pivot);
+                }
+                glm_ms = std::min(glm_ms, millisecondsSince(start));
+
+                start = std::chrono::steady_clock::now();
+                transforms.update(simd_models);
+                simd_ms = std::min(simd_ms, millisecondsSince(start));
+            }
+
+            for (unsigned int i = 0; i < n_objects; i += every) {
+                if (maxError(glm_models.models[i], simd_models.models[i]) > tolerance) {
+                    std::cout << "MISMATCH between glm and " << simd_name << " models" << std::endl;
+                    return 1;
+                }
+            }
+
+            double mvp_glm_ms = 1e30;
+            double mvp_simd_ms = 1e30;
+            std::vector<glm::mat4> glm_mvps(n_objects);
+            std::vector<glm::mat4> simd_mvps;
+            for (int run = 0; run < n_runs; run++) {
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                for (unsigned int i = 0; i < n_objects; i++) {
+                    glm_mvps[i] = view_projection * glm_models.models[i];
+                }
+                mvp_glm_ms = std::min(mvp_glm_ms, millisecondsSince(start));
+
+                start = std::chrono::steady_clock::now();
+                transforms.modelViewProjection(view_projection, simd_mvps);
+                mvp_simd_ms = std::min(mvp_simd_ms, millisecondsSince(start));
+            }
+
+            for (unsigned int i = 0; i < n_objects; i++) {
+                if (maxError(glm_mvps[i], simd_mvps[transforms.slotOf(i)]) > tolerance) {
+                    std::cout << "MISMATCH between glm and " << simd_name << " mvps" << std::endl;
+                    return 1;
+                }
+            }
+
+            std::cout << std::setw(10) << n_objects << std::setw(7) << 100 / every << "%"
+                      << std::fixed << std::setprecision(3)
+                      << std::setw(12) << glm_ms << std::setw(15) << simd_ms
+                      << std::setw(10) << glm_ms / simd_ms
+                      << std::setw(14) << mvp_glm_ms << std::setw(12) << mvp_simd_ms
+                      << std::setw(10) << mvp_glm_ms / mvp_simd_ms << std::endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,492 @@
+#ifndef AABB_TREE_H
+#define AABB_TREE_H
+
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+struct Aabb {
+    glm::vec3 min;
+    glm::vec3 max;
+
+    Aabb() {}
+    Aabb(glm::vec3 min, glm::vec3 max): min(min), max(max) {}
+
+    static Aabb merge(const Aabb& a, const Aabb& b) {
+        return Aabb(glm::min(a.min, b.min), glm::max(a.max, b.max));
+    }
+
+    bool overlaps(const Aabb& other) const {
+        return min.x <= other.max.x && max.x >= other.min.x
+            && min.y <= other.max.y && max.y >= other.min.y
+            && min.z <= other.max.z && max.z >= other.min.z;
+    }
+
+    bool contains(const Aabb& other) const {
+        return min.x <= other.min.x && max.x >= other.max.x
+            && min.y <= other.min.y && max.y >= other.max.y
+            && min.z <= other.min.z && max.z >= other.max.z;
+    }
+
+    float surfaceArea() const {
+        glm::vec3 d = max - min;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    // squared distance from a point to the box, 0 if inside
+    float distance2(glm::vec3 point) const {
+        glm::vec3 d = glm::max(glm::max(min - point, point - max), glm::vec3(0.0f));
+        return glm::dot(d, d);
+    }
+
+    Aabb expanded(float margin) const {
+        return Aabb(min - glm::vec3(margin), max + glm::vec3(margin));
+    }
+};
+
+// Dynamic bounding volume tree over boxes, as in Box2D's b2DynamicTree.
+// Leaves store a fattened box so small moves don't touch the tree, inserts
+// pick the sibling with the cheapest surface area cost and rotations keep
+// the tree balanced, so queries stay logarithmic as proxies come and go.
+class AabbTree {
+  public:
+    static const int NULL_NODE = -1;
+
+    AabbTree(float margin = 0.1f):
+        root_(NULL_NODE),
+        free_list_(NULL_NODE),
+        margin_(margin)
+    {}
+
+    // returns a proxy id that stays valid until destroyProxy
+    int createProxy(const Aabb& box, unsigned int user_data) {
+        int proxy = allocateNode();
+        nodes_[proxy].box = box.expanded(margin_);
+        nodes_[proxy].user_data = user_data;
+        nodes_[proxy].height = 0;
+        insertLeaf(proxy);
+        return proxy;
+    }
+
+    // n proxies at once into an empty tree, proxies[i] is the one of boxes[i].
+    // for loading a level: sorts the boxes along a morton curve through their
+    // centers and splits that order in halves top down, instead of n inserts
+    void build(const Aabb* boxes, const unsigned int* user_data, unsigned int n, int* proxies) {
+        if (root_ != NULL_NODE || n == 0) {
+            for (unsigned int i = 0; i < n; i++) {
+                proxies[i] = createProxy(boxes[i], user_data[i]);
+            }
+            return;
+        }
+        // box centers times two, only their order matters
+        glm::vec3 lo = boxes[0].min + boxes[0].max;
+        glm::vec3 hi = lo;
+        for (unsigned int i = 1; i < n; i++) {
+            lo = glm::min(lo, boxes[i].min + boxes[i].max);
+            hi = glm::max(hi, boxes[i].min + boxes[i].max);
+        }
+        const glm::vec3 scale = glm::vec3(1023.0f) / glm::max(hi - lo, glm::vec3(1e-6f));
+        std::vector<uint32_t> codes(n);
+        std::vector<unsigned int> order(n);
+        for (unsigned int i = 0; i < n; i++) {
+            const glm::vec3 cell = (boxes[i].min + boxes[i].max - lo) * scale;
+            codes[i] = (spreadBits(uint32_t(cell.x)) << 2) | (spreadBits(uint32_t(cell.y)) << 1) | spreadBits(uint32_t(cell.z));
+            order[i] = i;
+        }
+        radixSort(codes, order);
+
+        nodes_.reserve(nodes_.size() + 2 * n - 1);
+        std::vector<int> leaves(n);
+        for (unsigned int i = 0; i < n; i++) {
+            const unsigned int box = order[i];
+            int leaf = allocateNode();
+            nodes_[leaf].box = boxes[box].expanded(margin_);
+            nodes_[leaf].user_data = user_data[box];
+            leaves[i] = proxies[box] = leaf;
+        }
+        root_ = buildSubtree(&leaves[0], n);
+    }
+
+    void destroyProxy(int proxy) {
+        removeLeaf(proxy);
+        freeNode(proxy);
+    }
+
+    // returns true if the proxy had to be reinserted
+    bool moveProxy(int proxy, const Aabb& box) {
+        if (nodes_[proxy].box.contains(box)) {
+            return false;
+        }
+        removeLeaf(proxy);
+        nodes_[proxy].box = box.expanded(margin_);
+        insertLeaf(proxy);
+        return true;
+    }
+
+    unsigned int userData(int proxy) const {
+        return nodes_[proxy].user_data;
+    }
+
+    const Aabb& fatBox(int proxy) const {
+        return nodes_[proxy].box;
+    }
+
+    // calls visit(user_data) for every proxy whose fat box overlaps box
+    template<typename Visitor>
+    void query(const Aabb& box, Visitor visit) const {
+        if (root_ == NULL_NODE) {
+            return;
+        }
+        std::vector<int>& stack = stack_;
+        stack.clear();
+        stack.push_back(root_);
+        while (!stack.empty()) {
+            int id = stack.back();
+            stack.pop_back();
+            const Node& node = nodes_[id];
+            if (!node.box.overlaps(box)) {
+                continue;
+            }
+            if (node.isLeaf()) {
+                visit(node.user_data);
+            } else {
+                stack.push_back(node.left);
+                stack.push_back(node.right);
+            }
+        }
+    }
+
+    // calls visit(user_data) for every proxy whose fat box is within radius of center
+    template<typename Visitor>
+    void queryRadius(glm::vec3 center, float radius, Visitor visit) const {
+        if (root_ == NULL_NODE) {
+            return;
+        }
+        const float radius2 = radius * radius;
+        std::vector<int>& stack = stack_;
+        stack.clear();
+        stack.push_back(root_);
+        while (!stack.empty()) {
+            int id = stack.back();
+            stack.pop_back();
+            const Node& node = nodes_[id];
+            if (node.box.distance2(center) > radius2) {
+                continue;
+            }
+            if (node.isLeaf()) {
+                visit(node.user_data);
+            } else {
+                stack.push_back(node.left);
+                stack.push_back(node.right);
+            }
+        }
+    }
+
+    // best first search for the k proxies closest to point, by exact box distance
+    // as computed by exact_distance2(user_data), nearest first
+    template<typename Distance>
+    void nearest(glm::vec3 point, unsigned int k, Distance exact_distance2, std::vector<unsigned int>& out) const {
+        out.clear();
+        if (root_ == NULL_NODE || k == 0) {
+            return;
+        }
+        typedef std::pair<float, int> Entry;
+        // nodes to visit, closest first
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > open;
+        // best results so far, farthest on top
+        std::priority_queue<std::pair<float, unsigned int> > best;
+
+        open.push(Entry(nodes_[root_].box.distance2(point), root_));
+        while (!open.empty()) {
+            Entry entry = open.top();
+            open.pop();
+            if (best.size() == k && entry.first > best.top().first) {
+                break; // nothing left can beat the current k
+            }
+            const Node& node = nodes_[entry.second];
+            if (node.isLeaf()) {
+                float d2 = exact_distance2(node.user_data);
+                if (best.size() < k) {
+                    best.push(std::make_pair(d2, node.user_data));
+                } else if (d2 < best.top().first) {
+                    best.pop();
+                    best.push(std::make_pair(d2, node.user_data));
+                }
+            } else {
+                open.push(Entry(nodes_[node.left].box.distance2(point), node.left));
+                open.push(Entry(nodes_[node.right].box.distance2(point), node.right));
+            }
+        }
+
+        out.resize(best.size());
+        for (int i = (int)best.size() - 1; i >= 0; i--) {
+            out[i] = best.top().second;
+            best.pop();
+        }
+    }
+
+    int height() const {
+        return (root_ == NULL_NODE) ? 0 : nodes_[root_].height;
+    }
+
+  private:
+    struct Node {
+        Aabb box;
+        int parent; // next free node while on the free list
+        int left;
+        int right;
+        int height; // leaves are 0, free nodes -1
+        unsigned int user_data;
+
+        bool isLeaf() const {
+            return left == NULL_NODE;
+        }
+    };
+
+    std::vector<Node> nodes_;
+    int root_;
+    int free_list_;
+    float margin_;
+    mutable std::vector<int> stack_;
+
+    int allocateNode() {
+        int id;
+        if (free_list_ != NULL_NODE) {
+            id = free_list_;
+            free_list_ = nodes_[id].parent;
+        } else {
+            id = nodes_.size();
+            nodes_.push_back(Node());
+        }
+        Node& node = nodes_[id];
+        node.parent = NULL_NODE;
+        node.left = NULL_NODE;
+        node.right = NULL_NODE;
+        node.height = 0;
+        node.user_data = 0;
+        return id;
+    }
+
+    void freeNode(int id) {
+        nodes_[id].parent = free_list_;
+        nodes_[id].height = -1;
+        free_list_ = id;
+    }
+
+    void insertLeaf(int leaf) {
+        if (root_ == NULL_NODE) {
+            root_ = leaf;
+            nodes_[leaf].parent = NULL_NODE;
+            return;
+        }
+
+        // walk down to the sibling that increases the total surface area the least
+        const Aabb leaf_box = nodes_[leaf].box;
+        int index = root_;
+        while (!nodes_[index].isLeaf()) {
+            const Node& node = nodes_[index];
+            float area = node.box.surfaceArea();
+            float combined_area = Aabb::merge(node.box, leaf_box).surfaceArea();
+
+            // cost of making a new parent for this node and the leaf
+            float cost = 2.0f * combined_area;
+            // minimum cost of pushing the leaf further down
+            float inheritance_cost = 2.0f * (combined_area - area);
+
+            float cost_left = childCost(node.left, leaf_box) + inheritance_cost;
+            float cost_right = childCost(node.right, leaf_box) + inheritance_cost;
+            if (cost < cost_left && cost < cost_right) {
+                break;
+            }
+            index = (cost_left < cost_right) ? node.left : node.right;
+        }
+        int sibling = index;
+
+        // new parent for the sibling and the leaf
+        int old_parent = nodes_[sibling].parent;
+        int new_parent = allocateNode();
+        nodes_[new_parent].parent = old_parent;
+        nodes_[new_parent].box = Aabb::merge(leaf_box, nodes_[sibling].box);
+        nodes_[new_parent].height = nodes_[sibling].height + 1;
+        nodes_[new_parent].left = sibling;
+        nodes_[new_parent].right = leaf;
+        nodes_[sibling].parent = new_parent;
+        nodes_[leaf].parent = new_parent;
+
+        if (old_parent == NULL_NODE) {
+            root_ = new_parent;
+        } else if (nodes_[old_parent].left == sibling) {
+            nodes_[old_parent].left = new_parent;
+        } else {
+            nodes_[old_parent].right = new_parent;
+        }
+
+        refit(nodes_[leaf].parent);
+    }
+
+    void removeLeaf(int leaf) {
+        if (leaf == root_) {
+            root_ = NULL_NODE;
+            return;
+        }
+
+        int parent = nodes_[leaf].parent;
+        int grand_parent = nodes_[parent].parent;
+        int sibling = (nodes_[parent].left == leaf) ? nodes_[parent].right : nodes_[parent].left;
+
+        if (grand_parent == NULL_NODE) {
+            root_ = sibling;
+            nodes_[sibling].parent = NULL_NODE;
+            freeNode(parent);
+            return;
+        }
+
+        // replace the parent with the sibling
+        if (nodes_[grand_parent].left == parent) {
+            nodes_[grand_parent].left = sibling;
+        } else {
+            nodes_[grand_parent].right = sibling;
+        }
+        nodes_[sibling].parent = grand_parent;
+        freeNode(parent);
+        refit(grand_parent);
+    }
+
+    // spreads the low 10 bits of x three apart, for a 30 bit morton code
+    static uint32_t spreadBits(uint32_t x) {
+        x &= 0x3ff;
+        x = (x | (x << 16)) & 0x030000ff;
+        x = (x | (x << 8)) & 0x0300f00f;
+        x = (x | (x << 4)) & 0x030c30c3;
+        x = (x | (x << 2)) & 0x09249249;
+        return x;
+    }
+
+    // sorts 30 bit keys and their values, ten bits a pass. a comparison sort
+    // of a million keys costs several times as much
+    static void radixSort(std::vector<uint32_t>& keys, std::vector<unsigned int>& values) {
+        const unsigned int n = keys.size();
+        std::vector<uint32_t> keys_out(n);
+        std::vector<unsigned int> values_out(n);
+        for (unsigned int shift = 0; shift < 30; shift += 10) {
+            unsigned int offsets[1024] = {};
+            for (unsigned int i = 0; i < n; i++) {
+                offsets[(keys[i] >> shift) & 0x3ff]++;
+            }
+            unsigned int sum = 0;
+            for (unsigned int digit = 0; digit < 1024; digit++) {
+                const unsigned int count = offsets[digit];
+                offsets[digit] = sum;
+                sum += count;
+            }
+            for (unsigned int i = 0; i < n; i++) {
+                const unsigned int slot = offsets[(keys[i] >> shift) & 0x3ff]++;
+                keys_out[slot] = keys[i];
+                values_out[slot] = values[i];
+            }
+            keys.swap(keys_out);
+            values.swap(values_out);
+        }
+    }
+
+    // parent of n leaves in curve order, each half under one child
+    int buildSubtree(const int* leaves, unsigned int n) {
+        if (n == 1) {
+            return leaves[0];
+        }
+        const int left = buildSubtree(leaves, n / 2);
+        const int right = buildSubtree(leaves + n / 2, n - n / 2);
+
+        int parent = allocateNode();
+        Node& node = nodes_[parent];
+        node.left = left;
+        node.right = right;
+        node.box = Aabb::merge(nodes_[left].box, nodes_[right].box);
+        node.height = 1 + std::max(nodes_[left].height, nodes_[right].height);
+        nodes_[left].parent = parent;
+        nodes_[right].parent = parent;
+        return parent;
+    }
+
+    float childCost(int child, const Aabb& leaf_box) const {
+        float combined_area = Aabb::merge(leaf_box, nodes_[child].box).surfaceArea();
+        if (nodes_[child].isLeaf()) {
+            return combined_area;
+        }
+        return combined_area - nodes_[child].box.surfaceArea();
+    }
+
+    // fix boxes and heights from index up to the root, rebalancing on the way
+    void refit(int index) {
+        while (index != NULL_NODE) {
+            index = balance(index);
+            Node& node = nodes_[index];
+            node.height = 1 + std::max(nodes_[node.left].height, nodes_[node.right].height);
+            node.box = Aabb::merge(nodes_[node.left].box, nodes_[node.right].box);
+            index = node.parent;
+        }
+    }
+
+    // rotate a child up if the subtree at a is unbalanced, returns the new subtree root
+    int balance(int a) {
+        Node& node_a = nodes_[a];
+        if (node_a.isLeaf() || node_a.height < 2) {
+            return a;
+        }
+        int b = node_a.left;
+        int c = node_a.right;
+        int skew = nodes_[c].height - nodes_[b].height;
+        if (skew > 1) {
+            return rotate(a, c);
+        }
+        if (skew < -1) {
+            return rotate(a, b);
+        }
+        return a;
+    }
+
+    // promote child, the taller child of a, above a
+    int rotate(int a, int child) {
+        int f = nodes_[child].left;
+        int g = nodes_[child].right;
+
+        // child takes a's place
+        nodes_[child].left = a;
+        nodes_[child].parent = nodes_[a].parent;
+        nodes_[a].parent = child;
+        int parent = nodes_[child].parent;
+        if (parent == NULL_NODE) {
+            root_ = child;
+        } else if (nodes_[parent].left == a) {
+            nodes_[parent].left = child;
+        } else {
+            nodes_[parent].right = child;
+        }
+
+        // keep the taller grandchild under child, hand the other one to a
+        int keep = (nodes_[f].height > nodes_[g].height) ? f : g;
+        int give = (keep == f) ? g : f;
+        nodes_[child].right = keep;
+        if (nodes_[a].left == child) {
+            nodes_[a].left = give;
+        } else {
+            nodes_[a].right = give;
+        }
+        nodes_[give].parent = a;
+
+        Node& node_a = nodes_[a];
+        node_a.box = Aabb::merge(nodes_[node_a.left].box, nodes_[node_a.right].box);
+        node_a.height = 1 + std::max(nodes_[node_a.left].height, nodes_[node_a.right].height);
+        Node& node_child = nodes_[child];
+        node_child.box = Aabb::merge(nodes_[node_child.left].box, nodes_[node_child.right].box);
+        node_child.height = 1 + std::max(nodes_[node_child.left].height, nodes_[node_child.right].height);
+        return child;
+    }
+};
+
+#endif
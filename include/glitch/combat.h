@@ -0,0 +1,484 @@
+#ifndef COMBAT_H
+#define COMBAT_H
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include <glitch/player.h>
+#include <glitch/aabb_tree.h>
+
+#ifdef __SSE2__
+#define GLITCH_COMBAT_SSE
+#include <emmintrin.h>
+#endif
+
+namespace fight {
+
+// Box in a fighter's frame: +x is where the fighter looks (Player::front on
+// the ground), +y up and +z to its right. The same rotation builds the
+// player model, a yaw of -radians(yaw) around +y.
+struct BoxShape {
+    glm::vec3 offset; // center relative to the fighter's position
+    glm::vec3 half_size;
+};
+
+// hitbox of attacker touched hurtbox of victim at time (0 = start of the tick, 1 = end)
+struct Contact {
+    uint32_t hitbox;
+    uint32_t hurtbox;
+    uint32_t attacker;
+    uint32_t victim;
+    float time;
+};
+
+// Hit detection between attack hitboxes and character hurtboxes for one tick.
+// Shapes are added every tick with the owner's pose at the start and at the
+// end of the tick, and are swept between the two so a fast attack or
+// projectile can't pass through a target between ticks. Boxes only turn
+// around +y, which keeps the overlap tests to the y axis plus a rectangle
+// test on the ground plane. The orientation is the one at the end of the
+// tick, only the movement is swept.
+//
+// The broadphase sorts the swept bounds on x and sweeps along them, testing
+// each box against the ones after it that start before it ends. The order is
+// kept between ticks and fixed with an insertion sort when little moved
+// (shapes added in the same order every tick, walking fighters), which is
+// close to linear. When a pass over the order finds too much out of place,
+// e.g. with lots of fast projectiles, it's sorted from scratch instead. The
+// sweep and the narrowphase both work four boxes or pairs at a time with SSE2.
+//
+// Contacts come out sorted by hitbox then victim, at most one per pair (the
+// earliest hurtbox touched), so the result only depends on the shapes and
+// the order they were added in.
+class CollisionWorld {
+  public:
+    struct Stats {
+        unsigned int n_shapes;
+        unsigned int n_swaps; // insertion sort swaps, low while order holds from tick to tick
+        bool resorted; // the order was too far off and got sorted from scratch
+        unsigned int n_candidates; // pairs whose swept bounds overlap
+        unsigned int n_hits; // candidates that touched, before keeping one per hitbox and victim
+    };
+
+    CollisionWorld():
+        stats_()
+    {}
+
+    void clear() {
+        shapes_.clear();
+        owner_.clear();
+        is_hitbox_.clear();
+        bounds_.clear();
+    }
+
+    uint32_t addHurtbox(uint32_t owner, const Player::State& from, const Player::State& to, const BoxShape& shape) {
+        return add(owner, false, from, to, shape);
+    }
+
+    uint32_t addHitbox(uint32_t owner, const Player::State& from, const Player::State& to, const BoxShape& shape) {
+        return add(owner, true, from, to, shape);
+    }
+
+    unsigned int size() const {
+        return owner_.size();
+    }
+
+    void collide(std::vector<Contact>& contacts) {
+        broadphase();
+        narrowphase();
+        finish(contacts);
+    }
+
+    // same result without SSE, the reference for it
+    void collideScalar(std::vector<Contact>& contacts) {
+        broadphase(false);
+        narrowphase(false);
+        finish(contacts);
+    }
+
+    // the steps of collide(), public so they can be timed apart
+
+    // candidate pairs of the shapes added since clear()
+    void broadphase(bool simd = true) {
+        sortBounds();
+        pairs_.clear();
+#ifdef GLITCH_COMBAT_SSE
+        if (simd) {
+            sweepSse();
+        } else {
+            sweepScalar();
+        }
+#else
+        sweepScalar();
+#endif
+        stats_.n_candidates = pairs_.size();
+    }
+
+    // swept tests of the broadphase's candidates
+    void narrowphase(bool simd = true) {
+#ifdef GLITCH_COMBAT_SSE
+        if (simd) {
+            narrowphaseSse();
+            return;
+        }
+#endif
+        narrowphaseScalar(0);
+    }
+
+    // earliest contact per hitbox and victim, sorted
+    void finish(std::vector<Contact>& contacts) {
+        stats_.n_hits = hits_.size();
+        std::sort(hits_.begin(), hits_.end(), [](const Contact& a, const Contact& b) {
+            if (a.hitbox != b.hitbox) return a.hitbox < b.hitbox;
+            if (a.victim != b.victim) return a.victim < b.victim;
+            if (a.time != b.time) return a.time < b.time;
+            return a.hurtbox < b.hurtbox;
+        });
+        contacts.clear();
+        for (const Contact& hit : hits_) {
+            if (contacts.empty() || contacts.back().hitbox != hit.hitbox || contacts.back().victim != hit.victim) {
+                contacts.push_back(hit);
+            }
+        }
+    }
+
+    const Stats& stats() const {
+        return stats_;
+    }
+
+  private:
+    // start center, movement over the tick, orientation and half size, as
+    // three groups of four floats so four shapes transpose into SIMD lanes
+    struct Shape {
+        float x, y, z, dx;
+        float dy, dz, cos, sin;
+        float hx, hy, hz, unused;
+    };
+
+    struct Pair {
+        uint32_t hitbox;
+        uint32_t hurtbox;
+    };
+
+    struct SortKey {
+        float min_x;
+        uint32_t shape;
+    };
+
+    // separation used for an axis the boxes never overlap on
+    static constexpr float NEVER = 1e30f;
+
+    std::vector<Shape> shapes_;
+    std::vector<uint32_t> owner_;
+    std::vector<uint8_t> is_hitbox_;
+    std::vector<Aabb> bounds_; // swept, world space
+
+    std::vector<SortKey> order_; // shapes by bounds min x, kept between ticks
+    // bounds in sorted order, padded with boxes that start at infinity so
+    // the sweep can read four past the end
+    std::vector<float> min_x_, max_x_, min_y_, max_y_, min_z_, max_z_;
+    std::vector<Pair> pairs_;
+    std::vector<Contact> hits_;
+    Stats stats_;
+
+    uint32_t add(uint32_t owner, bool is_hitbox, const Player::State& from, const Player::State& to, const BoxShape& shape) {
+        const float angle = -glm::radians(to.yaw);
+        const float c = std::cos(angle);
+        const float s = std::sin(angle);
+        // local x goes to (c, 0, -s), local z to (s, 0, c)
+        const glm::vec3 offset(c * shape.offset.x + s * shape.offset.z, shape.offset.y, -s * shape.offset.x + c * shape.offset.z);
+        const glm::vec3 start = from.position + offset;
+        const glm::vec3 end = to.position + offset;
+        const glm::vec3 half = shape.half_size;
+
+        const Shape data = {
+            start.x, start.y, start.z, end.x - start.x,
+            end.y - start.y, end.z - start.z, c, s,
+            half.x, half.y, half.z, 0.0f
+        };
+        shapes_.push_back(data);
+        owner_.push_back(owner);
+        is_hitbox_.push_back(is_hitbox ? 1 : 0);
+
+        const glm::vec3 extent(
+            half.x * std::fabs(c) + half.z * std::fabs(s),
+            half.y,
+            half.x * std::fabs(s) + half.z * std::fabs(c)
+        );
+        bounds_.push_back(Aabb(glm::min(start, end) - extent, glm::max(start, end) + extent));
+        return shapes_.size() - 1;
+    }
+
+    static bool sortsBefore(const SortKey& a, const SortKey& b) {
+        return a.min_x < b.min_x || (a.min_x == b.min_x && a.shape < b.shape);
+    }
+
+    void sortBounds() {
+        const unsigned int n = size();
+        stats_ = Stats();
+        stats_.n_shapes = n;
+        if (order_.size() != n) {
+            order_.resize(n);
+            for (unsigned int i = 0; i < n; i++) {
+                order_[i].shape = i;
+            }
+        }
+        unsigned int n_descents = 0;
+        for (unsigned int i = 0; i < n; i++) {
+            order_[i].min_x = bounds_[order_[i].shape].min.x;
+            n_descents += (i > 0 && sortsBefore(order_[i], order_[i - 1]));
+        }
+        // each out of place neighbour costs the insertion sort a walk back,
+        // past a few percent of them a full sort is cheaper. the swap cap
+        // catches the few that walk back a long way
+        const unsigned int max_swaps = 8 * n;
+        stats_.resorted = n_descents > n / 32;
+        for (unsigned int i = 1; i < n && !stats_.resorted; i++) {
+            const SortKey key = order_[i];
+            unsigned int j = i;
+            while (j > 0 && sortsBefore(key, order_[j - 1])) {
+                order_[j] = order_[j - 1];
+                j--;
+                stats_.n_swaps++;
+            }
+            order_[j] = key;
+            stats_.resorted = stats_.n_swaps > max_swaps;
+        }
+        if (stats_.resorted) {
+            std::sort(order_.begin(), order_.end(), sortsBefore);
+        }
+
+        const unsigned int padded = n + 4;
+        std::vector<float>* arrays[] = { &min_x_, &max_x_, &min_y_, &max_y_, &min_z_, &max_z_ };
+        for (std::vector<float>* array : arrays) {
+            array->resize(padded);
+        }
+        for (unsigned int i = 0; i < n; i++) {
+            const Aabb& box = bounds_[order_[i].shape];
+            min_x_[i] = box.min.x; max_x_[i] = box.max.x;
+            min_y_[i] = box.min.y; max_y_[i] = box.max.y;
+            min_z_[i] = box.min.z; max_z_[i] = box.max.z;
+        }
+        for (unsigned int i = n; i < padded; i++) {
+            min_x_[i] = max_x_[i] = min_y_[i] = max_y_[i] = min_z_[i] = max_z_[i] = NEVER;
+        }
+    }
+
+    // each box against the ones after it that start before it ends on x
+    void sweepScalar() {
+        for (unsigned int i = 0; i < size(); i++) {
+            for (unsigned int j = i + 1; min_x_[j] <= max_x_[i]; j++) {
+                if (min_z_[i] <= max_z_[j] && max_z_[i] >= min_z_[j] && min_y_[i] <= max_y_[j] && max_y_[i] >= min_y_[j]) {
+                    addCandidate(order_[i].shape, order_[j].shape);
+                }
+            }
+        }
+    }
+
+#ifdef GLITCH_COMBAT_SSE
+    // same pairs in the same order, four boxes after each at a time
+    void sweepSse() {
+        for (unsigned int i = 0; i < size(); i++) {
+            const __m128 max_x = _mm_set1_ps(max_x_[i]);
+            const __m128 min_y = _mm_set1_ps(min_y_[i]), max_y = _mm_set1_ps(max_y_[i]);
+            const __m128 min_z = _mm_set1_ps(min_z_[i]), max_z = _mm_set1_ps(max_z_[i]);
+            for (unsigned int j = i + 1; ; j += 4) {
+                const __m128 starts = _mm_cmple_ps(_mm_loadu_ps(&min_x_[j]), max_x);
+                const __m128 overlaps = _mm_and_ps(
+                    _mm_and_ps(_mm_cmple_ps(min_z, _mm_loadu_ps(&max_z_[j])), _mm_cmpge_ps(max_z, _mm_loadu_ps(&min_z_[j]))),
+                    _mm_and_ps(_mm_cmple_ps(min_y, _mm_loadu_ps(&max_y_[j])), _mm_cmpge_ps(max_y, _mm_loadu_ps(&min_y_[j])))
+                );
+                int mask = _mm_movemask_ps(_mm_and_ps(starts, overlaps));
+                while (mask) {
+                    const int lane = __builtin_ctz(mask);
+                    addCandidate(order_[i].shape, order_[j + lane].shape);
+                    mask &= mask - 1;
+                }
+                // sorted on min x, once one lane starts too late the rest do too
+                if (_mm_movemask_ps(starts) != 0xF) {
+                    break;
+                }
+            }
+        }
+    }
+#endif
+
+    void addCandidate(uint32_t a, uint32_t b) {
+        if (is_hitbox_[a] != is_hitbox_[b] && owner_[a] != owner_[b]) {
+            pairs_.push_back(is_hitbox_[a] ? Pair { a, b } : Pair { b, a });
+        }
+    }
+
+    // Separating axis test of a box moving relative to another over the tick.
+    // On each axis the projections overlap during [enter, exit], the boxes
+    // touch where all of those intervals meet. The axes are y and the two
+    // ground axes of each box, enough to separate two rectangles at any time
+    // of the tick, so the meeting of the intervals is exact.
+    bool sweptTest(uint32_t hitbox, uint32_t hurtbox, float& time) const {
+        const Shape& a = shapes_[hitbox];
+        const Shape& b = shapes_[hurtbox];
+        const float cx = a.x - b.x, cy = a.y - b.y, cz = a.z - b.z;
+        const float vx = a.dx - b.dx, vy = a.dy - b.dy, vz = a.dz - b.dz;
+        // ground axes as (x, z): u = (cos, -sin), w = (sin, cos)
+        const float k1 = std::fabs(a.cos * b.cos + a.sin * b.sin);
+        const float k2 = std::fabs(a.cos * b.sin - a.sin * b.cos);
+
+        float enter = 0.0f;
+        float exit = 1.0f;
+        narrowInterval(cy, vy, a.hy + b.hy, enter, exit);
+        narrowInterval(cx * a.cos - cz * a.sin, vx * a.cos - vz * a.sin, a.hx + b.hx * k1 + b.hz * k2, enter, exit);
+        narrowInterval(cx * a.sin + cz * a.cos, vx * a.sin + vz * a.cos, a.hz + b.hx * k2 + b.hz * k1, enter, exit);
+        narrowInterval(cx * b.cos - cz * b.sin, vx * b.cos - vz * b.sin, b.hx + a.hx * k1 + a.hz * k2, enter, exit);
+        narrowInterval(cx * b.sin + cz * b.cos, vx * b.sin + vz * b.cos, b.hz + a.hx * k2 + a.hz * k1, enter, exit);
+
+        time = enter;
+        return enter <= exit;
+    }
+
+    // |p + v t| <= r for t in [enter, exit]
+    static void narrowInterval(float p, float v, float r, float& enter, float& exit) {
+        float t_min, t_max;
+        if (v == 0.0f) {
+            const bool inside = std::fabs(p) <= r;
+            t_min = inside ? -NEVER : +NEVER;
+            t_max = inside ? +NEVER : -NEVER;
+        } else {
+            const float inverse_v = 1.0f / v;
+            const float t1 = (-r - p) * inverse_v;
+            const float t2 = (r - p) * inverse_v;
+            t_min = std::min(t1, t2);
+            t_max = std::max(t1, t2);
+        }
+        enter = std::max(enter, t_min);
+        exit = std::min(exit, t_max);
+    }
+
+    void narrowphaseScalar(unsigned int first) {
+        if (first == 0) {
+            hits_.clear();
+        }
+        for (unsigned int i = first; i < pairs_.size(); i++) {
+            float time;
+            if (sweptTest(pairs_[i].hitbox, pairs_[i].hurtbox, time)) {
+                addHit(pairs_[i], time);
+            }
+        }
+    }
+
+    void addHit(const Pair& pair, float time) {
+        hits_.push_back(Contact { pair.hitbox, pair.hurtbox, owner_[pair.hitbox], owner_[pair.hurtbox], time });
+    }
+
+#ifdef GLITCH_COMBAT_SSE
+    static __m128 absSse(__m128 x) {
+        return _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+    }
+
+    // four lane narrowInterval, same operations in the same order
+    static void narrowIntervalSse(__m128 p, __m128 v, __m128 r, __m128& enter, __m128& exit) {
+        const __m128 still = _mm_cmpeq_ps(v, _mm_setzero_ps());
+        const __m128 inside = _mm_cmple_ps(absSse(p), r);
+        const __m128 never = _mm_set1_ps(NEVER);
+        const __m128 minus_never = _mm_set1_ps(-NEVER);
+        const __m128 still_min = _mm_or_ps(_mm_and_ps(inside, minus_never), _mm_andnot_ps(inside, never));
+        const __m128 still_max = _mm_or_ps(_mm_and_ps(inside, never), _mm_andnot_ps(inside, minus_never));
+
+        // lanes that don't move divide by zero, their result is replaced below
+        const __m128 safe_v = _mm_or_ps(_mm_and_ps(still, _mm_set1_ps(1.0f)), _mm_andnot_ps(still, v));
+        const __m128 inverse_v = _mm_div_ps(_mm_set1_ps(1.0f), safe_v);
+        const __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_setzero_ps(), r), p), inverse_v);
+        const __m128 t2 = _mm_mul_ps(_mm_sub_ps(r, p), inverse_v);
+        const __m128 t_min = _mm_or_ps(_mm_and_ps(still, still_min), _mm_andnot_ps(still, _mm_min_ps(t1, t2)));
+        const __m128 t_max = _mm_or_ps(_mm_and_ps(still, still_max), _mm_andnot_ps(still, _mm_max_ps(t1, t2)));
+        enter = _mm_max_ps(enter, t_min);
+        exit = _mm_min_ps(exit, t_max);
+    }
+
+    // one side of four pairs, shape fields to lanes: three loads and a transpose per group of four fields
+    void loadLanes(const Pair* pairs, uint32_t Pair::*side,
+                   __m128& x, __m128& y, __m128& z, __m128& dx,
+                   __m128& dy, __m128& dz, __m128& cos, __m128& sin,
+                   __m128& hx, __m128& hy, __m128& hz, __m128& unused) const {
+        const float* shape[4];
+        for (unsigned int lane = 0; lane < 4; lane++) {
+            shape[lane] = &shapes_[pairs[lane].*side].x;
+        }
+        x = _mm_loadu_ps(shape[0]); y = _mm_loadu_ps(shape[1]); z = _mm_loadu_ps(shape[2]); dx = _mm_loadu_ps(shape[3]);
+        _MM_TRANSPOSE4_PS(x, y, z, dx);
+        dy = _mm_loadu_ps(shape[0] + 4); dz = _mm_loadu_ps(shape[1] + 4); cos = _mm_loadu_ps(shape[2] + 4); sin = _mm_loadu_ps(shape[3] + 4);
+        _MM_TRANSPOSE4_PS(dy, dz, cos, sin);
+        hx = _mm_loadu_ps(shape[0] + 8); hy = _mm_loadu_ps(shape[1] + 8); hz = _mm_loadu_ps(shape[2] + 8); unused = _mm_loadu_ps(shape[3] + 8);
+        _MM_TRANSPOSE4_PS(hx, hy, hz, unused);
+    }
+
+    // four candidate pairs per iteration, the tail goes through the scalar path
+    void narrowphaseSse() {
+        hits_.clear();
+        const unsigned int n_wide = pairs_.size() & ~3u;
+        for (unsigned int i = 0; i < n_wide; i += 4) {
+            const Pair* pairs = &pairs_[i];
+            __m128 x_a, y_a, z_a, dx_a, dy_a, dz_a, cos_a, sin_a, hx_a, hy_a, hz_a, unused_a;
+            __m128 x_b, y_b, z_b, dx_b, dy_b, dz_b, cos_b, sin_b, hx_b, hy_b, hz_b, unused_b;
+            loadLanes(pairs, &Pair::hitbox, x_a, y_a, z_a, dx_a, dy_a, dz_a, cos_a, sin_a, hx_a, hy_a, hz_a, unused_a);
+            loadLanes(pairs, &Pair::hurtbox, x_b, y_b, z_b, dx_b, dy_b, dz_b, cos_b, sin_b, hx_b, hy_b, hz_b, unused_b);
+            const __m128 cx = _mm_sub_ps(x_a, x_b);
+            const __m128 cy = _mm_sub_ps(y_a, y_b);
+            const __m128 cz = _mm_sub_ps(z_a, z_b);
+            const __m128 vx = _mm_sub_ps(dx_a, dx_b);
+            const __m128 vy = _mm_sub_ps(dy_a, dy_b);
+            const __m128 vz = _mm_sub_ps(dz_a, dz_b);
+
+            const __m128 k1 = absSse(_mm_add_ps(_mm_mul_ps(cos_a, cos_b), _mm_mul_ps(sin_a, sin_b)));
+            const __m128 k2 = absSse(_mm_sub_ps(_mm_mul_ps(cos_a, sin_b), _mm_mul_ps(sin_a, cos_b)));
+
+            __m128 enter = _mm_setzero_ps();
+            __m128 exit = _mm_set1_ps(1.0f);
+            narrowIntervalSse(cy, vy, _mm_add_ps(hy_a, hy_b), enter, exit);
+            narrowIntervalSse(
+                _mm_sub_ps(_mm_mul_ps(cx, cos_a), _mm_mul_ps(cz, sin_a)),
+                _mm_sub_ps(_mm_mul_ps(vx, cos_a), _mm_mul_ps(vz, sin_a)),
+                _mm_add_ps(_mm_add_ps(hx_a, _mm_mul_ps(hx_b, k1)), _mm_mul_ps(hz_b, k2)),
+                enter, exit
+            );
+            narrowIntervalSse(
+                _mm_add_ps(_mm_mul_ps(cx, sin_a), _mm_mul_ps(cz, cos_a)),
+                _mm_add_ps(_mm_mul_ps(vx, sin_a), _mm_mul_ps(vz, cos_a)),
+                _mm_add_ps(_mm_add_ps(hz_a, _mm_mul_ps(hx_b, k2)), _mm_mul_ps(hz_b, k1)),
+                enter, exit
+            );
+            narrowIntervalSse(
+                _mm_sub_ps(_mm_mul_ps(cx, cos_b), _mm_mul_ps(cz, sin_b)),
+                _mm_sub_ps(_mm_mul_ps(vx, cos_b), _mm_mul_ps(vz, sin_b)),
+                _mm_add_ps(_mm_add_ps(hx_b, _mm_mul_ps(hx_a, k1)), _mm_mul_ps(hz_a, k2)),
+                enter, exit
+            );
+            narrowIntervalSse(
+                _mm_add_ps(_mm_mul_ps(cx, sin_b), _mm_mul_ps(cz, cos_b)),
+                _mm_add_ps(_mm_mul_ps(vx, sin_b), _mm_mul_ps(vz, cos_b)),
+                _mm_add_ps(_mm_add_ps(hz_b, _mm_mul_ps(hx_a, k2)), _mm_mul_ps(hz_a, k1)),
+                enter, exit
+            );
+
+            int hit_mask = _mm_movemask_ps(_mm_cmple_ps(enter, exit));
+            if (hit_mask) {
+                float times[4];
+                _mm_storeu_ps(times, enter);
+                while (hit_mask) {
+                    const int lane = __builtin_ctz(hit_mask);
+                    addHit(pairs[lane], times[lane]);
+                    hit_mask &= hit_mask - 1;
+                }
+            }
+        }
+        narrowphaseScalar(n_wide);
+    }
+#endif
+};
+
+}
+
+#endif
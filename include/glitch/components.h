@@ -0,0 +1,60 @@
+#ifndef COMPONENTS_H
+#define COMPONENTS_H
+
+#include <glm/glm.hpp>
+
+#include <glitch/graphics.h>
+#include <glitch/camera.h>
+#include <glitch/player.h>
+
+namespace ecs {
+
+// axis aligned box placed by its min corner, like gfx::Block
+struct Transform {
+    glm::vec3 position;
+    glm::vec3 size;
+};
+
+// the batch instance that draws the entity
+struct RenderMesh {
+    gfx::InstancedBatch* batch;
+    gfx::InstancedBatch::InstanceId instance;
+};
+
+// tag: the transform's box is solid and never moves, physics mirrors it
+struct Collider {};
+
+enum class CameraMode {
+    FirstPerson,
+    ThirdPerson
+};
+
+enum class PlayerMovement {
+    None,
+    Forward,
+    ForwardLeft,
+    ForwardRight,
+    Back,
+    BackLeft,
+    BackRight,
+    Left,
+    Right
+};
+
+// a player moved by the tick's input
+struct PlayerController {
+    Player body; // position, yaw and pitch
+    PlayerMovement movement; // the keys held during the last tick
+    glm::vec3 previous_position; // as of the previous tick, for render interpolation
+    float move_speed;
+};
+
+// looks through the eyes of the entity's PlayerController or from behind it
+struct FollowCamera {
+    Camera camera;
+    CameraMode mode;
+};
+
+}
+
+#endif
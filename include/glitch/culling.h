@@ -0,0 +1,270 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <vector>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+#ifdef __SSE2__
+#define GLITCH_CULL_SSE
+#include <emmintrin.h>
+#endif
+#ifdef __AVX__
+#define GLITCH_CULL_AVX
+#include <immintrin.h>
+#endif
+
+namespace gfx {
+
+// Six planes (xyz = normal pointing inside, w = offset) taken from a
+// projection * view matrix, see Gribb & Hartmann.
+struct Frustum {
+    glm::vec4 planes[6];
+
+    static Frustum fromMatrix(const glm::mat4& m) {
+        // glm is column major, m[col][row]
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+        Frustum frustum;
+        frustum.planes[0] = row3 + row0; // left
+        frustum.planes[1] = row3 - row0; // right
+        frustum.planes[2] = row3 + row1; // bottom
+        frustum.planes[3] = row3 - row1; // top
+        frustum.planes[4] = row3 + row2; // near
+        frustum.planes[5] = row3 - row2; // far
+        return frustum;
+    }
+};
+
+// Boxes stored as separate center/extent arrays so SIMD lanes load
+// four (or eight) boxes' worth of one component at once.
+class CullingBoxes {
+  public:
+    unsigned int add(glm::vec3 min, glm::vec3 max) {
+        unsigned int index = size();
+        cx_.push_back(0.0f); cy_.push_back(0.0f); cz_.push_back(0.0f);
+        ex_.push_back(0.0f); ey_.push_back(0.0f); ez_.push_back(0.0f);
+        set(index, min, max);
+        return index;
+    }
+
+    void set(unsigned int index, glm::vec3 min, glm::vec3 max) {
+        glm::vec3 center = 0.5f * (min + max);
+        glm::vec3 extent = 0.5f * (max - min);
+        cx_[index] = center.x; cy_[index] = center.y; cz_[index] = center.z;
+        ex_[index] = extent.x; ey_[index] = extent.y; ez_[index] = extent.z;
+    }
+
+    void clear() {
+        cx_.clear(); cy_.clear(); cz_.clear();
+        ex_.clear(); ey_.clear(); ez_.clear();
+    }
+
+    unsigned int size() const {
+        return cx_.size();
+    }
+
+    const float* cx() const { return cx_.data(); }
+    const float* cy() const { return cy_.data(); }
+    const float* cz() const { return cz_.data(); }
+    const float* ex() const { return ex_.data(); }
+    const float* ey() const { return ey_.data(); }
+    const float* ez() const { return ez_.data(); }
+
+  private:
+    std::vector<float> cx_, cy_, cz_;
+    std::vector<float> ex_, ey_, ez_;
+};
+
+// scalar reference: a box is outside if it is fully behind any plane
+inline bool boxOutside(const Frustum& frustum, float cx, float cy, float cz, float ex, float ey, float ez) {
+    for (unsigned int p = 0; p < 6; p++) {
+        const glm::vec4& plane = frustum.planes[p];
+        float distance = plane.x * cx + plane.y * cy + plane.z * cz + plane.w;
+        float radius = std::fabs(plane.x) * ex + std::fabs(plane.y) * ey + std::fabs(plane.z) * ez;
+        if (distance + radius < 0.0f) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// appends the visible ones of boxes [begin, end)
+inline void cullScalar(const Frustum& frustum, const CullingBoxes& boxes, unsigned int begin, unsigned int end, std::vector<unsigned int>& visible) {
+    for (unsigned int i = begin; i < end; i++) {
+        if (!boxOutside(frustum, boxes.cx()[i], boxes.cy()[i], boxes.cz()[i], boxes.ex()[i], boxes.ey()[i], boxes.ez()[i])) {
+            visible.push_back(i);
+        }
+    }
+}
+
+inline void cullScalar(const Frustum& frustum, const CullingBoxes& boxes, std::vector<unsigned int>& visible) {
+    visible.clear();
+    cullScalar(frustum, boxes, 0, boxes.size(), visible);
+}
+
+#ifdef GLITCH_CULL_SSE
+// four boxes per iteration, the tail goes through the scalar path
+inline void cullSse(const Frustum& frustum, const CullingBoxes& boxes, unsigned int begin, unsigned int end, std::vector<unsigned int>& visible) {
+    __m128 nx[6], ny[6], nz[6], nw[6], ax[6], ay[6], az[6];
+    for (unsigned int p = 0; p < 6; p++) {
+        const glm::vec4& plane = frustum.planes[p];
+        nx[p] = _mm_set1_ps(plane.x);
+        ny[p] = _mm_set1_ps(plane.y);
+        nz[p] = _mm_set1_ps(plane.z);
+        nw[p] = _mm_set1_ps(plane.w);
+        ax[p] = _mm_set1_ps(std::fabs(plane.x));
+        ay[p] = _mm_set1_ps(std::fabs(plane.y));
+        az[p] = _mm_set1_ps(std::fabs(plane.z));
+    }
+
+    const __m128 zero = _mm_setzero_ps();
+    const unsigned int wide_end = begin + ((end - begin) & ~3u);
+    for (unsigned int i = begin; i < wide_end; i += 4) {
+        __m128 cx = _mm_loadu_ps(boxes.cx() + i);
+        __m128 cy = _mm_loadu_ps(boxes.cy() + i);
+        __m128 cz = _mm_loadu_ps(boxes.cz() + i);
+        __m128 ex = _mm_loadu_ps(boxes.ex() + i);
+        __m128 ey = _mm_loadu_ps(boxes.ey() + i);
+        __m128 ez = _mm_loadu_ps(boxes.ez() + i);
+
+        __m128 outside = zero;
+        for (unsigned int p = 0; p < 6; p++) {
+            __m128 distance = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(nx[p], cx), _mm_mul_ps(ny[p], cy)),
+                _mm_add_ps(_mm_mul_ps(nz[p], cz), nw[p])
+            );
+            __m128 radius = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(ax[p], ex), _mm_mul_ps(ay[p], ey)),
+                _mm_mul_ps(az[p], ez)
+            );
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+        }
+
+        int inside_mask = ~_mm_movemask_ps(outside) & 0xF;
+        while (inside_mask) {
+            int lane = __builtin_ctz(inside_mask);
+            visible.push_back(i + lane);
+            inside_mask &= inside_mask - 1;
+        }
+    }
+    cullScalar(frustum, boxes, wide_end, end, visible);
+}
+
+inline void cullSse(const Frustum& frustum, const CullingBoxes& boxes, std::vector<unsigned int>& visible) {
+    visible.clear();
+    visible.reserve(boxes.size());
+    cullSse(frustum, boxes, 0, boxes.size(), visible);
+}
+#endif
+
+#ifdef GLITCH_CULL_AVX
+// eight boxes per iteration, only when compiled with -mavx
+inline void cullAvx(const Frustum& frustum, const CullingBoxes& boxes, unsigned int begin, unsigned int end, std::vector<unsigned int>& visible) {
+    __m256 nx[6], ny[6], nz[6], nw[6], ax[6], ay[6], az[6];
+    for (unsigned int p = 0; p < 6; p++) {
+        const glm::vec4& plane = frustum.planes[p];
+        nx[p] = _mm256_set1_ps(plane.x);
+        ny[p] = _mm256_set1_ps(plane.y);
+        nz[p] = _mm256_set1_ps(plane.z);
+        nw[p] = _mm256_set1_ps(plane.w);
+        ax[p] = _mm256_set1_ps(std::fabs(plane.x));
+        ay[p] = _mm256_set1_ps(std::fabs(plane.y));
+        az[p] = _mm256_set1_ps(std::fabs(plane.z));
+    }
+
+    const __m256 zero = _mm256_setzero_ps();
+    const unsigned int wide_end = begin + ((end - begin) & ~7u);
+    for (unsigned int i = begin; i < wide_end; i += 8) {
+        __m256 cx = _mm256_loadu_ps(boxes.cx() + i);
+        __m256 cy = _mm256_loadu_ps(boxes.cy() + i);
+        __m256 cz = _mm256_loadu_ps(boxes.cz() + i);
+        __m256 ex = _mm256_loadu_ps(boxes.ex() + i);
+        __m256 ey = _mm256_loadu_ps(boxes.ey() + i);
+        __m256 ez = _mm256_loadu_ps(boxes.ez() + i);
+
+        __m256 outside = zero;
+        for (unsigned int p = 0; p < 6; p++) {
+            __m256 distance = _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(nx[p], cx), _mm256_mul_ps(ny[p], cy)),
+                _mm256_add_ps(_mm256_mul_ps(nz[p], cz), nw[p])
+            );
+            __m256 radius = _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(ax[p], ex), _mm256_mul_ps(ay[p], ey)),
+                _mm256_mul_ps(az[p], ez)
+            );
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), zero, _CMP_LT_OQ));
+        }
+
+        int inside_mask = ~_mm256_movemask_ps(outside) & 0xFF;
+        while (inside_mask) {
+            int lane = __builtin_ctz(inside_mask);
+            visible.push_back(i + lane);
+            inside_mask &= inside_mask - 1;
+        }
+    }
+    cullScalar(frustum, boxes, wide_end, end, visible);
+}
+
+inline void cullAvx(const Frustum& frustum, const CullingBoxes& boxes, std::vector<unsigned int>& visible) {
+    visible.clear();
+    visible.reserve(boxes.size());
+    cullAvx(frustum, boxes, 0, boxes.size(), visible);
+}
+#endif
+
+// the widest box test cull() was compiled with, for the startup log
+inline const char* cullPath() {
+#if defined(GLITCH_CULL_AVX)
+    return "avx";
+#elif defined(GLITCH_CULL_SSE)
+    return "sse";
+#else
+    return "scalar";
+#endif
+}
+
+// indices of the boxes that intersect the frustum, in ascending order,
+// using the widest instruction set this was compiled for
+inline void cull(const Frustum& frustum, const CullingBoxes& boxes, std::vector<unsigned int>& visible) {
+#if defined(GLITCH_CULL_AVX)
+    cullAvx(frustum, boxes, visible);
+#elif defined(GLITCH_CULL_SSE)
+    cullSse(frustum, boxes, visible);
+#else
+    cullScalar(frustum, boxes, visible);
+#endif
+}
+
+// appends the visible ones of boxes [begin, end), in ascending order
+inline void cull(const Frustum& frustum, const CullingBoxes& boxes, unsigned int begin, unsigned int end, std::vector<unsigned int>& visible) {
+#if defined(GLITCH_CULL_AVX)
+    cullAvx(frustum, boxes, begin, end, visible);
+#elif defined(GLITCH_CULL_SSE)
+    cullSse(frustum, boxes, begin, end, visible);
+#else
+    cullScalar(frustum, boxes, begin, end, visible);
+#endif
+}
+
+// cull() over a jobs::Scheduler's workers in chunks of grain boxes. chunk i
+// fills visible[i], so no two jobs share a list, and the lists read in
+// order give the boxes in ascending order
+template<typename Scheduler>
+void cullParallel(const Frustum& frustum, const CullingBoxes& boxes, Scheduler& scheduler, unsigned int grain,
+                  std::vector<std::vector<unsigned int> >& visible) {
+    visible.resize((boxes.size() + grain - 1) / grain);
+    scheduler.parallelFor(0, boxes.size(), grain, [&](unsigned int begin, unsigned int end) {
+        std::vector<unsigned int>& chunk_visible = visible[begin / grain];
+        chunk_visible.clear();
+        cull(frustum, boxes, begin, end, chunk_visible);
+    });
+}
+
+}
+
+#endif
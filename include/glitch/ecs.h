@@ -0,0 +1,273 @@
+#ifndef ECS_H
+#define ECS_H
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+namespace ecs {
+
+// Handle to an entity. The generation changes every time the index is
+// reused, so a handle to a destroyed entity never aliases a new one.
+struct Entity {
+    uint32_t index;
+    uint32_t generation;
+};
+
+inline bool operator==(const Entity& a, const Entity& b) {
+    return a.index == b.index && a.generation == b.generation;
+}
+
+inline bool operator!=(const Entity& a, const Entity& b) {
+    return !(a == b);
+}
+
+const Entity NULL_ENTITY = { 0xffffffffu, 0 };
+
+class PoolBase {
+  public:
+    virtual ~PoolBase() {}
+    virtual void remove(Entity entity) = 0;
+};
+
+// Sparse set: components of one type packed densely, in no particular order,
+// with the owning entity of each slot next to it. The sparse array maps an
+// entity index to its slot. Removing moves the last component into the hole,
+// so the arrays never have gaps and passes over them read memory linearly.
+template<typename T>
+class Pool : public PoolBase {
+  public:
+    // replaces the entity's component if it already has one
+    T& add(Entity entity, const T& component) {
+        if (contains(entity)) {
+            return components_[sparse_[entity.index]] = component;
+        }
+        if (entity.index >= sparse_.size()) {
+            sparse_.resize(entity.index + 1, NO_SLOT);
+        }
+        sparse_[entity.index] = entities_.size();
+        entities_.push_back(entity);
+        components_.push_back(component);
+        return components_.back();
+    }
+
+    void remove(Entity entity) {
+        if (!contains(entity)) {
+            return;
+        }
+        const uint32_t slot = sparse_[entity.index];
+        const uint32_t last = entities_.size() - 1;
+        if (slot != last) {
+            entities_[slot] = entities_[last];
+            components_[slot] = components_[last];
+            sparse_[entities_[slot].index] = slot;
+        }
+        entities_.pop_back();
+        components_.pop_back();
+        sparse_[entity.index] = NO_SLOT;
+    }
+
+    // room for n components, so adding that many in a row doesn't reallocate
+    void reserve(unsigned int n) {
+        entities_.reserve(n);
+        components_.reserve(n);
+    }
+
+    bool contains(Entity entity) const {
+        return entity.index < sparse_.size()
+            && sparse_[entity.index] != NO_SLOT
+            && entities_[sparse_[entity.index]] == entity;
+    }
+
+    T& get(Entity entity) {
+        return components_[sparse_[entity.index]];
+    }
+
+    const T& get(Entity entity) const {
+        return components_[sparse_[entity.index]];
+    }
+
+    unsigned int size() const {
+        return entities_.size();
+    }
+
+    // dense arrays, slot i of one belongs to slot i of the other
+    T* data() {
+        return components_.data();
+    }
+
+    const T* data() const {
+        return components_.data();
+    }
+
+    const Entity* entities() const {
+        return entities_.data();
+    }
+
+  private:
+    static const uint32_t NO_SLOT = 0xffffffffu;
+
+    std::vector<uint32_t> sparse_;
+    std::vector<Entity> entities_;
+    std::vector<T> components_;
+};
+
+template<typename T>
+const uint32_t Pool<T>::NO_SLOT;
+
+inline unsigned int nextComponentId() {
+    static unsigned int next = 0;
+    return next++;
+}
+
+// small dense id per component type, assigned on first use
+template<typename T>
+unsigned int componentId() {
+    static const unsigned int id = nextComponentId();
+    return id;
+}
+
+// Creates entities and owns one pool per component type. Components are
+// plain values; references into a pool are invalidated by adding or
+// removing components of that type.
+class Registry {
+  public:
+    Entity create() {
+        uint32_t index;
+        if (free_indices_.empty()) {
+            index = generations_.size();
+            generations_.push_back(0);
+        } else {
+            index = free_indices_.back();
+            free_indices_.pop_back();
+        }
+        n_alive_++;
+        return Entity { index, generations_[index] };
+    }
+
+    void destroy(Entity entity) {
+        if (!alive(entity)) {
+            return;
+        }
+        for (std::unique_ptr<PoolBase>& pool : pools_) {
+            if (pool) {
+                pool->remove(entity);
+            }
+        }
+        generations_[entity.index]++;
+        free_indices_.push_back(entity.index);
+        n_alive_--;
+    }
+
+    bool alive(Entity entity) const {
+        return entity.index < generations_.size() && generations_[entity.index] == entity.generation;
+    }
+
+    // the live entity at index, for code that only kept the index
+    Entity entityAt(uint32_t index) const {
+        return Entity { index, generations_[index] };
+    }
+
+    unsigned int size() const {
+        return n_alive_;
+    }
+
+    template<typename T>
+    Pool<T>& pool() {
+        const unsigned int id = componentId<T>();
+        if (id >= pools_.size()) {
+            pools_.resize(id + 1);
+        }
+        if (!pools_[id]) {
+            pools_[id].reset(new Pool<T>());
+        }
+        return static_cast<Pool<T>&>(*pools_[id]);
+    }
+
+    // an empty pool when no component of the type was ever added
+    template<typename T>
+    const Pool<T>& pool() const {
+        static const Pool<T> empty;
+        const unsigned int id = componentId<T>();
+        if (id >= pools_.size() || !pools_[id]) {
+            return empty;
+        }
+        return static_cast<const Pool<T>&>(*pools_[id]);
+    }
+
+    template<typename T>
+    T& add(Entity entity, const T& component) {
+        return pool<T>().add(entity, component);
+    }
+
+    template<typename T>
+    void remove(Entity entity) {
+        pool<T>().remove(entity);
+    }
+
+    template<typename T>
+    void reserve(unsigned int n) {
+        pool<T>().reserve(n);
+    }
+
+    template<typename T>
+    bool has(Entity entity) const {
+        return pool<T>().contains(entity);
+    }
+
+    template<typename T>
+    T& get(Entity entity) {
+        return pool<T>().get(entity);
+    }
+
+    template<typename T>
+    const T& get(Entity entity) const {
+        return pool<T>().get(entity);
+    }
+
+    // calls f(entity, first, rest...) for every entity with all the components.
+    // walks First's pool in order and looks the others up, so put the rarest
+    // component first. f must not add or remove these component types
+    template<typename First, typename... Rest, typename F>
+    void each(F f) {
+        Pool<First>& first = pool<First>();
+        for (unsigned int slot = 0; slot < first.size(); slot++) {
+            const Entity entity = first.entities()[slot];
+            if (hasAll<Rest...>(entity)) {
+                f(entity, first.data()[slot], get<Rest>(entity)...);
+            }
+        }
+    }
+
+    template<typename First, typename... Rest, typename F>
+    void each(F f) const {
+        const Pool<First>& first = pool<First>();
+        for (unsigned int slot = 0; slot < first.size(); slot++) {
+            const Entity entity = first.entities()[slot];
+            if (hasAll<Rest...>(entity)) {
+                f(entity, first.data()[slot], get<Rest>(entity)...);
+            }
+        }
+    }
+
+  private:
+    std::vector<uint32_t> generations_;
+    std::vector<uint32_t> free_indices_;
+    std::vector<std::unique_ptr<PoolBase>> pools_;
+    unsigned int n_alive_ = 0;
+
+    template<typename... Components>
+    bool hasAll(Entity entity) const {
+        const bool has_components[] = { true, has<Components>(entity)... };
+        for (bool has_component : has_components) {
+            if (!has_component) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,296 @@
+#ifndef FIGHT_H
+#define FIGHT_H
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <type_traits>
+
+#include <glm/glm.hpp>
+
+#include <glitch/player.h>
+#include <glitch/aabb_tree.h>
+#include <glitch/combat.h>
+
+namespace fight {
+
+static const unsigned int N_PLAYERS = 2;
+
+// one player's input for one tick. mouse movement is whole pixels so every
+// peer turns by exactly the same amount
+struct Input {
+    enum Button {
+        Forward = 1,
+        Back = 2,
+        Left = 4,
+        Right = 8,
+        Jump = 16,
+        Attack = 32
+    };
+
+    uint8_t buttons;
+    int16_t look_x;
+    int16_t look_y;
+
+    bool held(Button button) const {
+        return (buttons & button) != 0;
+    }
+};
+
+inline bool operator==(const Input& a, const Input& b) {
+    return a.buttons == b.buttons && a.look_x == b.look_x && a.look_y == b.look_y;
+}
+
+inline bool operator!=(const Input& a, const Input& b) {
+    return !(a == b);
+}
+
+struct Fighter {
+    Player::State player; // hurtbox center, yaw and pitch
+    glm::vec3 velocity;
+    uint32_t grounded;
+    uint32_t attack_ticks; // counts down from active + recovery ticks, the hitbox is out above recovery
+    uint32_t attack_hit; // the current attack already connected
+    uint32_t stun_ticks; // knocked back, input is ignored
+    uint32_t hits_taken;
+};
+
+// Everything that changes during a match, plain data so a snapshot is one memcpy
+struct GameState {
+    uint32_t tick;
+    uint32_t rng; // xorshift32, only advanced inside step
+    Fighter fighters[N_PLAYERS];
+};
+
+static_assert(std::is_trivially_copyable<GameState>::value, "GameState must stay plain data");
+
+inline uint32_t nextRandom(uint32_t& rng) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+// Deterministic fixed tick update of a GameState: the same state and inputs
+// always give the same next state on the same build, which rollback depends
+// on. Fighters are kinematic boxes resolved one axis at a time against the
+// static boxes, the arena itself never changes so it isn't in the state.
+class Simulation {
+  public:
+    struct Config {
+        float dt;
+        glm::vec3 hurtbox_size;
+        float move_speed;
+        float mouse_sensitivity;
+        float gravity;
+        float jump_speed;
+        float kill_height; // fighters falling below this respawn
+    };
+
+    // the one attack every fighter has, on Input::Attack
+    struct Attack {
+        BoxShape hitbox;
+        uint32_t active_ticks;
+        uint32_t recovery_ticks;
+        uint32_t hitstun_ticks;
+        float knockback; // speed the victim is launched at, away from the attacker
+    };
+
+    Simulation(const Config& config):
+        config_(config),
+        has_attack_(false)
+    {}
+
+    // box from min corner to max corner
+    void addStaticBox(const Aabb& box) {
+        static_boxes_.push_back(box);
+    }
+
+    // without any, a fighter's hurtbox is its whole collision box
+    void addHurtbox(const BoxShape& shape) {
+        hurtboxes_.push_back(shape);
+    }
+
+    void setAttack(const Attack& attack) {
+        attack_ = attack;
+        has_attack_ = true;
+    }
+
+    void addSpawn(glm::vec3 position, float yaw) {
+        spawns_.push_back(Player::State { position, yaw, 0.0f });
+    }
+
+    // fighter i starts at spawn i % number of spawns
+    GameState initialState(uint32_t seed) const {
+        GameState state = GameState();
+        state.rng = seed ? seed : 1;
+        for (unsigned int i = 0; i < N_PLAYERS; i++) {
+            state.fighters[i].player = spawns_.empty() ? Player::State { glm::vec3(0.0f), -90.0f, 0.0f } : spawns_[i % spawns_.size()];
+        }
+        return state;
+    }
+
+    // advance one tick, inputs has one entry per player
+    void step(GameState& state, const Input* inputs) const {
+        Player::State previous[N_PLAYERS];
+        for (unsigned int i = 0; i < N_PLAYERS; i++) {
+            previous[i] = state.fighters[i].player;
+            stepFighter(state, state.fighters[i], inputs[i]);
+        }
+        resolveHits(state, previous);
+        state.tick++;
+    }
+
+    const Config& config() const {
+        return config_;
+    }
+
+  private:
+    Config config_;
+    std::vector<Aabb> static_boxes_;
+    std::vector<Player::State> spawns_;
+    std::vector<BoxShape> hurtboxes_;
+    Attack attack_;
+    bool has_attack_;
+
+    // scratch space for resolveHits, step still only depends on the state and inputs
+    mutable CollisionWorld combat_;
+    mutable std::vector<Contact> contacts_;
+
+    void stepFighter(GameState& state, Fighter& fighter, const Input& input) const {
+        Player::State& player = fighter.player;
+        player.yaw += input.look_x * config_.mouse_sensitivity;
+        player.pitch = std::min(std::max(player.pitch + input.look_y * config_.mouse_sensitivity, -89.0f), 89.0f);
+
+        if (fighter.attack_ticks > 0) {
+            fighter.attack_ticks--;
+        }
+        fighter.velocity.y -= config_.gravity * config_.dt;
+        if (fighter.stun_ticks > 0) {
+            // keep flying the way the hit sent us
+            fighter.stun_ticks--;
+        } else {
+            // walk on the xz plane whatever the pitch
+            const float yaw = glm::radians(player.yaw);
+            const glm::vec3 front(std::cos(yaw), 0.0f, std::sin(yaw));
+            const glm::vec3 right(-front.z, 0.0f, front.x);
+            glm::vec3 walk(0.0f);
+            if (input.held(Input::Forward)) walk += front;
+            if (input.held(Input::Back)) walk -= front;
+            if (input.held(Input::Left)) walk -= right;
+            if (input.held(Input::Right)) walk += right;
+            if (glm::dot(walk, walk) > 0.0f) {
+                walk = glm::normalize(walk) * config_.move_speed;
+            }
+            fighter.velocity.x = walk.x;
+            fighter.velocity.z = walk.z;
+            if (fighter.grounded && input.held(Input::Jump)) {
+                fighter.velocity.y = config_.jump_speed;
+            }
+            if (has_attack_ && fighter.attack_ticks == 0 && input.held(Input::Attack)) {
+                fighter.attack_ticks = attack_.active_ticks + attack_.recovery_ticks;
+                fighter.attack_hit = 0;
+            }
+        }
+
+        fighter.grounded = 0;
+        for (int axis = 0; axis < 3; axis++) {
+            moveAxis(fighter, axis);
+        }
+
+        if (player.position.y < config_.kill_height) {
+            respawn(state, fighter);
+        }
+    }
+
+    void moveAxis(Fighter& fighter, int axis) const {
+        const float delta = fighter.velocity[axis] * config_.dt;
+        if (delta == 0.0f) {
+            return;
+        }
+        glm::vec3& position = fighter.player.position;
+        position[axis] += delta;
+        const glm::vec3 half = 0.5f * config_.hurtbox_size;
+        for (const Aabb& box : static_boxes_) {
+            Aabb hurtbox(position - half, position + half);
+            if (!overlapsStrictly(hurtbox, box)) {
+                continue;
+            }
+            // back out along the axis we came from
+            if (delta > 0.0f) {
+                position[axis] = box.min[axis] - half[axis];
+            } else {
+                position[axis] = box.max[axis] + half[axis];
+                if (axis == 1) {
+                    fighter.grounded = 1;
+                }
+            }
+            fighter.velocity[axis] = 0.0f;
+        }
+    }
+
+    // touching faces don't count, a fighter standing on a box isn't inside it.
+    // the skin absorbs rounding after being pushed out onto a face
+    static bool overlapsStrictly(const Aabb& a, const Aabb& b) {
+        const float skin = 1e-4f;
+        return a.min.x < b.max.x - skin && a.max.x > b.min.x + skin
+            && a.min.y < b.max.y - skin && a.max.y > b.min.y + skin
+            && a.min.z < b.max.z - skin && a.max.z > b.min.z + skin;
+    }
+
+    bool attacking(const Fighter& fighter) const {
+        return fighter.attack_ticks > attack_.recovery_ticks && !fighter.attack_hit;
+    }
+
+    // hitboxes against hurtboxes over the movement of this tick, every
+    // contact lands; both fighters hitting each other on the same tick trade
+    void resolveHits(GameState& state, const Player::State* previous) const {
+        if (!has_attack_) {
+            return;
+        }
+        combat_.clear();
+        bool any_attack = false;
+        for (unsigned int i = 0; i < N_PLAYERS; i++) {
+            const Fighter& fighter = state.fighters[i];
+            if (hurtboxes_.empty()) {
+                combat_.addHurtbox(i, previous[i], fighter.player, BoxShape { glm::vec3(0.0f), 0.5f * config_.hurtbox_size });
+            }
+            for (const BoxShape& hurtbox : hurtboxes_) {
+                combat_.addHurtbox(i, previous[i], fighter.player, hurtbox);
+            }
+            if (attacking(fighter)) {
+                combat_.addHitbox(i, previous[i], fighter.player, attack_.hitbox);
+                any_attack = true;
+            }
+        }
+        if (!any_attack) {
+            return;
+        }
+
+        combat_.collide(contacts_);
+        for (const Contact& contact : contacts_) {
+            Fighter& attacker = state.fighters[contact.attacker];
+            Fighter& victim = state.fighters[contact.victim];
+            const float yaw = glm::radians(attacker.player.yaw);
+            victim.velocity = attack_.knockback * glm::vec3(std::cos(yaw), 0.5f, std::sin(yaw));
+            victim.stun_ticks = attack_.hitstun_ticks;
+            victim.hits_taken++;
+            attacker.attack_hit = 1;
+        }
+    }
+
+    void respawn(GameState& state, Fighter& fighter) const {
+        if (spawns_.empty()) {
+            fighter.player.position = glm::vec3(0.0f);
+        } else {
+            fighter.player = spawns_[nextRandom(state.rng) % spawns_.size()];
+        }
+        fighter.velocity = glm::vec3(0.0f);
+        fighter.stun_ticks = 0;
+    }
+};
+
+}
+
+#endif
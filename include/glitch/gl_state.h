@@ -0,0 +1,299 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+namespace gfx {
+
+// Shadow copy of the GL state we touch every frame: bound program, vertex
+// array, buffers, texture units and a few capabilities. Everything binds
+// through here so a call only reaches the driver when it changes something.
+// It assumes one context on one thread; code that changes state behind its
+// back has to call invalidate() afterwards.
+class GLState {
+  public:
+    static const unsigned int MAX_TEXTURE_UNITS = 16;
+
+    struct Counters {
+        unsigned long long issued;
+        unsigned long long skipped;
+    };
+
+    static GLState& instance() {
+        static GLState state;
+        return state;
+    }
+
+    void useProgram(unsigned int program) {
+        if (check(program_, program)) {
+            glUseProgram(program);
+        }
+    }
+
+    void bindVertexArray(unsigned int vao) {
+        if (check(vao_, vao)) {
+            glBindVertexArray(vao);
+            // the element buffer binding is part of the vertex array
+            buffers_[ELEMENT_SLOT] = UNKNOWN;
+        }
+    }
+
+    void bindBuffer(unsigned int target, unsigned int buffer) {
+        unsigned int slot = bufferSlot(target);
+        if (slot == N_BUFFER_SLOTS ? issue() : check(buffers_[slot], buffer)) {
+            glBindBuffer(target, buffer);
+        }
+    }
+
+    // also binds the generic binding point, like GL does
+    void bindBufferBase(unsigned int target, unsigned int index, unsigned int buffer) {
+        glBindBufferBase(target, index, buffer);
+        issue();
+        unsigned int slot = bufferSlot(target);
+        if (slot != N_BUFFER_SLOTS) {
+            buffers_[slot] = buffer;
+        }
+    }
+
+    void bindBufferRange(unsigned int target, unsigned int index, unsigned int buffer, unsigned int offset, unsigned int size) {
+        glBindBufferRange(target, index, buffer, offset, size);
+        issue();
+        unsigned int slot = bufferSlot(target);
+        if (slot != N_BUFFER_SLOTS) {
+            buffers_[slot] = buffer;
+        }
+    }
+
+    // unit is GL_TEXTURE0 + n
+    void activeTexture(unsigned int unit) {
+        if (check(active_unit_, unit - GL_TEXTURE0)) {
+            glActiveTexture(unit);
+        }
+    }
+
+    // bind to the active unit
+    void bindTexture(unsigned int target, unsigned int texture) {
+        unsigned int slot = textureSlot(target);
+        if ((active_unit_ >= MAX_TEXTURE_UNITS || slot == N_TEXTURE_SLOTS) ? issue() : check(textures_[active_unit_][slot], texture)) {
+            glBindTexture(target, texture);
+        }
+    }
+
+    // make texture current on unit, only switching units when the binding changes
+    void bindTextureUnit(unsigned int unit, unsigned int target, unsigned int texture) {
+        unsigned int index = unit - GL_TEXTURE0;
+        unsigned int slot = textureSlot(target);
+        if (index < MAX_TEXTURE_UNITS && slot != N_TEXTURE_SLOTS && textures_[index][slot] == texture) {
+            counters_.skipped++;
+            return;
+        }
+        activeTexture(unit);
+        bindTexture(target, texture);
+    }
+
+    void enable(unsigned int capability) {
+        setCapability(capability, true);
+    }
+
+    void disable(unsigned int capability) {
+        setCapability(capability, false);
+    }
+
+    void blendFunc(unsigned int src, unsigned int dst) {
+        if (blend_src_ == src && blend_dst_ == dst) {
+            counters_.skipped++;
+            return;
+        }
+        blend_src_ = src;
+        blend_dst_ = dst;
+        glBlendFunc(src, dst);
+        issue();
+    }
+
+    void depthFunc(unsigned int func) {
+        if (check(depth_func_, func)) {
+            glDepthFunc(func);
+        }
+    }
+
+    void depthMask(bool write) {
+        if (check(depth_mask_, write ? 1u : 0u)) {
+            glDepthMask(write ? GL_TRUE : GL_FALSE);
+        }
+    }
+
+    // deleting a bound object resets its bindings to 0 in GL, keep up with that
+    // so a recycled name isn't mistaken for the old object
+    void forgetBuffer(unsigned int buffer) {
+        for (unsigned int& bound : buffers_) {
+            if (bound == buffer) {
+                bound = 0;
+            }
+        }
+    }
+
+    // a deleted program stays current in GL until the next glUseProgram, so
+    // don't skip that call when its name comes back for a new program
+    void forgetProgram(unsigned int program) {
+        if (program_ == program) {
+            program_ = UNKNOWN;
+        }
+    }
+
+    void forgetVertexArray(unsigned int vao) {
+        if (vao_ == vao) {
+            vao_ = 0;
+            buffers_[ELEMENT_SLOT] = UNKNOWN;
+        }
+    }
+
+    void forgetTexture(unsigned int texture) {
+        for (unsigned int unit = 0; unit < MAX_TEXTURE_UNITS; unit++) {
+            for (unsigned int& bound : textures_[unit]) {
+                if (bound == texture) {
+                    bound = 0;
+                }
+            }
+        }
+    }
+
+    // forget everything, the next call of each kind always reaches GL
+    void invalidate() {
+        program_ = UNKNOWN;
+        vao_ = UNKNOWN;
+        for (unsigned int& bound : buffers_) {
+            bound = UNKNOWN;
+        }
+        active_unit_ = UNKNOWN;
+        for (unsigned int unit = 0; unit < MAX_TEXTURE_UNITS; unit++) {
+            for (unsigned int& bound : textures_[unit]) {
+                bound = UNKNOWN;
+            }
+        }
+        for (unsigned int& enabled : capabilities_) {
+            enabled = UNKNOWN;
+        }
+        blend_src_ = blend_dst_ = UNKNOWN;
+        depth_func_ = UNKNOWN;
+        depth_mask_ = UNKNOWN;
+    }
+
+    Counters counters() const {
+        return counters_;
+    }
+
+    void resetCounters() {
+        counters_ = Counters { 0, 0 };
+    }
+
+  private:
+    static const unsigned int UNKNOWN = 0xffffffffu;
+
+    enum BufferSlot {
+        ARRAY_SLOT,
+        ELEMENT_SLOT,
+        UNIFORM_SLOT,
+        PIXEL_UNPACK_SLOT,
+        PIXEL_PACK_SLOT,
+        COPY_READ_SLOT,
+        COPY_WRITE_SLOT,
+        N_BUFFER_SLOTS
+    };
+
+    enum TextureSlot {
+        TEXTURE_2D_SLOT,
+        TEXTURE_2D_ARRAY_SLOT,
+        TEXTURE_3D_SLOT,
+        TEXTURE_CUBE_MAP_SLOT,
+        N_TEXTURE_SLOTS
+    };
+
+    enum CapabilitySlot {
+        DEPTH_TEST_SLOT,
+        BLEND_SLOT,
+        CULL_FACE_SLOT,
+        N_CAPABILITY_SLOTS
+    };
+
+    unsigned int program_;
+    unsigned int vao_;
+    unsigned int buffers_[N_BUFFER_SLOTS];
+    unsigned int active_unit_;
+    unsigned int textures_[MAX_TEXTURE_UNITS][N_TEXTURE_SLOTS];
+    unsigned int capabilities_[N_CAPABILITY_SLOTS];
+    unsigned int blend_src_;
+    unsigned int blend_dst_;
+    unsigned int depth_func_;
+    unsigned int depth_mask_;
+    Counters counters_;
+
+    GLState():
+        counters_(Counters { 0, 0 })
+    {
+        invalidate();
+    }
+
+    // true when the shadow changed and GL has to be told
+    bool check(unsigned int& shadow, unsigned int value) {
+        if (shadow == value) {
+            counters_.skipped++;
+            return false;
+        }
+        shadow = value;
+        counters_.issued++;
+        return true;
+    }
+
+    // for state that isn't shadowed
+    bool issue() {
+        counters_.issued++;
+        return true;
+    }
+
+    static unsigned int bufferSlot(unsigned int target) {
+        switch (target) {
+            case GL_ARRAY_BUFFER: return ARRAY_SLOT;
+            case GL_ELEMENT_ARRAY_BUFFER: return ELEMENT_SLOT;
+            case GL_UNIFORM_BUFFER: return UNIFORM_SLOT;
+            case GL_PIXEL_UNPACK_BUFFER: return PIXEL_UNPACK_SLOT;
+            case GL_PIXEL_PACK_BUFFER: return PIXEL_PACK_SLOT;
+            case GL_COPY_READ_BUFFER: return COPY_READ_SLOT;
+            case GL_COPY_WRITE_BUFFER: return COPY_WRITE_SLOT;
+            default: return N_BUFFER_SLOTS;
+        }
+    }
+
+    static unsigned int textureSlot(unsigned int target) {
+        switch (target) {
+            case GL_TEXTURE_2D: return TEXTURE_2D_SLOT;
+            case GL_TEXTURE_2D_ARRAY: return TEXTURE_2D_ARRAY_SLOT;
+            case GL_TEXTURE_3D: return TEXTURE_3D_SLOT;
+            case GL_TEXTURE_CUBE_MAP: return TEXTURE_CUBE_MAP_SLOT;
+            default: return N_TEXTURE_SLOTS;
+        }
+    }
+
+    static unsigned int capabilitySlot(unsigned int capability) {
+        switch (capability) {
+            case GL_DEPTH_TEST: return DEPTH_TEST_SLOT;
+            case GL_BLEND: return BLEND_SLOT;
+            case GL_CULL_FACE: return CULL_FACE_SLOT;
+            default: return N_CAPABILITY_SLOTS;
+        }
+    }
+
+    void setCapability(unsigned int capability, bool enabled) {
+        unsigned int slot = capabilitySlot(capability);
+        if (slot == N_CAPABILITY_SLOTS ? issue() : check(capabilities_[slot], enabled ? 1u : 0u)) {
+            if (enabled) {
+                glEnable(capability);
+            } else {
+                glDisable(capability);
+            }
+        }
+    }
+};
+
+}
+
+#endif
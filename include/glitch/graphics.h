@@ -3,17 +3,154 @@
 
 #include <vector>
 #include <iostream>
+#include <algorithm>
+#include <cstring>
 
 #include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 #include <glad/glad.h>
+#include <stb_image.h>
+
+#include <glitch/gl_state.h>
+#include <glitch/stream_buffer.h>
 
 namespace gfx {
 
-const unsigned int N_CUBE_SOLID_COLOR_VERTICES = 8 * 3;
-const unsigned int N_CUBE_TEXTURE_VERTICES = 24 * 5; // * length of single vertex data
 const unsigned int N_CUBE_INDICES = 12 * 3; // * 3 xyz coords
 const unsigned int N_CUBE_DRAW_VERTICES = 36;
 
+// instanced attribute locations, must match v_instanced.glsl
+const unsigned int INSTANCE_MODEL_ATTRIBUTE = 2; // mat4 takes locations 2-5
+const unsigned int INSTANCE_COLOR_ATTRIBUTE = 6;
+const unsigned int INSTANCE_LAYER_ATTRIBUTE = 7;
+
+// vertex layouts meshes can be generated for
+struct PositionLayout {
+    static const unsigned int N_FLOATS = 3; // xyz
+};
+
+struct PositionUvLayout {
+    static const unsigned int N_FLOATS = 5; // xyz uv
+};
+
+// Unit cube for each layout, baked at compile time. Block size is applied by
+// the model matrix so every block of a layout shares this data.
+// (Dummy only exists so the arrays can be defined in this header)
+template<typename Layout, typename Dummy = void>
+struct UnitCube;
+
+template<typename Dummy>
+struct UnitCube<PositionLayout, Dummy> {
+    static const unsigned int N_VERTICES = 8;
+
+    static constexpr float vertices[N_VERTICES * PositionLayout::N_FLOATS] = {
+        0.0f, 0.0f, 0.0f,
+        1.0f, 0.0f, 0.0f,
+        1.0f, 1.0f, 0.0f,
+        0.0f, 1.0f, 0.0f,
+        0.0f, 0.0f, 1.0f,
+        1.0f, 0.0f, 1.0f,
+        1.0f, 1.0f, 1.0f,
+        0.0f, 1.0f, 1.0f
+    };
+
+    static constexpr unsigned int indices[N_CUBE_INDICES] = {
+        0, 1, 2,
+        2, 3, 0,
+
+        4, 5, 6,
+        6, 7, 4,
+
+        4, 5, 1,
+        1, 0, 4,
+
+        3, 2, 6,
+        6, 7, 3,
+
+        4, 0, 3,
+        3, 7, 4,
+
+        1, 5, 6,
+        6, 2, 1
+    };
+};
+
+template<typename Dummy>
+constexpr float UnitCube<PositionLayout, Dummy>::vertices[];
+template<typename Dummy>
+constexpr unsigned int UnitCube<PositionLayout, Dummy>::indices[];
+
+template<typename Dummy>
+struct UnitCube<PositionUvLayout, Dummy> {
+    static const unsigned int N_VERTICES = 24; // faces don't share uvs
+
+    static constexpr float vertices[N_VERTICES * PositionUvLayout::N_FLOATS] = {
+        0.0f, 0.0f, 0.0f,  0.0f, 0.0f,
+        1.0f, 0.0f, 0.0f,  1.0f, 0.0f,
+        1.0f, 1.0f, 0.0f,  1.0f, 1.0f,
+        0.0f, 1.0f, 0.0f,  0.0f, 1.0f,
+
+        0.0f, 0.0f, 1.0f,  0.0f, 0.0f,
+        1.0f, 0.0f, 1.0f,  1.0f, 0.0f,
+        1.0f, 1.0f, 1.0f,  1.0f, 1.0f,
+        0.0f, 1.0f, 1.0f,  0.0f, 1.0f,
+
+        0.0f, 1.0f, 1.0f,  1.0f, 0.0f,
+        0.0f, 1.0f, 0.0f,  1.0f, 1.0f,
+        0.0f, 0.0f, 0.0f,  0.0f, 1.0f,
+        0.0f, 0.0f, 1.0f,  0.0f, 0.0f,
+
+        1.0f, 1.0f, 1.0f,  1.0f, 0.0f,
+        1.0f, 1.0f, 0.0f,  1.0f, 1.0f,
+        1.0f, 0.0f, 0.0f,  0.0f, 1.0f,
+        1.0f, 0.0f, 1.0f,  0.0f, 0.0f,
+
+        0.0f, 0.0f, 0.0f,  0.0f, 1.0f,
+        1.0f, 0.0f, 0.0f,  1.0f, 1.0f,
+        1.0f, 0.0f, 1.0f,  1.0f, 0.0f,
+        0.0f, 0.0f, 1.0f,  0.0f, 0.0f,
+
+        0.0f, 1.0f, 0.0f,  0.0f, 1.0f,
+        1.0f, 1.0f, 0.0f,  1.0f, 1.0f,
+        1.0f, 1.0f, 1.0f,  1.0f, 0.0f,
+        0.0f, 1.0f, 1.0f,  0.0f, 0.0f,
+    };
+
+    static constexpr unsigned int indices[N_CUBE_INDICES] = {
+        0, 1, 2,
+        2, 3, 0,
+
+        4, 5, 6,
+        6, 7, 4,
+
+        8, 9, 10,
+        10, 11, 8,
+
+        12, 13, 14,
+        14, 15, 12,
+
+        16, 17, 18,
+        18, 19, 16,
+
+        20, 21, 22,
+        22, 23, 20,
+    };
+};
+
+template<typename Dummy>
+constexpr float UnitCube<PositionUvLayout, Dummy>::vertices[];
+template<typename Dummy>
+constexpr unsigned int UnitCube<PositionUvLayout, Dummy>::indices[];
+
+// buffer sizes of the unit cube of a layout
+template<typename Layout>
+struct CubeMesh {
+    typedef UnitCube<Layout> Data;
+
+    static const unsigned int VERTEX_BYTES = sizeof(Data::vertices);
+    static const unsigned int INDEX_BYTES = sizeof(Data::indices);
+};
+
 class Block {
   public:
     
@@ -22,9 +159,6 @@ class Block {
         size_(size)
     {}
 
-    virtual std::vector<float> vertices() const = 0;
-    virtual std::vector<unsigned int> indices() const = 0;
-
     void setPosition(glm::vec3 new_position) {
         position_ = new_position;
     }
@@ -44,111 +178,20 @@ class Block {
 
 class SolidColorBlock : public Block {
   public:
+    typedef PositionLayout Layout;
+
     SolidColorBlock(glm::vec3 position, glm::vec3 size):
         Block(position, size)
     {}
-
-    std::vector<float> vertices() const {
-
-        const glm::vec3 size = this->size();
-        return {
-            0.0f,   0.0f,   0.0f,
-            size.x, 0.0f,   0.0f,
-            size.x, size.y, 0.0f,
-            0.0f,   size.y, 0.0f,
-            0.0f,   0.0f,   size.z,
-            size.x, 0.0f,   size.z,
-            size.x, size.y, size.z,
-            0.0f,   size.y, size.z
-        };
-    }
-
-    std::vector<unsigned int> indices() const {
-        return {
-            0, 1, 2,
-            2, 3, 0,
-
-            4, 5, 6,
-            6, 7, 4,
-
-            4, 5, 1,
-            1, 0, 4,
-
-            3, 2, 6,
-            6, 7, 3,
-
-            4, 0, 3,
-            3, 7, 4,
-
-            1, 5, 6,
-            6, 2, 1
-        };
-    }
 };
 
 class TextureBlock : public Block {
   public:
+    typedef PositionUvLayout Layout;
+
     TextureBlock(glm::vec3 position, glm::vec3 size):
         Block(position, size)
     {}
-
-    std::vector<float> vertices() const {
-
-        const glm::vec3 size = this->size();
-        return {
-            0.0f, 0.0f, 0.0f,  0.0f, 0.0f,
-            size.x, 0.0f, 0.0f,  1.0f, 0.0f,
-            size.x,  size.y, 0.0f,  1.0f, 1.0f,
-            0.0f,  size.y, 0.0f,  0.0f, 1.0f,
-
-            0.0f, 0.0f,  size.z,  0.0f, 0.0f,
-            size.x, 0.0f,  size.z,  1.0f, 0.0f,
-            size.x,  size.y,  size.z,  1.0f, 1.0f,
-            0.0f,  size.y,  size.z,  0.0f, 1.0f,
-
-            0.0f,  size.y,  size.z,  1.0f, 0.0f,
-            0.0f,  size.y, 0.0f,  1.0f, 1.0f,
-            0.0f, 0.0f, 0.0f,  0.0f, 1.0f,
-            0.0f, 0.0f,  size.z,  0.0f, 0.0f,
-
-            size.x,  size.y,  size.z,  1.0f, 0.0f,
-            size.x,  size.y, 0.0f,  1.0f, 1.0f,
-            size.x, 0.0f, 0.0f,  0.0f, 1.0f,
-            size.x, 0.0f,  size.z,  0.0f, 0.0f,
-
-            0.0f, 0.0f, 0.0f,  0.0f, 1.0f,
-            size.x, 0.0f, 0.0f,  1.0f, 1.0f,
-            size.x, 0.0f,  size.z,  1.0f, 0.0f,
-            0.0f, 0.0f,  size.z,  0.0f, 0.0f,
-
-            0.0f,  size.y, 0.0f,  0.0f, 1.0f,
-            size.x,  size.y, 0.0f,  1.0f, 1.0f,
-            size.x,  size.y,  size.z,  1.0f, 0.0f,
-            0.0f,  size.y,  size.z,  0.0f, 0.0f,
-        };
-    }
-
-    std::vector<unsigned int> indices() const {
-        return {
-            0, 1, 2,
-            2, 3, 0,
-
-            4, 5, 6,
-            6, 7, 4,
-
-            8, 9, 10,
-            10, 11, 8,
-
-            12, 13, 14,
-            14, 15, 12,
-
-            16, 17, 18,
-            18, 19, 16,
-
-            20, 21, 22,
-            22, 23, 20,
-        };
-    }
 };
 
 class VAO {
@@ -157,50 +200,42 @@ class VAO {
     
     VAO() {
         glGenVertexArrays(1, &addr_);
-        glBindVertexArray(addr_);
     }
 
-    void initFromBlock(const SolidColorBlock& block) {
-        std::vector<float> vtx_vec = block.vertices();
-        float vertices[gfx::N_CUBE_SOLID_COLOR_VERTICES];
-        std::copy(vtx_vec.begin(), vtx_vec.end(), vertices);
-        std::vector<unsigned int> idx_vec = block.indices();
-        unsigned int indices[gfx::N_CUBE_INDICES];
-        std::copy(idx_vec.begin(), idx_vec.end(), indices);
-
-        addVertexBuffer(sizeof(vertices), vertices, GL_STATIC_DRAW);
-        addElementBuffer(sizeof(indices), indices, GL_STATIC_DRAW);
-        addVertexAttribute(0, 3, 3, 0);
+    // upload the unit cube of a layout, straight from the compile time tables
+    template<typename Layout>
+    void initCube() {
+        bind();
+        addVertexBuffer(CubeMesh<Layout>::VERTEX_BYTES, UnitCube<Layout>::vertices, GL_STATIC_DRAW);
+        addElementBuffer(CubeMesh<Layout>::INDEX_BYTES, UnitCube<Layout>::indices, GL_STATIC_DRAW);
+        addLayoutAttributes(Layout());
     }
 
-    void initFromBlock(const TextureBlock& block) {
-        std::vector<float> vtx_vec = block.vertices();
-        float vertices[gfx::N_CUBE_TEXTURE_VERTICES];
-        std::copy(vtx_vec.begin(), vtx_vec.end(), vertices);
-        std::vector<unsigned int> idx_vec = block.indices();
-        unsigned int indices[gfx::N_CUBE_INDICES];
-        std::copy(idx_vec.begin(), idx_vec.end(), indices);
+    void addLayoutAttributes(PositionLayout) {
+        addVertexAttribute(0, 3, PositionLayout::N_FLOATS, 0);
+    }
 
-        addVertexBuffer(sizeof(vertices), vertices, GL_STATIC_DRAW);
-        addElementBuffer(sizeof(indices), indices, GL_STATIC_DRAW);
-        addVertexAttribute(0, 3, 5, 0);
-        addVertexAttribute(1, 3, 5, 3);
+    void addLayoutAttributes(PositionUvLayout) {
+        addVertexAttribute(0, 3, PositionUvLayout::N_FLOATS, 0);
+        addVertexAttribute(1, 2, PositionUvLayout::N_FLOATS, 3);
     }
 
-    void addVertexBuffer(unsigned int data_size, float vertices[], int draw_type) {
+    unsigned int addVertexBuffer(unsigned int data_size, const float vertices[], int draw_type) {
         unsigned int VBO;
         glGenBuffers(1, &VBO);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        GLState::instance().bindBuffer(GL_ARRAY_BUFFER, VBO);
         glBufferData(GL_ARRAY_BUFFER, data_size, vertices, draw_type);
         buffer_addrs_.push_back(VBO);
+        return VBO;
     }
 
-    void addElementBuffer(unsigned int data_size, unsigned int indices[], int draw_type) {
+    unsigned int addElementBuffer(unsigned int data_size, const unsigned int indices[], int draw_type) {
         unsigned int EBO;
         glGenBuffers(1, &EBO);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        GLState::instance().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, data_size, indices, draw_type);
         buffer_addrs_.push_back(EBO);
+        return EBO;
     }
 
     // n_values = how many values in this single attribute
@@ -211,8 +246,14 @@ class VAO {
         glEnableVertexAttribArray(attribute_id);
     }
 
+    // same as addVertexAttribute, but advances once per instance instead of once per vertex
+    void addInstanceAttribute(unsigned int attribute_id, unsigned int n_values, unsigned int value_count, unsigned int start_idx) {
+        addVertexAttribute(attribute_id, n_values, value_count, start_idx);
+        glVertexAttribDivisor(attribute_id, 1);
+    }
+
     void bind() {
-        glBindVertexArray(addr_);
+        GLState::instance().bindVertexArray(addr_);
     }
 
     void drawArrays(unsigned int n_vertices) {
@@ -223,11 +264,17 @@ class VAO {
         glDrawElements(GL_TRIANGLES, n_vertices, GL_UNSIGNED_INT, 0);
     }
 
+    void drawElementsInstanced(unsigned int n_vertices, unsigned int n_instances) {
+        glDrawElementsInstanced(GL_TRIANGLES, n_vertices, GL_UNSIGNED_INT, 0, n_instances);
+    }
+
     void deallocate() {
         glDeleteVertexArrays(1, &addr_);
+        GLState::instance().forgetVertexArray(addr_);
         for (unsigned int buffer_addr : buffer_addrs_) {
             // not really sure if this is doing what I think it does
             glDeleteBuffers(1, &buffer_addr);
+            GLState::instance().forgetBuffer(buffer_addr);
         }
     }
 
@@ -236,28 +283,378 @@ class VAO {
     std::vector<unsigned int> buffer_addrs_;
 };
 
+// Geometry for one draw call, ready to go once a program is in use.
+// model, color and fade only reach programs that have such uniforms, instanced
+// draws carry theirs per instance.
+struct DrawItem {
+    VAO* vao;
+    unsigned int n_indices;
+    unsigned int n_instances;
+    glm::mat4 model;
+    glm::vec4 color;
+    float fade; // dithered level of detail cross-fade, see LodSelector::fade
+
+    DrawItem(VAO* vao = NULL, unsigned int n_indices = 0, unsigned int n_instances = 1):
+        vao(vao),
+        n_indices(n_indices),
+        n_instances(n_instances),
+        model(1.0f),
+        color(1.0f),
+        fade(1.0f)
+    {}
+
+    bool empty() const {
+        return n_indices == 0 || n_instances == 0;
+    }
+
+    void draw() const {
+        if (empty()) {
+            return;
+        }
+        vao->bind();
+        if (n_instances == 1) {
+            vao->drawElements(n_indices);
+        } else {
+            vao->drawElementsInstanced(n_indices, n_instances);
+        }
+    }
+};
+
+enum class BlockLayout {
+    SolidColor,
+    Texture
+};
+
+// Per instance data streamed to the instance buffer, layout matches v_instanced.glsl
+struct InstanceData {
+    glm::mat4 model;
+    glm::vec4 color;
+    float layer; // texture array layer, ignored by solid color shaders
+};
+
+const unsigned int N_INSTANCE_FLOATS = sizeof(InstanceData) / sizeof(float);
+
+// model matrix for a block drawn from the shared unit cube
+inline glm::mat4 blockModel(const Block& block) {
+    glm::mat4 model = glm::translate(glm::mat4(1.0f), block.position());
+    return glm::scale(model, block.size());
+}
+
+// Draws every instance of one block layout with a single glDrawElementsInstanced.
+// All instances share a unit cube mesh, block position/size live in the model matrix.
+// Instances are kept packed (removal swaps with the last one) and only the range
+// touched since the last draw is re-uploaded. Instances that change every frame
+// can be written to a StreamBuffer instead, the instance attributes follow
+// whichever buffer was used last.
+class InstancedBatch {
+  public:
+    typedef unsigned int InstanceId;
+
+    InstancedBatch(BlockLayout layout, unsigned int initial_capacity = 64):
+        capacity_(initial_capacity > 0 ? initial_capacity : 1),
+        attribute_buffer_(0),
+        attribute_offset_(0),
+        dirty_begin_(0),
+        dirty_end_(0)
+    {
+        if (layout == BlockLayout::SolidColor) {
+            vao_.initCube<SolidColorBlock::Layout>();
+        } else {
+            vao_.initCube<TextureBlock::Layout>();
+        }
+
+        instance_vbo_ = vao_.addVertexBuffer(capacity_ * sizeof(InstanceData), NULL, GL_DYNAMIC_DRAW);
+        pointInstanceAttributes(instance_vbo_, 0);
+        instances_.reserve(capacity_);
+        id_of_slot_.reserve(capacity_);
+        slot_of_id_.reserve(capacity_);
+    }
+
+    InstanceId add(const glm::mat4& model, const glm::vec4& color = glm::vec4(1.0f), unsigned int layer = 0) {
+        InstanceId id;
+        if (free_ids_.empty()) {
+            id = slot_of_id_.size();
+            slot_of_id_.push_back(0);
+        } else {
+            id = free_ids_.back();
+            free_ids_.pop_back();
+        }
+        unsigned int slot = instances_.size();
+        InstanceData data = { model, color, static_cast<float>(layer) };
+        instances_.push_back(data);
+        id_of_slot_.push_back(id);
+        slot_of_id_[id] = slot;
+        markDirty(slot);
+        return id;
+    }
+
+    void remove(InstanceId id) {
+        unsigned int slot = slot_of_id_[id];
+        unsigned int last = instances_.size() - 1;
+        if (slot != last) {
+            instances_[slot] = instances_[last];
+            id_of_slot_[slot] = id_of_slot_[last];
+            slot_of_id_[id_of_slot_[slot]] = slot;
+            markDirty(slot);
+        }
+        instances_.pop_back();
+        id_of_slot_.pop_back();
+        free_ids_.push_back(id);
+        if (dirty_end_ > instances_.size()) {
+            dirty_end_ = instances_.size();
+        }
+        if (dirty_begin_ >= dirty_end_) {
+            dirty_begin_ = dirty_end_ = 0;
+        }
+    }
+
+    void setModel(InstanceId id, const glm::mat4& model) {
+        unsigned int slot = slot_of_id_[id];
+        instances_[slot].model = model;
+        markDirty(slot);
+    }
+
+    // for code that fills models in place (gfx::Transforms), the instance is re-uploaded
+    glm::mat4& model(InstanceId id) {
+        unsigned int slot = slot_of_id_[id];
+        markDirty(slot);
+        return instances_[slot].model;
+    }
+
+    // model() for several threads at once, each writing different instances
+    // (Transforms::update on a scheduler). every instance is re-uploaded
+    class ModelWriter {
+      public:
+        explicit ModelWriter(InstancedBatch& batch): batch_(batch) {
+            if (!batch.instances_.empty()) {
+                batch.markDirty(0);
+                batch.markDirty(batch.instances_.size() - 1);
+            }
+        }
+
+        glm::mat4& model(InstanceId id) {
+            return batch_.instances_[batch_.slot_of_id_[id]].model;
+        }
+
+      private:
+        InstancedBatch& batch_;
+    };
+
+    void setColor(InstanceId id, const glm::vec4& color) {
+        unsigned int slot = slot_of_id_[id];
+        instances_[slot].color = color;
+        markDirty(slot);
+    }
+
+    void setLayer(InstanceId id, unsigned int layer) {
+        unsigned int slot = slot_of_id_[id];
+        instances_[slot].layer = static_cast<float>(layer);
+        markDirty(slot);
+    }
+
+    unsigned int size() const {
+        return instances_.size();
+    }
+
+    // upload whatever changed since the last draw, then draw all instances
+    void draw() {
+        prepare().draw();
+    }
+
+    // upload whatever changed since the last draw, the returned item draws all instances
+    DrawItem prepare() {
+        if (instances_.empty()) {
+            return DrawItem();
+        }
+        vao_.bind();
+        upload();
+        pointInstanceAttributes(instance_vbo_, 0);
+        return DrawItem(&vao_, N_CUBE_DRAW_VERTICES, instances_.size());
+    }
+
+    // write every instance to this frame's region of stream instead of the instance buffer
+    DrawItem prepare(StreamBuffer& stream) {
+        return streamInstances(stream, false);
+    }
+
+    // per frame visible set, e.g. what survived frustum culling
+    void clearVisible() {
+        visible_.clear();
+    }
+
+    void addVisible(InstanceId id) {
+        visible_.push_back(id);
+    }
+
+    // compact the visible instances into the instance buffer and draw only those
+    void drawVisible() {
+        prepareVisible().draw();
+    }
+
+    // like prepare, but the item only draws the visible instances
+    DrawItem prepareVisible() {
+        if (visible_.empty()) {
+            return DrawItem();
+        }
+        scratch_.resize(visible_.size());
+        for (unsigned int i = 0; i < visible_.size(); i++) {
+            scratch_[i] = instances_[slot_of_id_[visible_[i]]];
+        }
+        vao_.bind();
+        GLState::instance().bindBuffer(GL_ARRAY_BUFFER, instance_vbo_);
+        reserve();
+        glBufferSubData(GL_ARRAY_BUFFER, 0, scratch_.size() * sizeof(InstanceData), &scratch_[0]);
+        // the buffer no longer mirrors instances_, a full draw has to re-upload everything
+        dirty_begin_ = 0;
+        dirty_end_ = instances_.size();
+        pointInstanceAttributes(instance_vbo_, 0);
+        return DrawItem(&vao_, N_CUBE_DRAW_VERTICES, visible_.size());
+    }
+
+    // like prepareVisible, but the visible instances go straight into stream
+    DrawItem prepareVisible(StreamBuffer& stream) {
+        return streamInstances(stream, true);
+    }
+
+    void deallocate() {
+        vao_.deallocate();
+    }
+
+  private:
+    VAO vao_;
+    unsigned int instance_vbo_;
+    unsigned int capacity_;
+    // where the instance attributes currently read from
+    unsigned int attribute_buffer_;
+    unsigned int attribute_offset_;
+
+    std::vector<InstanceData> instances_;
+    std::vector<InstanceId> id_of_slot_;
+    std::vector<unsigned int> slot_of_id_;
+    std::vector<InstanceId> free_ids_;
+    std::vector<InstanceId> visible_;
+    std::vector<InstanceData> scratch_;
+
+    // slots [dirty_begin_, dirty_end_) need to be re-uploaded
+    unsigned int dirty_begin_;
+    unsigned int dirty_end_;
+
+    void markDirty(unsigned int slot) {
+        if (dirty_begin_ == dirty_end_) {
+            dirty_begin_ = slot;
+            dirty_end_ = slot + 1;
+        } else {
+            dirty_begin_ = std::min(dirty_begin_, slot);
+            dirty_end_ = std::max(dirty_end_, slot + 1);
+        }
+    }
+
+    // make room for every instance, the instance buffer must be bound
+    void reserve() {
+        if (instances_.size() > capacity_) {
+            // grow geometrically, the attribute pointers follow the buffer object so they stay valid
+            while (capacity_ < instances_.size()) {
+                capacity_ *= 2;
+            }
+            glBufferData(GL_ARRAY_BUFFER, capacity_ * sizeof(InstanceData), NULL, GL_DYNAMIC_DRAW);
+            dirty_begin_ = 0;
+            dirty_end_ = instances_.size();
+        }
+    }
+
+    // the vao must be bound
+    void pointInstanceAttributes(unsigned int buffer, unsigned int offset) {
+        if (buffer == attribute_buffer_ && offset == attribute_offset_) {
+            return;
+        }
+        GLState::instance().bindBuffer(GL_ARRAY_BUFFER, buffer);
+        const unsigned int start_idx = offset / sizeof(float);
+        for (unsigned int col = 0; col < 4; col++) {
+            vao_.addInstanceAttribute(INSTANCE_MODEL_ATTRIBUTE + col, 4, N_INSTANCE_FLOATS, start_idx + col * 4);
+        }
+        vao_.addInstanceAttribute(INSTANCE_COLOR_ATTRIBUTE, 4, N_INSTANCE_FLOATS, start_idx + 16);
+        vao_.addInstanceAttribute(INSTANCE_LAYER_ATTRIBUTE, 1, N_INSTANCE_FLOATS, start_idx + 20);
+        attribute_buffer_ = buffer;
+        attribute_offset_ = offset;
+    }
+
+    // falls back to the instance buffer when the stream's region is full
+    DrawItem streamInstances(StreamBuffer& stream, bool visible_only) {
+        const unsigned int n_instances = visible_only ? visible_.size() : instances_.size();
+        if (n_instances == 0) {
+            return DrawItem();
+        }
+        StreamBuffer::Allocation allocation = stream.allocate(n_instances * sizeof(InstanceData), sizeof(InstanceData::color));
+        if (!allocation.data) {
+            return visible_only ? prepareVisible() : prepare();
+        }
+        InstanceData* out = static_cast<InstanceData*>(allocation.data);
+        if (visible_only) {
+            for (unsigned int i = 0; i < n_instances; i++) {
+                out[i] = instances_[slot_of_id_[visible_[i]]];
+            }
+        } else {
+            std::memcpy(out, &instances_[0], n_instances * sizeof(InstanceData));
+        }
+        stream.commit(allocation);
+        vao_.bind();
+        pointInstanceAttributes(stream.buffer(), allocation.offset);
+        return DrawItem(&vao_, N_CUBE_DRAW_VERTICES, n_instances);
+    }
+
+    void upload() {
+        GLState::instance().bindBuffer(GL_ARRAY_BUFFER, instance_vbo_);
+        reserve();
+        if (dirty_begin_ < dirty_end_) {
+            glBufferSubData(
+                GL_ARRAY_BUFFER,
+                dirty_begin_ * sizeof(InstanceData),
+                (dirty_end_ - dirty_begin_) * sizeof(InstanceData),
+                &instances_[dirty_begin_]
+            );
+        }
+        dirty_begin_ = dirty_end_ = 0;
+    }
+};
+
+// matching GL formats for an image with n_channels 8 bit channels
+inline void textureFormats(int n_channels, int& internal_format, unsigned int& format) {
+    switch (n_channels) {
+        case 1: internal_format = GL_R8; format = GL_RED; break;
+        case 2: internal_format = GL_RG8; format = GL_RG; break;
+        case 4: internal_format = GL_RGBA8; format = GL_RGBA; break;
+        default: internal_format = GL_RGB8; format = GL_RGB; break;
+    }
+}
+
 class Texture {
   public:
     struct Param {
         int param;
         int value;
     };
-    
+
+    // empty texture, give it an image with setImage
     Texture(
         unsigned int type,
-        const std::vector<Param>& params,
-        const std::string& image_path,
-        bool transparent
+        const std::vector<Param>& params
     ): type_(type) {
 
         // init texture
         glGenTextures(1, &id_);
-        glBindTexture(type, id_);
+        GLState::instance().bindTexture(type, id_);
 
         // set params
         for (Param param : params) {
             glTexParameteri(type, param.param, param.value);
         }
+    }
+    
+    Texture(
+        unsigned int type,
+        const std::vector<Param>& params,
+        const std::string& image_path
+    ): Texture(type, params) {
 
         // load image, create texture, generate mipmaps
         int width, height, nrChannels;
@@ -265,8 +662,7 @@ class Texture {
         unsigned char* data = stbi_load(image_path.c_str(), &width, &height, &nrChannels, 0);
         if (data)
         {
-            glTexImage2D(type, 0, GL_RGB, width, height, 0, (transparent) ? GL_RGBA : GL_RGB, GL_UNSIGNED_BYTE, data);
-            glGenerateMipmap(type);
+            setImage(width, height, nrChannels, data);
         }
         else
         {
@@ -276,9 +672,19 @@ class Texture {
 
     }
 
+    // upload a whole image at once and generate mipmaps, format follows the channel count
+    void setImage(int width, int height, int n_channels, const unsigned char* data) {
+        int internal_format;
+        unsigned int format;
+        textureFormats(n_channels, internal_format, format);
+        GLState::instance().bindTexture(type_, id_);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // rows of 1 and 3 channel images aren't 4 byte aligned
+        glTexImage2D(type_, 0, internal_format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+        glGenerateMipmap(type_);
+    }
+
     void activeBindTexture(int tx) {
-        glActiveTexture(tx);
-        glBindTexture(type_, id_);
+        GLState::instance().bindTextureUnit(tx, type_, id_);
     }
 
     unsigned int type() {
@@ -289,6 +695,11 @@ class Texture {
         return id_;
     }
 
+    void deallocate() {
+        glDeleteTextures(1, &id_);
+        GLState::instance().forgetTexture(id_);
+    }
+
   private:
     unsigned int type_;
     unsigned int id_;
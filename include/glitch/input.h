@@ -0,0 +1,216 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+namespace input {
+
+// Fixed size ring for one producer thread and one consumer thread, no locks.
+// Capacity must be a power of two.
+template<typename T, unsigned int Capacity>
+class SpscQueue {
+  public:
+    SpscQueue(): head_(0), tail_(0) {}
+
+    // producer side, false when full
+    bool push(const T& value) {
+        const unsigned int tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+        items_[tail & (Capacity - 1)] = value;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side
+    bool empty() const {
+        return head_.load(std::memory_order_relaxed) == tail_.load(std::memory_order_acquire);
+    }
+
+    const T& front() const {
+        return items_[head_.load(std::memory_order_relaxed) & (Capacity - 1)];
+    }
+
+    void pop() {
+        head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // calls f(item) for every queued item without consuming them
+    template<typename F>
+    void peek(F f) const {
+        const unsigned int tail = tail_.load(std::memory_order_acquire);
+        for (unsigned int i = head_.load(std::memory_order_relaxed); i != tail; i++) {
+            f(items_[i & (Capacity - 1)]);
+        }
+    }
+
+  private:
+    T items_[Capacity];
+    std::atomic<unsigned int> head_;
+    std::atomic<unsigned int> tail_;
+};
+
+struct Event {
+    enum class Type {
+        MouseMove,
+        Key
+    };
+
+    Type type;
+    double time; // seconds, same clock as the frame and tick times
+    float x;
+    float y;
+    int key;
+    int action; // 1 press, 0 release, anything else (repeat) is ignored
+
+    static Event mouseMove(double time, float x, float y) {
+        return Event { Type::MouseMove, time, x, y, 0, 0 };
+    }
+
+    static Event keyEvent(double time, int key, int action) {
+        return Event { Type::Key, time, 0.0f, 0.0f, key, action };
+    }
+};
+
+// Input as one simulation tick sees it: which keys are held, which went
+// down during the tick and how far the mouse moved since the previous tick
+class State {
+  public:
+    static const int N_KEYS = 512;
+
+    State(): mouse_delta_(0.0f) {
+        std::fill(held_, held_ + N_KEYS, false);
+        std::fill(pressed_, pressed_ + N_KEYS, false);
+    }
+
+    bool held(int key) const {
+        return key >= 0 && key < N_KEYS && held_[key];
+    }
+
+    bool pressed(int key) const {
+        return key >= 0 && key < N_KEYS && pressed_[key];
+    }
+
+    glm::vec2 mouseDelta() const {
+        return mouse_delta_;
+    }
+
+  private:
+    friend class Queue;
+
+    bool held_[N_KEYS];
+    bool pressed_[N_KEYS];
+    glm::vec2 mouse_delta_;
+};
+
+// Timestamped input events from the window callbacks. Each simulation tick
+// takes the events that happened before it and folds them into a State, so
+// a tick sees one summed mouse delta instead of one turn per cursor event.
+// Events not consumed by any tick yet can still be peeked at to latch the
+// camera as late as possible.
+class Queue {
+  public:
+    Queue():
+        has_mouse_(false),
+        last_mouse_(0.0f),
+        n_dropped_(0)
+    {}
+
+    void push(const Event& event) {
+        if (!events_.push(event)) {
+            n_dropped_++;
+        }
+    }
+
+    // consume every event up to time into state
+    void coalesce(double time, State& state) {
+        state.mouse_delta_ = glm::vec2(0.0f);
+        std::fill(state.pressed_, state.pressed_ + State::N_KEYS, false);
+        while (!events_.empty() && events_.front().time <= time) {
+            const Event& event = events_.front();
+            if (event.type == Event::Type::MouseMove) {
+                state.mouse_delta_ += mouseDelta(event);
+                last_mouse_ = glm::vec2(event.x, event.y);
+                has_mouse_ = true;
+            } else if (event.key >= 0 && event.key < State::N_KEYS && (event.action == 0 || event.action == 1)) {
+                state.held_[event.key] = event.action == 1;
+                state.pressed_[event.key] = state.pressed_[event.key] || event.action == 1;
+            }
+            events_.pop();
+        }
+    }
+
+    // mouse movement no tick has consumed yet
+    glm::vec2 pendingMouseDelta() const {
+        glm::vec2 delta(0.0f);
+        glm::vec2 last = last_mouse_;
+        bool has_mouse = has_mouse_;
+        events_.peek([&](const Event& event) {
+            if (event.type == Event::Type::MouseMove) {
+                if (has_mouse) {
+                    delta += glm::vec2(event.x - last.x, last.y - event.y);
+                }
+                last = glm::vec2(event.x, event.y);
+                has_mouse = true;
+            }
+        });
+        return delta;
+    }
+
+    unsigned int droppedEvents() const {
+        return n_dropped_;
+    }
+
+  private:
+    SpscQueue<Event, 1024> events_;
+    bool has_mouse_;
+    glm::vec2 last_mouse_;
+    unsigned int n_dropped_;
+
+    // y is reversed since window coordinates go from top to bottom
+    glm::vec2 mouseDelta(const Event& event) const {
+        if (!has_mouse_) {
+            return glm::vec2(0.0f);
+        }
+        return glm::vec2(event.x - last_mouse_.x, last_mouse_.y - event.y);
+    }
+};
+
+// Input to swap latency samples, in milliseconds
+class LatencyStats {
+  public:
+    void record(double ms) {
+        samples_.push_back(ms);
+    }
+
+    unsigned int size() const {
+        return samples_.size();
+    }
+
+    // p in [0, 1]
+    double percentile(double p) const {
+        if (samples_.empty()) {
+            return 0.0;
+        }
+        std::vector<double> sorted = samples_;
+        std::sort(sorted.begin(), sorted.end());
+        unsigned int index = std::min<unsigned int>(sorted.size() - 1, static_cast<unsigned int>(p * sorted.size()));
+        return sorted[index];
+    }
+
+    void clear() {
+        samples_.clear();
+    }
+
+  private:
+    std::vector<double> samples_;
+};
+
+}
+
+#endif
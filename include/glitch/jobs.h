@@ -0,0 +1,325 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <cstdint>
+
+namespace jobs {
+
+struct Job;
+
+// Counts unfinished jobs. Waiting on a counter runs other jobs meanwhile,
+// and jobs queued with runAfter start once it drops to zero.
+class Counter {
+  public:
+    Counter(): value_(0) {}
+
+    bool done() const {
+        return value_.load() == 0;
+    }
+
+  private:
+    friend class Scheduler;
+
+    std::atomic<int> value_;
+    std::mutex mutex_;
+    std::vector<Job*> waiting_;
+};
+
+struct Job {
+    std::function<void()> function;
+    Counter* counter; // decremented once function returns, may be NULL
+};
+
+// Chase-Lev deque of a fixed capacity (Le et al. 2013, "Correct and
+// Efficient Work-Stealing for Weak Memory Models"). The owning worker pushes
+// and pops at the bottom, newest first while the data is still in its cache,
+// other workers steal the oldest from the top.
+class Deque {
+  public:
+    static const int64_t CAPACITY = 4096;
+
+    Deque():
+        top_(0),
+        bottom_(0)
+    {
+        for (std::atomic<Job*>& job : jobs_) {
+            job.store(NULL, std::memory_order_relaxed);
+        }
+    }
+
+    // owner only, false when full
+    bool push(Job* job) {
+        const int64_t bottom = bottom_.load(std::memory_order_relaxed);
+        const int64_t top = top_.load(std::memory_order_acquire);
+        if (bottom - top >= CAPACITY) {
+            return false;
+        }
+        jobs_[bottom & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(bottom + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // owner only, NULL when empty
+    Job* pop() {
+        const int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+        bottom_.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = top_.load(std::memory_order_relaxed);
+        if (top > bottom) {
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+            return NULL;
+        }
+        Job* job = jobs_[bottom & (CAPACITY - 1)].load(std::memory_order_relaxed);
+        if (top == bottom) {
+            // the last one, thieves may be racing for it
+            if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                job = NULL;
+            }
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+
+    // any thread, NULL when empty or another thread got there first
+    Job* steal() {
+        int64_t top = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t bottom = bottom_.load(std::memory_order_acquire);
+        if (top >= bottom) {
+            return NULL;
+        }
+        Job* job = jobs_[top & (CAPACITY - 1)].load(std::memory_order_relaxed);
+        if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return NULL;
+        }
+        return job;
+    }
+
+  private:
+    // top and bottom on their own cache lines, thieves hammer top
+    std::atomic<int64_t> top_;
+    char top_padding_[64 - sizeof(std::atomic<int64_t>)];
+    std::atomic<int64_t> bottom_;
+    char bottom_padding_[64 - sizeof(std::atomic<int64_t>)];
+    std::atomic<Job*> jobs_[CAPACITY];
+};
+
+// index of the calling thread in its scheduler, NOT_A_WORKER outside one
+const unsigned int NOT_A_WORKER = 0xffffffffu;
+
+inline unsigned int& currentWorker() {
+    static thread_local unsigned int worker = NOT_A_WORKER;
+    return worker;
+}
+
+// Work-stealing job scheduler. The thread that creates it is worker 0 and
+// only runs jobs while it waits, so it keeps the GL context and everything
+// else that has to stay on the main thread; jobs must not touch GL. The
+// other workers each own a deque, run their own jobs newest first and steal
+// the oldest job of a random other worker when theirs is empty, sleeping
+// once there is nothing left anywhere.
+//
+// Jobs are submitted from worker threads (the main thread or inside jobs).
+class Scheduler {
+  public:
+    // n_threads counts the calling thread
+    explicit Scheduler(unsigned int n_threads = std::thread::hardware_concurrency()):
+        n_threads_(std::max(n_threads, 1u)),
+        pending_(0),
+        n_sleeping_(0),
+        stopping_(false)
+    {
+        for (unsigned int i = 0; i < n_threads_; i++) {
+            deques_.push_back(std::unique_ptr<Deque>(new Deque()));
+            random_.push_back(0x9e3779b9u * (i + 1));
+        }
+        currentWorker() = 0;
+        for (unsigned int i = 1; i < n_threads_; i++) {
+            threads_.push_back(std::thread(&Scheduler::work, this, i));
+        }
+    }
+
+    ~Scheduler() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread& thread : threads_) {
+            thread.join();
+        }
+        currentWorker() = NOT_A_WORKER;
+    }
+
+    unsigned int threadCount() const {
+        return n_threads_;
+    }
+
+    // counter, if any, counts the job until it has run
+    void run(std::function<void()> function, Counter* counter = NULL) {
+        submit(allocate(function, counter));
+    }
+
+    // queue the job once dependency reaches zero, right away if it already has
+    void runAfter(Counter& dependency, std::function<void()> function, Counter* counter = NULL) {
+        Job* job = allocate(function, counter);
+        {
+            std::lock_guard<std::mutex> lock(dependency.mutex_);
+            if (!dependency.done()) {
+                dependency.waiting_.push_back(job);
+                return;
+            }
+        }
+        submit(job);
+    }
+
+    // run jobs until counter reaches zero
+    void wait(Counter& counter) {
+        const unsigned int worker = currentWorker();
+        unsigned int n_idle = 0;
+        while (!counter.done()) {
+            Job* job = findJob(worker);
+            if (job) {
+                execute(job);
+                n_idle = 0;
+            } else if (++n_idle > 64) {
+                std::this_thread::yield();
+            }
+        }
+        // the last job may still hold the lock, the counter can go once it's released
+        std::lock_guard<std::mutex> lock(counter.mutex_);
+    }
+
+    // f(chunk_begin, chunk_end) over [begin, end) in chunks of about grain
+    // items, returns once every chunk ran. the caller runs chunks too
+    template<typename F>
+    void parallelFor(unsigned int begin, unsigned int end, unsigned int grain, F f) {
+        if (begin >= end) {
+            return;
+        }
+        grain = std::max(grain, 1u);
+        Counter counter;
+        for (unsigned int chunk = begin; chunk < end; chunk += grain) {
+            const unsigned int chunk_end = std::min(end, chunk + grain);
+            run([chunk, chunk_end, &f]() { f(chunk, chunk_end); }, &counter);
+        }
+        wait(counter);
+    }
+
+  private:
+    unsigned int n_threads_;
+    std::vector<std::unique_ptr<Deque>> deques_;
+    std::vector<uint32_t> random_; // per worker, picks steal victims
+    std::vector<std::thread> threads_;
+
+    // jobs sitting in deques, workers sleep while it's zero
+    std::atomic<int> pending_;
+    std::atomic<int> n_sleeping_;
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    bool stopping_;
+
+    Job* allocate(const std::function<void()>& function, Counter* counter) {
+        if (counter) {
+            counter->value_++;
+        }
+        return new Job { function, counter };
+    }
+
+    void submit(Job* job) {
+        const unsigned int worker = currentWorker();
+        if (!deques_[worker]->push(job)) {
+            // deque full, no point queueing more
+            execute(job);
+            return;
+        }
+        pending_++;
+        if (n_sleeping_.load() > 0) {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            wake_.notify_one();
+        }
+    }
+
+    void execute(Job* job) {
+        job->function();
+        Counter* counter = job->counter;
+        delete job;
+        if (!counter) {
+            return;
+        }
+        // under the lock so runAfter can't queue behind a counter that just
+        // finished, and so wait() can't return and free the counter before
+        // we're done with it
+        std::vector<Job*> ready;
+        {
+            std::lock_guard<std::mutex> lock(counter->mutex_);
+            if (--counter->value_ == 0) {
+                ready.swap(counter->waiting_);
+            }
+        }
+        for (Job* waiting : ready) {
+            submit(waiting);
+        }
+    }
+
+    Job* findJob(unsigned int worker) {
+        Job* job = deques_[worker]->pop();
+        if (!job && n_threads_ > 1) {
+            // xorshift, start at a random victim so thieves spread out
+            uint32_t& random = random_[worker];
+            random ^= random << 13;
+            random ^= random >> 17;
+            random ^= random << 5;
+            const unsigned int first = random % n_threads_;
+            for (unsigned int i = 0; i < n_threads_ && !job; i++) {
+                const unsigned int victim = (first + i) % n_threads_;
+                if (victim != worker) {
+                    job = deques_[victim]->steal();
+                }
+            }
+        }
+        if (job) {
+            pending_--;
+        }
+        return job;
+    }
+
+    void work(unsigned int worker) {
+        currentWorker() = worker;
+        unsigned int n_idle = 0;
+        while (true) {
+            Job* job = findJob(worker);
+            if (job) {
+                execute(job);
+                n_idle = 0;
+                continue;
+            }
+            // spin a little, a frame's jobs tend to come in bursts
+            if (++n_idle < 64) {
+                std::this_thread::yield();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            n_sleeping_++;
+            wake_.wait(lock, [this]() { return stopping_ || pending_.load() > 0; });
+            n_sleeping_--;
+            if (stopping_) {
+                return;
+            }
+            n_idle = 0;
+        }
+    }
+};
+
+}
+
+#endif
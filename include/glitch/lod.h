@@ -0,0 +1,172 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+namespace gfx {
+
+// levels of detail, finest first
+const unsigned int LOD_FULL = 0; // the real mesh
+const unsigned int LOD_PROXY = 1; // a merged, coarser mesh
+const unsigned int LOD_IMPOSTOR = 2; // a camera facing billboard
+const unsigned int N_LODS = 3;
+
+struct LodSettings {
+    // projected diameter, in pixels, below which an object drops from
+    // LOD_FULL to LOD_PROXY and from LOD_PROXY to LOD_IMPOSTOR
+    float min_pixels[N_LODS - 1];
+    // fraction either side of a threshold where an object keeps its level,
+    // so one sitting on the boundary doesn't switch back and forth
+    float hysteresis;
+    // how long a switch cross-fades, 0 switches at once
+    float fade_seconds;
+    // nothing further than this is drawn at all
+    float view_distance;
+};
+
+// what an object is drawn with. while fade < 1 it is switching from
+// previous to level and both are drawn, see LodSelector::fade()
+struct LodState {
+    uint8_t level;
+    uint8_t previous;
+    float fade;
+
+    // N_LODS = not on screen, the next selection snaps without a fade
+    LodState(): level(N_LODS), previous(N_LODS), fade(1.0f) {}
+
+    bool fading() const {
+        return fade < 1.0f && previous < N_LODS;
+    }
+};
+
+struct LodStats {
+    unsigned int n_objects[N_LODS];
+    unsigned int n_draws[N_LODS];
+    unsigned int n_triangles[N_LODS];
+    unsigned int n_fading;
+    unsigned int n_culled; // outside the frustum or the view distance
+};
+
+// Picks a level per object from its bounding sphere's projected size, and
+// counts what gets drawn at each level over a frame.
+class LodSelector {
+  public:
+    explicit LodSelector(const LodSettings& settings):
+        settings_(settings),
+        eye_(0.0f),
+        pixels_per_unit_(1.0f),
+        dt_(0.0f)
+    {
+        resetStats();
+    }
+
+    // once per frame, before any select(). fov_y in radians, dt in seconds
+    void begin(glm::vec3 eye, float fov_y, float viewport_height, float dt) {
+        eye_ = eye;
+        // pixels covered by one unit at distance one
+        pixels_per_unit_ = viewport_height / (2.0f * std::tan(0.5f * fov_y));
+        dt_ = dt;
+        resetStats();
+    }
+
+    // update an object's state for this frame. false when it's past the
+    // view distance and shouldn't be drawn
+    bool select(LodState& state, glm::vec3 center, float radius) {
+        const float distance = glm::distance(eye_, center);
+        if (distance - radius > settings_.view_distance) {
+            hide(state);
+            return false;
+        }
+        const unsigned int level = pick(projectedPixels(distance, radius), state.level);
+        if (state.level == N_LODS) {
+            state.level = state.previous = level;
+            state.fade = 1.0f;
+        } else if (level != state.level) {
+            // whatever was fading out is dropped, the fade restarts from the level on screen
+            state.previous = state.level;
+            state.level = level;
+            state.fade = 0.0f;
+        }
+        if (state.fade < 1.0f) {
+            state.fade = (settings_.fade_seconds > 0.0f) ? std::min(state.fade + dt_ / settings_.fade_seconds, 1.0f) : 1.0f;
+        }
+        stats_.n_objects[state.level]++;
+        stats_.n_fading += state.fading();
+        return true;
+    }
+
+    // for objects culled before select(), so they snap to the right level
+    // instead of finishing an old fade when they're back in view
+    void hide(LodState& state) {
+        state.level = state.previous = N_LODS;
+        state.fade = 1.0f;
+        stats_.n_culled++;
+    }
+
+    // the fade uniform of f_dithered_color.glsl: 1 draws every pixel,
+    // [0, 1) the incoming level's share of a dither pattern and [-1, 0)
+    // the outgoing level's, so the two together cover each pixel once
+    static float fade(const LodState& state, bool outgoing) {
+        if (!state.fading()) {
+            return 1.0f;
+        }
+        return outgoing ? state.fade - 1.0f : state.fade;
+    }
+
+    void countDraw(unsigned int level, unsigned int n_triangles) {
+        stats_.n_draws[level]++;
+        stats_.n_triangles[level] += n_triangles;
+    }
+
+    // since the last begin()
+    const LodStats& stats() const {
+        return stats_;
+    }
+
+    const LodSettings& settings() const {
+        return settings_;
+    }
+
+  private:
+    LodSettings settings_;
+    glm::vec3 eye_;
+    float pixels_per_unit_;
+    float dt_;
+    LodStats stats_;
+
+    float projectedPixels(float distance, float radius) const {
+        // from inside the sphere it covers the screen
+        return 2.0f * radius * pixels_per_unit_ / std::max(distance, radius);
+    }
+
+    // the threshold moves away from the current level, so changing back
+    // needs the size to cross the whole hysteresis band first
+    unsigned int pick(float pixels, unsigned int current) const {
+        unsigned int level = 0;
+        for (; level < N_LODS - 1; level++) {
+            float threshold = settings_.min_pixels[level];
+            if (current != N_LODS) {
+                threshold *= (current <= level) ? 1.0f - settings_.hysteresis : 1.0f + settings_.hysteresis;
+            }
+            if (pixels >= threshold) {
+                break;
+            }
+        }
+        return level;
+    }
+
+    void resetStats() {
+        for (unsigned int level = 0; level < N_LODS; level++) {
+            stats_.n_objects[level] = stats_.n_draws[level] = stats_.n_triangles[level] = 0;
+        }
+        stats_.n_fading = stats_.n_culled = 0;
+    }
+};
+
+}
+
+#endif
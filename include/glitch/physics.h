@@ -0,0 +1,174 @@
+#ifndef PHYSICS_H
+#define PHYSICS_H
+
+#include <vector>
+#include <memory>
+#include <chrono>
+
+#include <glm/glm.hpp>
+
+#include <btBulletDynamicsCommon.h>
+#include <BulletCollision/CollisionDispatch/btGhostObject.h>
+#include <BulletDynamics/Character/btKinematicCharacterController.h>
+#ifdef GLITCH_PHYSICS_MT
+#include <LinearMath/btThreads.h>
+#include <BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h>
+#include <BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolverMt.h>
+#include <BulletDynamics/Dynamics/btDiscreteDynamicsWorldMt.h>
+#endif
+
+#include <glitch/graphics.h>
+
+namespace phys {
+
+inline btVector3 toBt(glm::vec3 v) {
+    return btVector3(v.x, v.y, v.z);
+}
+
+inline glm::vec3 toGlm(const btVector3& v) {
+    return glm::vec3(v.x(), v.y(), v.z());
+}
+
+struct Stats {
+    double step_ms; // wall time of the last step
+    int n_overlapping_pairs; // broadphase pairs after the last step
+    int n_collision_objects;
+};
+
+// Bullet world mirroring the blocks as static box colliders and the player
+// as a kinematic character controller. Build with GLITCH_PHYSICS_MT (and a
+// multithreaded bullet3) to step through btDiscreteDynamicsWorldMt.
+class PhysicsWorld {
+  public:
+    PhysicsWorld():
+        config_(new btDefaultCollisionConfiguration()),
+        broadphase_(new btDbvtBroadphase()),
+        ghost_pair_callback_(new btGhostPairCallback())
+    {
+#ifdef GLITCH_PHYSICS_MT
+        btITaskScheduler* scheduler = btCreateDefaultTaskScheduler();
+        if (scheduler != NULL) {
+            btSetTaskScheduler(scheduler);
+        }
+        dispatcher_.reset(new btCollisionDispatcherMt(config_.get()));
+        solver_pool_.reset(new btConstraintSolverPoolMt(BT_MAX_THREAD_COUNT));
+        solver_.reset(new btSequentialImpulseConstraintSolverMt());
+        world_.reset(new btDiscreteDynamicsWorldMt(
+            dispatcher_.get(), broadphase_.get(), solver_pool_.get(), solver_.get(), config_.get()
+        ));
+#else
+        dispatcher_.reset(new btCollisionDispatcher(config_.get()));
+        solver_.reset(new btSequentialImpulseConstraintSolver());
+        world_.reset(new btDiscreteDynamicsWorld(
+            dispatcher_.get(), broadphase_.get(), solver_.get(), config_.get()
+        ));
+#endif
+        // lets the character's ghost object track what it overlaps
+        broadphase_->getOverlappingPairCache()->setInternalGhostPairCallback(ghost_pair_callback_.get());
+        stats_.step_ms = 0.0;
+        stats_.n_overlapping_pairs = 0;
+        stats_.n_collision_objects = 0;
+    }
+
+    ~PhysicsWorld() {
+        if (character_) {
+            world_->removeAction(character_.get());
+            world_->removeCollisionObject(ghost_.get());
+        }
+        for (std::unique_ptr<btCollisionObject>& object : static_objects_) {
+            world_->removeCollisionObject(object.get());
+        }
+    }
+
+    // blocks never move, so they are plain collision objects instead of rigid bodies
+    void addStaticBlock(const gfx::Block& block) {
+        btBoxShape* shape = new btBoxShape(toBt(0.5f * block.size()));
+        shapes_.push_back(std::unique_ptr<btCollisionShape>(shape));
+
+        btTransform transform;
+        transform.setIdentity();
+        // blocks are positioned by their min corner, bullet boxes by their center
+        transform.setOrigin(toBt(block.position() + 0.5f * block.size()));
+
+        btCollisionObject* object = new btCollisionObject();
+        object->setCollisionShape(shape);
+        object->setWorldTransform(transform);
+        object->setCollisionFlags(object->getCollisionFlags() | btCollisionObject::CF_STATIC_OBJECT);
+        static_objects_.push_back(std::unique_ptr<btCollisionObject>(object));
+        world_->addCollisionObject(
+            object,
+            btBroadphaseProxy::StaticFilter,
+            btBroadphaseProxy::AllFilter ^ btBroadphaseProxy::StaticFilter
+        );
+    }
+
+    // position is the center of the hurtbox
+    void addCharacter(glm::vec3 position, glm::vec3 hurtbox_size, float step_height = 0.2f) {
+        btBoxShape* shape = new btBoxShape(toBt(0.5f * hurtbox_size));
+        shapes_.push_back(std::unique_ptr<btCollisionShape>(shape));
+
+        btTransform transform;
+        transform.setIdentity();
+        transform.setOrigin(toBt(position));
+
+        ghost_.reset(new btPairCachingGhostObject());
+        ghost_->setWorldTransform(transform);
+        ghost_->setCollisionShape(shape);
+        ghost_->setCollisionFlags(btCollisionObject::CF_CHARACTER_OBJECT);
+
+        character_.reset(new btKinematicCharacterController(ghost_.get(), shape, step_height, btVector3(0.0f, 1.0f, 0.0f)));
+        world_->addCollisionObject(
+            ghost_.get(),
+            btBroadphaseProxy::CharacterFilter,
+            btBroadphaseProxy::StaticFilter | btBroadphaseProxy::DefaultFilter
+        );
+        world_->addAction(character_.get());
+    }
+
+    // displacement applied to the character on every following step
+    void setCharacterWalk(glm::vec3 displacement) {
+        character_->setWalkDirection(toBt(displacement));
+    }
+
+    glm::vec3 characterPosition() const {
+        return toGlm(ghost_->getWorldTransform().getOrigin());
+    }
+
+    // advance exactly one step of dt, the caller owns the fixed timestep
+    void step(float dt) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        world_->stepSimulation(dt, 1, dt);
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+        stats_.step_ms = std::chrono::duration<double, std::milli>(end - start).count();
+        stats_.n_overlapping_pairs = broadphase_->getOverlappingPairCache()->getNumOverlappingPairs();
+        stats_.n_collision_objects = world_->getNumCollisionObjects();
+    }
+
+    Stats stats() const {
+        return stats_;
+    }
+
+  private:
+    // declared in construction order so they are destroyed in reverse
+    std::unique_ptr<btDefaultCollisionConfiguration> config_;
+    std::unique_ptr<btBroadphaseInterface> broadphase_;
+    std::unique_ptr<btGhostPairCallback> ghost_pair_callback_;
+    std::unique_ptr<btCollisionDispatcher> dispatcher_;
+#ifdef GLITCH_PHYSICS_MT
+    std::unique_ptr<btConstraintSolverPoolMt> solver_pool_;
+#endif
+    std::unique_ptr<btConstraintSolver> solver_;
+    std::unique_ptr<btDiscreteDynamicsWorld> world_;
+
+    std::vector<std::unique_ptr<btCollisionShape>> shapes_;
+    std::vector<std::unique_ptr<btCollisionObject>> static_objects_;
+    std::unique_ptr<btPairCachingGhostObject> ghost_;
+    std::unique_ptr<btKinematicCharacterController> character_;
+
+    Stats stats_;
+};
+
+}
+
+#endif
@@ -9,6 +9,13 @@
 class Player {
   public:
 
+    // what a rollback snapshot keeps, the direction vectors follow from yaw and pitch
+    struct State {
+        glm::vec3 position;
+        float yaw;
+        float pitch;
+    };
+
     // Player(glm::vec3 front, glm::vec3 position, glm::vec3 hurtbox_size):
     //     front_(front), position_(position), hurtbox_size_(hurtbox_size), yaw_(-glm::pi<float>() / 2)
     // {}
@@ -19,6 +26,10 @@ class Player {
         turn(yaw, pitch);
     }
 
+    State state() const {
+        return State { position_, yaw_, pitch_ };
+    }
+
     glm::vec3 position() const {
         return position_;
     }
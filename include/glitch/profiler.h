@@ -0,0 +1,302 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+#include <glad/glad.h>
+
+namespace prof {
+
+// Frame profiler for the render thread. CPU scopes are timed with a steady
+// clock, GPU scopes with GL_TIME_ELAPSED queries that are read back two
+// frames later so the CPU never waits on them. A range of frames can be
+// captured to a Chrome trace (chrome://tracing or ui.perfetto.dev).
+// Not thread safe, only the thread owning the GL context should use it.
+class Profiler {
+  public:
+    // per stage timings averaged since the last reset
+    struct Stage {
+        const char* name;
+        double cpu_ms;
+        double gpu_ms;
+        unsigned int cpu_count;
+        unsigned int gpu_count;
+    };
+
+    static Profiler& instance() {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    void beginFrame() {
+        frame_++;
+        frame_start_us_ = now();
+        resolveGpu(slots_[frame_ % N_GPU_SLOTS]);
+        n_frames_++;
+        if (capture_end_ != 0 && frame_ >= capture_end_ + N_GPU_SLOTS - 1) {
+            writeTrace();
+        }
+    }
+
+    void endFrame() {
+        addCpu("frame", frame_start_us_, now() - frame_start_us_);
+    }
+
+    void beginCpu(const char* name) {
+        cpu_stack_.push_back(OpenScope { name, now() });
+    }
+
+    void endCpu() {
+        OpenScope scope = cpu_stack_.back();
+        cpu_stack_.pop_back();
+        addCpu(scope.name, scope.start_us, now() - scope.start_us);
+    }
+
+    // time elapsed queries can't nest, an inner gpu scope is ignored and
+    // beginGpu returns false so the caller knows not to end it
+    bool beginGpu(const char* name) {
+        if (gpu_open_) {
+            return false;
+        }
+        GpuSlot& slot = slots_[frame_ % N_GPU_SLOTS];
+        if (slot.used == slot.queries.size()) {
+            unsigned int query;
+            glGenQueries(1, &query);
+            slot.queries.push_back(query);
+        }
+        slot.events.push_back(GpuEvent { name, now() });
+        glBeginQuery(GL_TIME_ELAPSED, slot.queries[slot.used++]);
+        gpu_open_ = true;
+        return true;
+    }
+
+    void endGpu() {
+        glEndQuery(GL_TIME_ELAPSED);
+        gpu_open_ = false;
+    }
+
+    // record the next n_frames frames and write them to path once their
+    // gpu timings are in
+    void capture(unsigned int n_frames, const std::string& path) {
+        trace_.clear();
+        trace_path_ = path;
+        capture_start_ = frame_ + 1;
+        capture_end_ = capture_start_ + n_frames;
+    }
+
+    bool capturing() const {
+        return capture_end_ != 0;
+    }
+
+    const std::vector<Stage>& stages() const {
+        return stages_;
+    }
+
+    unsigned int framesSinceReset() const {
+        return n_frames_;
+    }
+
+    void reset() {
+        stages_.clear();
+        n_frames_ = 0;
+    }
+
+    // average time per frame of every stage since the last reset
+    void printStages(std::ostream& out) const {
+        out << "profile over " << n_frames_ << " frames (ms per frame, cpu / gpu)" << std::endl;
+        const unsigned int frames = std::max(n_frames_, 1u);
+        for (const Stage& stage : stages_) {
+            out << "  " << std::left << std::setw(12) << stage.name << std::right << std::fixed << std::setprecision(3)
+                << std::setw(9) << stage.cpu_ms / frames;
+            if (stage.gpu_count > 0) {
+                out << " / " << stage.gpu_ms / frames;
+            }
+            out << std::endl;
+        }
+    }
+
+    void deallocate() {
+        for (GpuSlot& slot : slots_) {
+            if (!slot.queries.empty()) {
+                glDeleteQueries(slot.queries.size(), slot.queries.data());
+            }
+            slot.queries.clear();
+            slot.events.clear();
+            slot.used = 0;
+        }
+    }
+
+  private:
+    static const unsigned int N_GPU_SLOTS = 2;
+
+    struct OpenScope {
+        const char* name;
+        double start_us;
+    };
+
+    struct GpuEvent {
+        const char* name;
+        double issue_us;
+    };
+
+    // the queries issued during one frame
+    struct GpuSlot {
+        std::vector<unsigned int> queries;
+        std::vector<GpuEvent> events;
+        unsigned int used = 0;
+        unsigned long long frame = 0;
+    };
+
+    struct TraceEvent {
+        const char* name;
+        double start_us;
+        double duration_us;
+        bool gpu;
+    };
+
+    Profiler():
+        epoch_(std::chrono::steady_clock::now()),
+        frame_(0),
+        frame_start_us_(0.0),
+        gpu_open_(false),
+        n_frames_(0),
+        capture_start_(0),
+        capture_end_(0)
+    {}
+
+    double now() const {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epoch_).count();
+    }
+
+    Stage& stage(const char* name) {
+        for (Stage& stage : stages_) {
+            if (stage.name == name || std::strcmp(stage.name, name) == 0) {
+                return stage;
+            }
+        }
+        stages_.push_back(Stage { name, 0.0, 0.0, 0, 0 });
+        return stages_.back();
+    }
+
+    bool inCapture(unsigned long long frame) const {
+        return capture_end_ != 0 && frame >= capture_start_ && frame < capture_end_;
+    }
+
+    void addCpu(const char* name, double start_us, double duration_us) {
+        Stage& s = stage(name);
+        s.cpu_ms += duration_us / 1000.0;
+        s.cpu_count++;
+        if (inCapture(frame_)) {
+            trace_.push_back(TraceEvent { name, start_us, duration_us, false });
+        }
+    }
+
+    // read back the queries a slot issued N_GPU_SLOTS frames ago, then reuse it.
+    // results that still aren't available are dropped rather than waited on
+    void resolveGpu(GpuSlot& slot) {
+        if (slot.used > 0) {
+            GLint available = 0;
+            glGetQueryObjectiv(slot.queries[slot.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+            // gpu work of one frame runs back to back, lay the spans out in
+            // issue order on their own track
+            double gpu_end_us = 0.0;
+            for (unsigned int i = 0; available && i < slot.used; i++) {
+                GLuint64 ns = 0;
+                glGetQueryObjectui64v(slot.queries[i], GL_QUERY_RESULT, &ns);
+                const double duration_us = ns / 1000.0;
+                Stage& s = stage(slot.events[i].name);
+                s.gpu_ms += duration_us / 1000.0;
+                s.gpu_count++;
+                if (inCapture(slot.frame)) {
+                    const double start_us = std::max(slot.events[i].issue_us, gpu_end_us);
+                    trace_.push_back(TraceEvent { slot.events[i].name, start_us, duration_us, true });
+                    gpu_end_us = start_us + duration_us;
+                }
+            }
+        }
+        slot.used = 0;
+        slot.events.clear();
+        slot.frame = frame_;
+    }
+
+    // chrome trace event format, complete ("X") events in microseconds
+    void writeTrace() {
+        std::ofstream file(trace_path_.c_str());
+        file << std::fixed << std::setprecision(3) << "{\"traceEvents\":[" << std::endl;
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"cpu\"}}," << std::endl;
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":1,\"args\":{\"name\":\"gpu\"}}";
+        for (const TraceEvent& event : trace_) {
+            file << "," << std::endl
+                 << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << (event.gpu ? 1 : 0)
+                 << ",\"ts\":" << event.start_us << ",\"dur\":" << event.duration_us << "}";
+        }
+        file << std::endl << "]}" << std::endl;
+        std::cout << "profiler: wrote " << (capture_end_ - capture_start_) << " frames to " << trace_path_ << std::endl;
+        trace_.clear();
+        capture_end_ = 0;
+    }
+
+    std::chrono::steady_clock::time_point epoch_;
+    unsigned long long frame_;
+    double frame_start_us_;
+    std::vector<OpenScope> cpu_stack_;
+    GpuSlot slots_[N_GPU_SLOTS];
+    bool gpu_open_;
+    std::vector<Stage> stages_;
+    unsigned int n_frames_;
+    std::vector<TraceEvent> trace_;
+    std::string trace_path_;
+    unsigned long long capture_start_;
+    unsigned long long capture_end_;
+};
+
+// scope guards behind the macros below
+class CpuScope {
+  public:
+    CpuScope(const char* name) {
+        Profiler::instance().beginCpu(name);
+    }
+    ~CpuScope() {
+        Profiler::instance().endCpu();
+    }
+};
+
+class GpuScope {
+  public:
+    GpuScope(const char* name):
+        open_(Profiler::instance().beginGpu(name))
+    {}
+    ~GpuScope() {
+        if (open_) {
+            Profiler::instance().endGpu();
+        }
+    }
+  private:
+    bool open_;
+};
+
+}
+
+// scope and frame markers compile away unless GLITCH_PROFILE is defined
+#define GLITCH_PROFILE_CONCAT_(a, b) a##b
+#define GLITCH_PROFILE_CONCAT(a, b) GLITCH_PROFILE_CONCAT_(a, b)
+#ifdef GLITCH_PROFILE
+#define PROFILE_SCOPE(name) prof::CpuScope GLITCH_PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define PROFILE_GPU_SCOPE(name) prof::GpuScope GLITCH_PROFILE_CONCAT(profile_gpu_scope_, __LINE__)(name)
+#define PROFILE_BEGIN_FRAME() prof::Profiler::instance().beginFrame()
+#define PROFILE_END_FRAME() prof::Profiler::instance().endFrame()
+#else
+#define PROFILE_SCOPE(name) do {} while (0)
+#define PROFILE_GPU_SCOPE(name) do {} while (0)
+#define PROFILE_BEGIN_FRAME() do {} while (0)
+#define PROFILE_END_FRAME() do {} while (0)
+#endif
+
+#endif
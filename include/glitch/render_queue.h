@@ -0,0 +1,253 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+
+#include <glitch/shader.h>
+#include <glitch/graphics.h>
+#include <glitch/gl_state.h>
+
+namespace gfx {
+
+// Collects a frame's draws and issues them in sorted order, so the order
+// they were submitted in doesn't matter. Every item gets a 64 bit key, most
+// significant field first:
+//   opaque:      layer:2 | 0:1 | program:8 | material:12 | depth:24
+//   transparent: layer:2 | 1:1 | far to near depth:24 | program:8 | material:12
+// Opaque draws are grouped by program then material (its textures) and go
+// front to back within a material for early z. Transparent draws go back to
+// front after every opaque one. Keys are sorted with an LSD radix sort.
+class RenderQueue {
+  public:
+    typedef unsigned int MaterialId;
+
+    static const unsigned int MAX_MATERIAL_TEXTURES = 4;
+
+    struct Stats {
+        unsigned int n_items;
+        unsigned int n_program_switches;
+        unsigned int n_material_switches;
+    };
+
+    // depth is quantized over [0, max_depth], anything further shares the last step
+    RenderQueue(float max_depth = 100.0f):
+        max_depth_(max_depth)
+    {
+        stats_ = Stats { 0, 0, 0 };
+    }
+
+    MaterialId addMaterial(Shader& shader, bool transparent = false) {
+        Material material;
+        material.shader = &shader;
+        material.program = programIndex(shader.ID);
+        material.transparent = transparent;
+        material.n_textures = 0;
+        material.model = shader.uniform<glm::mat4>("model");
+        material.color = shader.uniform<glm::vec4>("color");
+        material.fade = shader.uniform<float>("fade");
+        materials_.push_back(material);
+        return materials_.size() - 1;
+    }
+
+    // texture bound to GL_TEXTURE0 + unit while drawing with the material,
+    // can change between frames without touching the sort keys
+    void setTexture(MaterialId id, unsigned int unit, unsigned int type, unsigned int texture) {
+        Material& material = materials_[id];
+        for (unsigned int i = material.n_textures; i < unit; i++) {
+            material.texture_types[i] = GL_TEXTURE_2D;
+            material.textures[i] = 0;
+        }
+        material.n_textures = std::max(material.n_textures, unit + 1);
+        material.texture_types[unit] = type;
+        material.textures[unit] = texture;
+    }
+
+    void setMaxDepth(float max_depth) {
+        max_depth_ = max_depth;
+    }
+
+    void clear() {
+        entries_.clear();
+        items_.clear();
+    }
+
+    // depth is the distance to the camera, layers are drawn in order (e.g. world then overlay)
+    void submit(MaterialId material, const DrawItem& item, float depth, unsigned int layer = 0) {
+        if (item.empty()) {
+            return;
+        }
+        entries_.push_back(Entry { key(material, depth, layer), static_cast<unsigned int>(items_.size()) });
+        items_.push_back(Submitted { item, material });
+    }
+
+    // sort and draw everything submitted since the last clear
+    void flush() {
+        sort();
+        stats_ = Stats { static_cast<unsigned int>(entries_.size()), 0, 0 };
+
+        GLState& state = GLState::instance();
+        const unsigned int none = 0xffffffffu;
+        unsigned int current_material = none;
+        unsigned int current_program = none;
+        bool blending = false;
+        for (const Entry& entry : entries_) {
+            const Submitted& submitted = items_[entry.index];
+            const Material& material = materials_[submitted.material];
+            if (submitted.material != current_material) {
+                if (material.program != current_program) {
+                    material.shader->use();
+                    current_program = material.program;
+                    stats_.n_program_switches++;
+                }
+                for (unsigned int unit = 0; unit < material.n_textures; unit++) {
+                    state.bindTextureUnit(GL_TEXTURE0 + unit, material.texture_types[unit], material.textures[unit]);
+                }
+                if (material.transparent != blending) {
+                    setBlending(material.transparent);
+                    blending = material.transparent;
+                }
+                current_material = submitted.material;
+                stats_.n_material_switches++;
+            }
+            if (material.model.location >= 0) {
+                material.shader->set(material.model, submitted.item.model);
+            }
+            if (material.color.location >= 0) {
+                material.shader->set(material.color, submitted.item.color);
+            }
+            if (material.fade.location >= 0) {
+                material.shader->set(material.fade, submitted.item.fade);
+            }
+            submitted.item.draw();
+        }
+        if (blending) {
+            setBlending(false);
+        }
+    }
+
+    const Stats& stats() const {
+        return stats_;
+    }
+
+  private:
+    static const unsigned int DEPTH_BITS = 24;
+    static const unsigned int PROGRAM_BITS = 8;
+    static const unsigned int MATERIAL_BITS = 12;
+
+    struct Material {
+        Shader* shader;
+        unsigned int program;
+        bool transparent;
+        unsigned int n_textures;
+        unsigned int texture_types[MAX_MATERIAL_TEXTURES];
+        unsigned int textures[MAX_MATERIAL_TEXTURES];
+        Uniform<glm::mat4> model;
+        Uniform<glm::vec4> color;
+        Uniform<float> fade;
+    };
+
+    struct Entry {
+        uint64_t key;
+        unsigned int index;
+    };
+
+    struct Submitted {
+        DrawItem item;
+        MaterialId material;
+    };
+
+    float max_depth_;
+    std::vector<Material> materials_;
+    std::vector<unsigned int> programs_;
+    std::vector<Entry> entries_;
+    std::vector<Entry> scratch_;
+    std::vector<Submitted> items_;
+    Stats stats_;
+
+    // small dense index per program, materials of one program sort next to each other
+    unsigned int programIndex(unsigned int program) {
+        std::vector<unsigned int>::iterator it = std::find(programs_.begin(), programs_.end(), program);
+        if (it != programs_.end()) {
+            return it - programs_.begin();
+        }
+        programs_.push_back(program);
+        return programs_.size() - 1;
+    }
+
+    uint64_t key(MaterialId id, float depth, unsigned int layer) const {
+        const Material& material = materials_[id];
+        const uint64_t max_quantized = (1u << DEPTH_BITS) - 1;
+        const float t = std::min(std::max(depth / max_depth_, 0.0f), 1.0f);
+        const uint64_t quantized = static_cast<uint64_t>(t * max_quantized);
+        const uint64_t program = material.program & ((1u << PROGRAM_BITS) - 1);
+        const uint64_t material_index = id & ((1u << MATERIAL_BITS) - 1);
+
+        uint64_t key = static_cast<uint64_t>(layer & 3) << 62;
+        if (!material.transparent) {
+            key |= program << 53;
+            key |= material_index << 41;
+            key |= quantized << 17;
+        } else {
+            key |= static_cast<uint64_t>(1) << 61;
+            key |= (max_quantized - quantized) << 37;
+            key |= program << 29;
+            key |= material_index << 17;
+        }
+        return key;
+    }
+
+    // 8 passes of 8 bits, histograms for every pass are built in one read and
+    // passes where all keys share the same byte are skipped
+    void sort() {
+        const unsigned int n = entries_.size();
+        if (n < 2) {
+            return;
+        }
+        unsigned int counts[8][256];
+        std::memset(counts, 0, sizeof(counts));
+        for (const Entry& entry : entries_) {
+            for (unsigned int pass = 0; pass < 8; pass++) {
+                counts[pass][(entry.key >> (pass * 8)) & 0xff]++;
+            }
+        }
+        scratch_.resize(n);
+        for (unsigned int pass = 0; pass < 8; pass++) {
+            const unsigned int shift = pass * 8;
+            if (counts[pass][(entries_[0].key >> shift) & 0xff] == n) {
+                continue;
+            }
+            unsigned int offsets[256];
+            unsigned int total = 0;
+            for (unsigned int bucket = 0; bucket < 256; bucket++) {
+                offsets[bucket] = total;
+                total += counts[pass][bucket];
+            }
+            for (const Entry& entry : entries_) {
+                scratch_[offsets[(entry.key >> shift) & 0xff]++] = entry;
+            }
+            entries_.swap(scratch_);
+        }
+    }
+
+    void setBlending(bool enabled) {
+        GLState& state = GLState::instance();
+        if (enabled) {
+            state.enable(GL_BLEND);
+            state.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            state.depthMask(false);
+        } else {
+            state.disable(GL_BLEND);
+            state.depthMask(true);
+        }
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,191 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iterator>
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+
+#include <glm/glm.hpp>
+
+namespace input {
+
+// everything one simulation tick reads from the player
+struct TickRecord {
+    uint8_t movement; // the game's PlayerMovement
+    bool toggle_camera;
+    glm::vec2 mouse_delta;
+};
+
+// File layout, little endian:
+//   header:  "GLRP" | version u32 | tick rate f64
+//   tick:    flags u8 | movement u8 | [mouse dx f32 | mouse dy f32 if HAS_MOUSE]
+//   trailer: END u8 | tick count u32 | state checksum u32
+// Ticks without mouse movement take two bytes. A file without a trailer
+// (the game didn't exit cleanly) still replays, it just can't be verified.
+namespace replay_format {
+    const char MAGIC[4] = { 'G', 'L', 'R', 'P' };
+    const uint32_t VERSION = 1;
+    const uint8_t TOGGLE_CAMERA = 1;
+    const uint8_t HAS_MOUSE = 2;
+    const uint8_t END = 0x80;
+}
+
+// Writes the input of every tick so a session can be replayed exactly
+class Recorder {
+  public:
+    Recorder(): n_ticks_(0) {}
+
+    bool open(const std::string& path, double tick_rate) {
+        file_.open(path.c_str(), std::ios::binary | std::ios::trunc);
+        if (!file_) {
+            std::cout << "Failed to open recording " << path << std::endl;
+            return false;
+        }
+        file_.write(replay_format::MAGIC, 4);
+        write(replay_format::VERSION);
+        write(tick_rate);
+        n_ticks_ = 0;
+        return true;
+    }
+
+    bool isOpen() const {
+        return file_.is_open();
+    }
+
+    void record(const TickRecord& tick) {
+        const bool has_mouse = tick.mouse_delta != glm::vec2(0.0f);
+        uint8_t flags = 0;
+        if (tick.toggle_camera) flags |= replay_format::TOGGLE_CAMERA;
+        if (has_mouse) flags |= replay_format::HAS_MOUSE;
+        write(flags);
+        write(tick.movement);
+        if (has_mouse) {
+            write(tick.mouse_delta.x);
+            write(tick.mouse_delta.y);
+        }
+        n_ticks_++;
+    }
+
+    // state_checksum describes the simulation after the last tick, replays compare against it
+    void close(uint32_t state_checksum) {
+        if (!isOpen()) {
+            return;
+        }
+        write(replay_format::END);
+        write(n_ticks_);
+        write(state_checksum);
+        file_.close();
+    }
+
+    unsigned int size() const {
+        return n_ticks_;
+    }
+
+  private:
+    std::ofstream file_;
+    uint32_t n_ticks_;
+
+    template<typename T>
+    void write(const T& value) {
+        file_.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+};
+
+// A recording loaded into memory, so replaying it never waits on the disk
+class Replay {
+  public:
+    Replay():
+        read_(0),
+        tick_rate_(0.0),
+        has_checksum_(false),
+        checksum_(0)
+    {}
+
+    bool load(const std::string& path) {
+        std::ifstream file(path.c_str(), std::ios::binary);
+        if (!file) {
+            std::cout << "Failed to open recording " << path << std::endl;
+            return false;
+        }
+        data_.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        read_ = 0;
+        ticks_.clear();
+        has_checksum_ = false;
+
+        char magic[4];
+        uint32_t version = 0;
+        if (!read(magic) || std::memcmp(magic, replay_format::MAGIC, 4) != 0
+            || !read(version) || version != replay_format::VERSION || !read(tick_rate_)) {
+            std::cout << "Not a version " << replay_format::VERSION << " recording: " << path << std::endl;
+            return false;
+        }
+
+        uint8_t flags;
+        while (read(flags)) {
+            if (flags & replay_format::END) {
+                uint32_t n_ticks = 0;
+                has_checksum_ = read(n_ticks) && read(checksum_) && n_ticks == ticks_.size();
+                break;
+            }
+            TickRecord tick;
+            tick.toggle_camera = (flags & replay_format::TOGGLE_CAMERA) != 0;
+            tick.mouse_delta = glm::vec2(0.0f);
+            if (!read(tick.movement)) {
+                break;
+            }
+            if ((flags & replay_format::HAS_MOUSE) && !(read(tick.mouse_delta.x) && read(tick.mouse_delta.y))) {
+                break;
+            }
+            ticks_.push_back(tick);
+        }
+        data_.clear();
+        return true;
+    }
+
+    double tickRate() const {
+        return tick_rate_;
+    }
+
+    unsigned int size() const {
+        return ticks_.size();
+    }
+
+    const TickRecord& tick(unsigned int i) const {
+        return ticks_[i];
+    }
+
+    // false if the recording was cut short
+    bool hasChecksum() const {
+        return has_checksum_;
+    }
+
+    uint32_t checksum() const {
+        return checksum_;
+    }
+
+  private:
+    std::vector<char> data_;
+    unsigned int read_;
+    std::vector<TickRecord> ticks_;
+    double tick_rate_;
+    bool has_checksum_;
+    uint32_t checksum_;
+
+    template<typename T>
+    bool read(T& value) {
+        if (read_ + sizeof(T) > data_.size()) {
+            return false;
+        }
+        std::memcpy(&value, &data_[read_], sizeof(T));
+        read_ += sizeof(T);
+        return true;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,396 @@
+#ifndef ROLLBACK_H
+#define ROLLBACK_H
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+
+namespace net {
+
+// FNV-1a over the bytes of a state, peers compare these to spot desyncs
+template<typename State>
+uint32_t checksum(const State& state) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&state);
+    uint32_t hash = 2166136261u;
+    for (unsigned int i = 0; i < sizeof(State); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// The last Capacity states, slot frame % Capacity. Saving and loading is a
+// memcpy, so State has to be plain data.
+template<typename State, unsigned int Capacity>
+class SnapshotRing {
+  public:
+    static_assert(std::is_trivially_copyable<State>::value, "snapshots are copied as bytes");
+
+    SnapshotRing() {
+        std::fill(frames_, frames_ + Capacity, NO_FRAME);
+    }
+
+    void save(unsigned int frame, const State& state) {
+        std::memcpy(&states_[frame % Capacity], &state, sizeof(State));
+        frames_[frame % Capacity] = frame;
+    }
+
+    // false if the frame was never saved or has been overwritten since
+    bool load(unsigned int frame, State& state) const {
+        if (!contains(frame)) {
+            return false;
+        }
+        std::memcpy(&state, &states_[frame % Capacity], sizeof(State));
+        return true;
+    }
+
+    bool contains(unsigned int frame) const {
+        return frames_[frame % Capacity] == frame;
+    }
+
+    const State& at(unsigned int frame) const {
+        return states_[frame % Capacity];
+    }
+
+  private:
+    static const unsigned int NO_FRAME = 0xffffffffu;
+
+    State states_[Capacity];
+    unsigned int frames_[Capacity];
+};
+
+template<typename State, unsigned int Capacity>
+const unsigned int SnapshotRing<State, Capacity>::NO_FRAME;
+
+// Inputs of one player for frames first_frame .. first_frame + n_inputs - 1.
+// ack is the last frame up to which the sender has every input of the receiver,
+// so each packet resends whatever may have been lost.
+template<typename Input, unsigned int MaxInputs>
+struct InputPacket {
+    uint32_t player;
+    int32_t ack;
+    uint32_t first_frame;
+    uint32_t n_inputs;
+    Input inputs[MaxInputs];
+};
+
+// GGPO style rollback over a deterministic step function. Every frame runs
+// right away with the remote inputs that have arrived and predictions (the
+// player's last known input) for the rest. When a late input shows a
+// prediction was wrong, the next advance restores the snapshot from before
+// that frame and simulates forward again to the present, all in that one
+// call. Local input is scheduled input_delay frames ahead, which hides that
+// much latency without any rollback. A peer more than MaxRollback frames
+// ahead of what it knows of the others stalls until their inputs arrive.
+template<typename State, typename Input, unsigned int NPlayers, unsigned int MaxRollback = 8>
+class Session {
+  public:
+    typedef std::function<void(State&, const Input*)> Step;
+
+    static const unsigned int MAX_PACKET_INPUTS = 32;
+    typedef InputPacket<Input, MAX_PACKET_INPUTS> Packet;
+
+    struct Stats {
+        unsigned int n_frames;
+        unsigned int n_stalls;
+        unsigned int n_rollbacks;
+        unsigned int n_resimulated_frames;
+        unsigned int max_rollback_frames;
+        double rollback_ms; // total time spent restoring and resimulating
+    };
+
+    Session(const State& initial, Step step, unsigned int local_player, unsigned int input_delay = 2):
+        state_(initial),
+        step_(step),
+        local_player_(local_player),
+        input_delay_(input_delay),
+        frame_(0),
+        rollback_to_(NO_ROLLBACK)
+    {
+        stats_ = Stats { 0, 0, 0, 0, 0, 0.0 };
+        for (unsigned int player = 0; player < NPlayers; player++) {
+            contiguous_[player] = -1;
+            acked_[player] = -1;
+            for (unsigned int slot = 0; slot < HISTORY; slot++) {
+                history_[player][slot] = Slot { NO_FRAME, false, Input() };
+            }
+        }
+        // the delayed frames before the first local input are empty
+        for (unsigned int frame = 0; frame < input_delay_; frame++) {
+            confirm(local_player_, frame, Input());
+        }
+    }
+
+    // frame the next local input is for
+    unsigned int localInputFrame() const {
+        return frame_ + input_delay_;
+    }
+
+    bool canAdvance() const {
+        return static_cast<int>(frame_) - (confirmedFrame() + 1) < static_cast<int>(MaxRollback);
+    }
+
+    // run one frame. false (and the input is not taken) while stalled on remote input,
+    // corrections from inputs that arrived meanwhile are applied either way
+    bool advance(const Input& local_input) {
+        rollback();
+        if (!canAdvance()) {
+            stats_.n_stalls++;
+            return false;
+        }
+        confirm(local_player_, localInputFrame(), local_input);
+
+        Input inputs[NPlayers];
+        gatherInputs(frame_, inputs);
+        snapshots_.save(frame_, state_);
+        step_(state_, inputs);
+        frame_++;
+        stats_.n_frames++;
+        return true;
+    }
+
+    void receive(const Packet& packet) {
+        if (packet.player >= NPlayers || packet.player == local_player_) {
+            return;
+        }
+        acked_[packet.player] = std::max(acked_[packet.player], static_cast<int>(packet.ack));
+        for (unsigned int i = 0; i < packet.n_inputs && i < MAX_PACKET_INPUTS; i++) {
+            addRemoteInput(packet.player, packet.first_frame + i, packet.inputs[i]);
+        }
+    }
+
+    // local inputs player hasn't acknowledged yet, oldest first
+    Packet packetFor(unsigned int player) const {
+        Packet packet = Packet();
+        packet.player = local_player_;
+        packet.ack = contiguous_[player];
+        packet.first_frame = acked_[player] + 1;
+        const int last = contiguous_[local_player_];
+        for (int frame = packet.first_frame; frame <= last && packet.n_inputs < MAX_PACKET_INPUTS; frame++) {
+            const Slot& slot = history_[local_player_][frame % HISTORY];
+            if (slot.frame != static_cast<unsigned int>(frame)) {
+                break;
+            }
+            packet.inputs[packet.n_inputs++] = slot.input;
+        }
+        return packet;
+    }
+
+    void addRemoteInput(unsigned int player, unsigned int frame, const Input& input) {
+        const Slot& slot = history_[player][frame % HISTORY];
+        if (static_cast<int>(frame) <= contiguous_[player] || (slot.frame == frame && slot.confirmed)) {
+            return;
+        }
+        // too far ahead to keep, it is sent again until acknowledged
+        if (frame >= frame_ + HISTORY - MaxRollback) {
+            return;
+        }
+        if (frame < frame_ && slot.frame == frame && slot.input != input) {
+            requestRollback(frame);
+        }
+        const int previous = contiguous_[player];
+        confirm(player, frame, input);
+
+        if (contiguous_[player] == previous) {
+            return;
+        }
+        // frames simulated after the new contiguous input were predicted from an older one
+        for (unsigned int later = contiguous_[player] + 1; later < frame_; later++) {
+            const Slot& predicted = history_[player][later % HISTORY];
+            if (predicted.frame == later && !predicted.confirmed && predicted.input != prediction(player)) {
+                requestRollback(later);
+                break;
+            }
+        }
+    }
+
+    // every input is known for every frame up to here
+    int confirmedFrame() const {
+        int frame = contiguous_[0];
+        for (unsigned int player = 1; player < NPlayers; player++) {
+            frame = std::min(frame, contiguous_[player]);
+        }
+        return frame;
+    }
+
+    // frame that the current state is at the start of
+    unsigned int frame() const {
+        return frame_;
+    }
+
+    const State& state() const {
+        return state_;
+    }
+
+    // state at the start of a recent frame, false if it isn't kept anymore or
+    // is about to be corrected by a rollback
+    bool stateAt(unsigned int frame, State& state) const {
+        if (rollback_to_ < frame) {
+            return false;
+        }
+        if (frame == frame_) {
+            state = state_;
+            return true;
+        }
+        return frame < frame_ && snapshots_.load(frame, state);
+    }
+
+    const Stats& stats() const {
+        return stats_;
+    }
+
+  private:
+    static const unsigned int HISTORY = 128;
+    static const unsigned int NO_FRAME = 0xffffffffu;
+    static const unsigned int NO_ROLLBACK = 0xffffffffu;
+
+    struct Slot {
+        unsigned int frame;
+        bool confirmed;
+        Input input;
+    };
+
+    State state_;
+    Step step_;
+    unsigned int local_player_;
+    unsigned int input_delay_;
+    unsigned int frame_;
+    unsigned int rollback_to_;
+    Slot history_[NPlayers][HISTORY];
+    int contiguous_[NPlayers]; // last frame with every earlier input confirmed
+    int acked_[NPlayers]; // last frame each player has all our inputs up to
+    SnapshotRing<State, MaxRollback + 2> snapshots_;
+    Stats stats_;
+
+    void confirm(unsigned int player, unsigned int frame, const Input& input) {
+        history_[player][frame % HISTORY] = Slot { frame, true, input };
+        while (true) {
+            const Slot& next = history_[player][(contiguous_[player] + 1) % HISTORY];
+            if (next.frame != static_cast<unsigned int>(contiguous_[player] + 1) || !next.confirmed) {
+                break;
+            }
+            contiguous_[player]++;
+        }
+    }
+
+    Input prediction(unsigned int player) const {
+        if (contiguous_[player] < 0) {
+            return Input();
+        }
+        return history_[player][contiguous_[player] % HISTORY].input;
+    }
+
+    // confirmed inputs where known, predictions (remembered for later checks) otherwise
+    void gatherInputs(unsigned int frame, Input* inputs) {
+        for (unsigned int player = 0; player < NPlayers; player++) {
+            Slot& slot = history_[player][frame % HISTORY];
+            if (slot.frame != frame || !slot.confirmed) {
+                slot = Slot { frame, false, prediction(player) };
+            }
+            inputs[player] = slot.input;
+        }
+    }
+
+    void requestRollback(unsigned int frame) {
+        rollback_to_ = std::min(rollback_to_, frame);
+    }
+
+    void rollback() {
+        if (rollback_to_ == NO_ROLLBACK) {
+            return;
+        }
+        const unsigned int from = rollback_to_;
+        rollback_to_ = NO_ROLLBACK;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (!snapshots_.load(from, state_)) {
+            // can't happen while frames stall at MaxRollback, the snapshot ring is larger
+            return;
+        }
+        Input inputs[NPlayers];
+        for (unsigned int frame = from; frame < frame_; frame++) {
+            gatherInputs(frame, inputs);
+            snapshots_.save(frame, state_);
+            step_(state_, inputs);
+        }
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+        const unsigned int n_frames = frame_ - from;
+        stats_.n_rollbacks++;
+        stats_.n_resimulated_frames += n_frames;
+        stats_.max_rollback_frames = std::max(stats_.max_rollback_frames, n_frames);
+        stats_.rollback_ms += std::chrono::duration<double, std::milli>(end - start).count();
+    }
+};
+
+// Stands in for a network link on one machine: messages arrive after delay
+// plus up to jitter seconds, or not at all with probability loss. With
+// jitter, messages can overtake each other, as UDP datagrams do.
+template<typename Message>
+class LoopbackChannel {
+  public:
+    struct Stats {
+        unsigned int n_sent;
+        unsigned int n_dropped;
+        unsigned int n_delivered;
+    };
+
+    LoopbackChannel(double delay, double jitter = 0.0, float loss = 0.0f, uint32_t seed = 1):
+        delay_(delay),
+        jitter_(jitter),
+        loss_(loss),
+        rng_(seed)
+    {
+        stats_ = Stats { 0, 0, 0 };
+    }
+
+    // now is in seconds, on the same clock as receive
+    void send(const Message& message, double now) {
+        stats_.n_sent++;
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        if (uniform(rng_) < loss_) {
+            stats_.n_dropped++;
+            return;
+        }
+        in_flight_.push_back(InFlight { now + delay_ + jitter_ * uniform(rng_), message });
+    }
+
+    // calls f(message) for every message that has arrived by now, earliest first
+    template<typename F>
+    void receive(double now, F f) {
+        std::stable_sort(in_flight_.begin(), in_flight_.end(), [](const InFlight& a, const InFlight& b) {
+            return a.arrival < b.arrival;
+        });
+        unsigned int n_arrived = 0;
+        while (n_arrived < in_flight_.size() && in_flight_[n_arrived].arrival <= now) {
+            f(in_flight_[n_arrived].message);
+            n_arrived++;
+        }
+        in_flight_.erase(in_flight_.begin(), in_flight_.begin() + n_arrived);
+        stats_.n_delivered += n_arrived;
+    }
+
+    const Stats& stats() const {
+        return stats_;
+    }
+
+  private:
+    struct InFlight {
+        double arrival;
+        Message message;
+    };
+
+    double delay_;
+    double jitter_;
+    float loss_;
+    std::mt19937 rng_;
+    std::vector<InFlight> in_flight_;
+    Stats stats_;
+};
+
+}
+
+#endif
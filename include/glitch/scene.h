@@ -0,0 +1,377 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <glm/glm.hpp>
+
+namespace scene {
+
+// Scenes are written as text and compiled to a binary that is used straight
+// from a read-only mapping. Text form, one statement per line, # comments:
+//   texture NAME PATH
+//   block X Y Z  W H D  R G B A  [TEXTURE]
+// where X Y Z is the low corner, W H D the size and TEXTURE a name declared
+// above it; a block without one is drawn in its color only.
+//
+// Binary form, little endian, each array 16 byte aligned:
+//   header:    "GLSC" | version u32 | block count u32 | texture count u32
+//              | offsets u64 of positions, sizes, colors, textures, paths | file size u64
+//   positions: f32[3] per block
+//   sizes:     f32[3] per block
+//   colors:    f32[4] per block
+//   textures:  i32 per block, index into the paths or NO_TEXTURE
+//   paths:     one null terminated path per texture, back to back
+namespace scene_format {
+    const char MAGIC[4] = { 'G', 'L', 'S', 'C' };
+    const uint32_t VERSION = 1;
+    const uint64_t ALIGNMENT = 16;
+
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint32_t n_blocks;
+        uint32_t n_textures;
+        uint64_t positions;
+        uint64_t sizes;
+        uint64_t colors;
+        uint64_t textures;
+        uint64_t paths;
+        uint64_t size;
+    };
+}
+
+const int32_t NO_TEXTURE = -1;
+
+// a scene being authored or compiled, one entry per block in each array
+struct SceneDesc {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> sizes;
+    std::vector<glm::vec4> colors;
+    std::vector<int32_t> textures;
+    std::vector<std::string> texture_paths;
+
+    unsigned int addTexture(const std::string& path) {
+        texture_paths.push_back(path);
+        return texture_paths.size() - 1;
+    }
+
+    void addBlock(glm::vec3 position, glm::vec3 size, glm::vec4 color, int32_t texture = NO_TEXTURE) {
+        positions.push_back(position);
+        sizes.push_back(size);
+        colors.push_back(color);
+        textures.push_back(texture);
+    }
+
+    unsigned int blockCount() const {
+        return positions.size();
+    }
+};
+
+// Text form to SceneDesc. name is only used in error messages
+inline bool parse(const char* text, size_t length, SceneDesc& out, const std::string& name) {
+    out = SceneDesc();
+    std::vector<std::string> texture_names;
+    const char* end = text + length;
+    unsigned int line_number = 0;
+    for (const char* line = text; line < end; ) {
+        const char* line_end = static_cast<const char*>(std::memchr(line, '\n', end - line));
+        if (!line_end) {
+            line_end = end;
+        }
+        line_number++;
+        std::string statement(line, line_end);
+        line = line_end + 1;
+        if (statement.find('#') != std::string::npos) {
+            statement.erase(statement.find('#'));
+        }
+
+        // split on whitespace
+        std::vector<std::string> words;
+        const char* separators = " \t\r";
+        for (size_t begin = statement.find_first_not_of(separators); begin != std::string::npos; ) {
+            size_t word_end = statement.find_first_of(separators, begin);
+            words.push_back(statement.substr(begin, word_end - begin));
+            begin = (word_end == std::string::npos) ? word_end : statement.find_first_not_of(separators, word_end);
+        }
+        if (words.empty()) {
+            continue;
+        }
+
+        if (words[0] == "texture" && words.size() == 3) {
+            texture_names.push_back(words[1]);
+            out.addTexture(words[2]);
+        } else if (words[0] == "block" && (words.size() == 11 || words.size() == 12)) {
+            float values[10];
+            for (unsigned int i = 0; i < 10; i++) {
+                char* number_end;
+                values[i] = std::strtof(words[i + 1].c_str(), &number_end);
+                if (*number_end != '\0') {
+                    std::cout << name << ":" << line_number << ": not a number: " << words[i + 1] << std::endl;
+                    return false;
+                }
+            }
+            int32_t texture = NO_TEXTURE;
+            if (words.size() == 12) {
+                for (unsigned int i = 0; i < texture_names.size(); i++) {
+                    if (texture_names[i] == words[11]) {
+                        texture = i;
+                    }
+                }
+                if (texture == NO_TEXTURE) {
+                    std::cout << name << ":" << line_number << ": unknown texture " << words[11] << std::endl;
+                    return false;
+                }
+            }
+            out.addBlock(
+                glm::vec3(values[0], values[1], values[2]),
+                glm::vec3(values[3], values[4], values[5]),
+                glm::vec4(values[6], values[7], values[8], values[9]),
+                texture
+            );
+        } else {
+            std::cout << name << ":" << line_number << ": expected texture NAME PATH or block X Y Z W H D R G B A [TEXTURE]" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// SceneDesc to the binary form
+inline void compile(const SceneDesc& desc, std::vector<char>& out) {
+    using namespace scene_format;
+    const uint64_t n_blocks = desc.blockCount();
+    uint64_t end = sizeof(Header);
+    // reserve an aligned section, returns its offset
+    auto section = [&end](uint64_t bytes) {
+        const uint64_t offset = (end + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        end = offset + bytes;
+        return offset;
+    };
+    Header header;
+    std::memcpy(header.magic, MAGIC, 4);
+    header.version = VERSION;
+    header.n_blocks = n_blocks;
+    header.n_textures = desc.texture_paths.size();
+    header.positions = section(n_blocks * 3 * sizeof(float));
+    header.sizes = section(n_blocks * 3 * sizeof(float));
+    header.colors = section(n_blocks * 4 * sizeof(float));
+    header.textures = section(n_blocks * sizeof(int32_t));
+    uint64_t path_bytes = 0;
+    for (const std::string& path : desc.texture_paths) {
+        path_bytes += path.size() + 1;
+    }
+    header.paths = section(path_bytes);
+    header.size = end;
+
+    out.assign(header.size, 0);
+    std::memcpy(&out[0], &header, sizeof(Header));
+    for (uint64_t i = 0; i < n_blocks; i++) {
+        std::memcpy(&out[header.positions + i * 3 * sizeof(float)], &desc.positions[i][0], 3 * sizeof(float));
+        std::memcpy(&out[header.sizes + i * 3 * sizeof(float)], &desc.sizes[i][0], 3 * sizeof(float));
+        std::memcpy(&out[header.colors + i * 4 * sizeof(float)], &desc.colors[i][0], 4 * sizeof(float));
+    }
+    if (n_blocks > 0) {
+        std::memcpy(&out[header.textures], &desc.textures[0], n_blocks * sizeof(int32_t));
+    }
+    uint64_t path_offset = header.paths;
+    for (const std::string& path : desc.texture_paths) {
+        std::memcpy(&out[path_offset], path.c_str(), path.size() + 1);
+        path_offset += path.size() + 1;
+    }
+}
+
+inline bool save(const std::string& path, const SceneDesc& desc) {
+    std::vector<char> data;
+    compile(desc, data);
+    std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cout << "Failed to open scene " << path << " for writing" << std::endl;
+        return false;
+    }
+    file.write(data.data(), data.size());
+    return bool(file);
+}
+
+// A loaded scene. Binary files are mapped and read in place, nothing is
+// parsed or copied; text files are parsed and compiled in memory first, so
+// either way the arrays below point into the binary form.
+class Scene {
+  public:
+    Scene():
+        data_(NULL),
+        mapping_(NULL),
+        mapping_size_(0),
+        header_(NULL)
+    {}
+
+    Scene(const Scene&) = delete;
+    Scene& operator=(const Scene&) = delete;
+
+    ~Scene() {
+        close();
+    }
+
+    bool load(const std::string& path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            std::cout << "Failed to open scene " << path << std::endl;
+            return false;
+        }
+        struct stat status;
+        if (fstat(fd, &status) != 0 || status.st_size == 0) {
+            std::cout << "Failed to read scene " << path << std::endl;
+            ::close(fd);
+            return false;
+        }
+        mapping_size_ = status.st_size;
+        void* mapping = mmap(NULL, mapping_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+            std::cout << "Failed to map scene " << path << std::endl;
+            mapping_size_ = 0;
+            return false;
+        }
+        mapping_ = mapping;
+        const char* bytes = static_cast<const char*>(mapping_);
+
+        if (mapping_size_ < 4 || std::memcmp(bytes, scene_format::MAGIC, 4) != 0) {
+            // the text form, compile it and let go of the file
+            SceneDesc desc;
+            bool parsed = parse(bytes, mapping_size_, desc, path);
+            unmap();
+            if (!parsed) {
+                return false;
+            }
+            compile(desc, compiled_);
+            return bind(compiled_.data(), compiled_.size(), path);
+        }
+        // every page is about to be read, start reading ahead now
+        madvise(mapping_, mapping_size_, MADV_WILLNEED);
+        return bind(bytes, mapping_size_, path);
+    }
+
+    void close() {
+        unmap();
+        compiled_.clear();
+        data_ = NULL;
+        header_ = NULL;
+        texture_paths_.clear();
+    }
+
+    unsigned int blockCount() const {
+        return header_ ? header_->n_blocks : 0;
+    }
+
+    // blockCount() entries each, valid until the scene is closed
+    const glm::vec3* positions() const {
+        return reinterpret_cast<const glm::vec3*>(data_ + header_->positions);
+    }
+
+    const glm::vec3* sizes() const {
+        return reinterpret_cast<const glm::vec3*>(data_ + header_->sizes);
+    }
+
+    const glm::vec4* colors() const {
+        return reinterpret_cast<const glm::vec4*>(data_ + header_->colors);
+    }
+
+    const int32_t* textures() const {
+        return reinterpret_cast<const int32_t*>(data_ + header_->textures);
+    }
+
+    unsigned int textureCount() const {
+        return texture_paths_.size();
+    }
+
+    const char* texturePath(unsigned int texture) const {
+        return texture_paths_[texture];
+    }
+
+  private:
+    const char* data_;
+    void* mapping_;
+    size_t mapping_size_;
+    std::vector<char> compiled_; // when loaded from text
+    const scene_format::Header* header_;
+    std::vector<const char*> texture_paths_;
+
+    void unmap() {
+        if (mapping_) {
+            munmap(mapping_, mapping_size_);
+            mapping_ = NULL;
+            mapping_size_ = 0;
+        }
+    }
+
+    // check every array lies inside the data before handing out pointers to it
+    bool bind(const char* data, size_t size, const std::string& path) {
+        using namespace scene_format;
+        const Header* header = reinterpret_cast<const Header*>(data);
+        if (size < sizeof(Header) || header->version != VERSION) {
+            std::cout << "Scene " << path << " is not a version " << VERSION << " scene" << std::endl;
+            close();
+            return false;
+        }
+        if (header->size != size) {
+            std::cout << "Scene " << path << " is " << size << " bytes, expected " << header->size << std::endl;
+            close();
+            return false;
+        }
+        const uint64_t n_blocks = header->n_blocks;
+        const uint64_t sections[][2] = {
+            { header->positions, n_blocks * 3 * sizeof(float) },
+            { header->sizes, n_blocks * 3 * sizeof(float) },
+            { header->colors, n_blocks * 4 * sizeof(float) },
+            { header->textures, n_blocks * sizeof(int32_t) },
+            { header->paths, 0 },
+        };
+        for (const uint64_t* section : sections) {
+            if (section[0] % ALIGNMENT != 0 || section[0] > size || section[1] > size - section[0]) {
+                std::cout << "Scene " << path << " is truncated" << std::endl;
+                close();
+                return false;
+            }
+        }
+
+        const char* path_data = data + header->paths;
+        const char* end = data + size;
+        for (uint32_t i = 0; i < header->n_textures; i++) {
+            const char* path_end = static_cast<const char*>(std::memchr(path_data, '\0', end - path_data));
+            if (!path_end) {
+                std::cout << "Scene " << path << " is truncated" << std::endl;
+                close();
+                return false;
+            }
+            texture_paths_.push_back(path_data);
+            path_data = path_end + 1;
+        }
+        const int32_t* textures = reinterpret_cast<const int32_t*>(data + header->textures);
+        for (uint64_t i = 0; i < n_blocks; i++) {
+            if (textures[i] != NO_TEXTURE && (textures[i] < 0 || uint32_t(textures[i]) >= header->n_textures)) {
+                std::cout << "Scene " << path << " block " << i << " has no texture " << textures[i] << std::endl;
+                close();
+                return false;
+            }
+        }
+        data_ = data;
+        header_ = header;
+        return true;
+    }
+};
+
+}
+
+#endif
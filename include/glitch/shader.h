@@ -4,11 +4,29 @@
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
 
 #include <string>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
+
+#include <glitch/gl_state.h>
+#include <glitch/stream_buffer.h>
+
+// uniform block binding point shared by every program that declares the Camera block
+const unsigned int CAMERA_BLOCK_BINDING = 0;
+
+// Resolved uniform location, typed so it can only be set with a matching value
+template<typename T>
+struct Uniform
+{
+    int location;
+    Uniform() : location(-1) {}
+    explicit Uniform(int location) : location(location) {}
+};
 
 class Shader
 {
@@ -69,41 +87,123 @@ public:
         // delete the shaders as they're linked into our program now and no longer necessary
         glDeleteShader(vertex);
         glDeleteShader(fragment);
+        // 3. resolve uniform locations and block bindings once, so setting them never queries GL
+        cacheUniformLocations();
+        bindUniformBlock("Camera", CAMERA_BLOCK_BINDING);
+    }
+    // wraps a program that is already linked, e.g. built by gfx::ShaderLibrary
+    // ------------------------------------------------------------------------
+    explicit Shader(unsigned int program)
+        : ID(program)
+    {
+        cacheUniformLocations();
+        bindUniformBlock("Camera", CAMERA_BLOCK_BINDING);
     }
     // activate the shader
     // ------------------------------------------------------------------------
     void use() 
     { 
-        glUseProgram(ID); 
+        gfx::GLState::instance().useProgram(ID);
     }
-    // utility uniform functions
+    // look up a uniform once and keep the handle around for the hot path
+    // ------------------------------------------------------------------------
+    template<typename T>
+    Uniform<T> uniform(const std::string &name) const
+    {
+        return Uniform<T>(uniformLocation(name));
+    }
+    // ------------------------------------------------------------------------
+    int uniformLocation(const std::string &name) const
+    {
+        std::unordered_map<std::string, int>::const_iterator it = uniform_locations_.find(name);
+        return (it != uniform_locations_.end()) ? it->second : -1;
+    }
+    // ------------------------------------------------------------------------
+    void bindUniformBlock(const std::string &name, unsigned int binding) const
+    {
+        unsigned int index = glGetUniformBlockIndex(ID, name.c_str());
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID, index, binding);
+    }
+    // utility uniform functions, the program must be in use
+    // ------------------------------------------------------------------------
+    void set(Uniform<bool> uniform, bool value) const
+    {
+        glUniform1i(uniform.location, (int)value);
+    }
+    // ------------------------------------------------------------------------
+    void set(Uniform<int> uniform, int value) const
+    {
+        glUniform1i(uniform.location, value);
+    }
+    // ------------------------------------------------------------------------
+    void set(Uniform<float> uniform, float value) const
+    {
+        glUniform1f(uniform.location, value);
+    }
+    // ------------------------------------------------------------------------
+    void set(Uniform<glm::vec4> uniform, const glm::vec4 &value) const
+    {
+        glUniform4fv(uniform.location, 1, glm::value_ptr(value));
+    }
+    // ------------------------------------------------------------------------
+    void set(Uniform<glm::mat4> uniform, const glm::mat4 &value) const
+    {
+        glUniformMatrix4fv(uniform.location, 1, GL_FALSE, glm::value_ptr(value));
+    }
+    // by name, still avoids glGetUniformLocation but hashes the name every call
     // ------------------------------------------------------------------------
     void setBool(const std::string &name, bool value) const
     {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+        glUniform1i(uniformLocation(name), (int)value); 
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string &name, int value) const
     { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1i(uniformLocation(name), value); 
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string &name, float value) const
     { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1f(uniformLocation(name), value); 
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string &name, glm::vec4 value) const
     { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, glm::value_ptr(value)); 
+        glUniform4fv(uniformLocation(name), 1, glm::value_ptr(value)); 
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string &name, glm::mat4 value) const
     { 
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(value)); 
+        glUniformMatrix4fv(uniformLocation(name), 1, GL_FALSE, glm::value_ptr(value)); 
     }
 
 private:
+    std::unordered_map<std::string, int> uniform_locations_;
+
+    // query every active uniform after linking
+    // ------------------------------------------------------------------------
+    void cacheUniformLocations()
+    {
+        int n_uniforms = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &n_uniforms);
+        char name[256];
+        for (int i = 0; i < n_uniforms; i++)
+        {
+            int length, size;
+            unsigned int type;
+            glGetActiveUniform(ID, i, sizeof(name), &length, &size, &type, name);
+            int location = glGetUniformLocation(ID, name);
+            if (location < 0)
+                continue; // lives in a uniform block
+            std::string uniform_name(name, length);
+            // arrays are reported as "name[0]", allow looking them up by "name" too
+            if (uniform_name.size() > 3 && uniform_name.compare(uniform_name.size() - 3, 3, "[0]") == 0)
+                uniform_locations_[uniform_name.substr(0, uniform_name.size() - 3)] = location;
+            uniform_locations_[uniform_name] = location;
+        }
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(unsigned int shader, std::string type)
@@ -130,4 +230,55 @@ private:
         }
     }
 };
+
+// std140 layout of the Camera uniform block
+struct CameraBlock
+{
+    glm::mat4 projection;
+    glm::mat4 view;
+};
+
+// Uniform buffer holding the camera matrices, written once per frame and
+// shared by every program through CAMERA_BLOCK_BINDING
+class CameraUniforms
+{
+public:
+    unsigned int ID;
+
+    CameraUniforms()
+    {
+        glGenBuffers(1, &ID);
+        gfx::GLState::instance().bindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraBlock), NULL, GL_DYNAMIC_DRAW);
+        gfx::GLState::instance().bindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, ID);
+    }
+    // ------------------------------------------------------------------------
+    void update(const glm::mat4 &projection, const glm::mat4 &view)
+    {
+        CameraBlock block = { projection, view };
+        gfx::GLState::instance().bindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, ID);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraBlock), &block);
+    }
+    // write the block to this frame's region of stream and bind that range instead
+    // ------------------------------------------------------------------------
+    void update(const glm::mat4 &projection, const glm::mat4 &view, gfx::StreamBuffer &stream)
+    {
+        gfx::StreamBuffer::Allocation allocation = stream.allocate(sizeof(CameraBlock), stream.uniformAlignment());
+        if (!allocation.data)
+        {
+            update(projection, view);
+            return;
+        }
+        CameraBlock block = { projection, view };
+        std::memcpy(allocation.data, &block, sizeof(CameraBlock));
+        stream.commit(allocation);
+        gfx::GLState::instance().bindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, stream.buffer(), allocation.offset, sizeof(CameraBlock));
+    }
+    // ------------------------------------------------------------------------
+    void deallocate()
+    {
+        glDeleteBuffers(1, &ID);
+        gfx::GLState::instance().forgetBuffer(ID);
+    }
+};
 #endif
\ No newline at end of file
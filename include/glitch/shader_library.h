@@ -0,0 +1,382 @@
+#ifndef SHADER_LIBRARY_H
+#define SHADER_LIBRARY_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#include <sys/stat.h>
+
+#include <glad/glad.h>
+
+#include <glitch/shader.h>
+
+namespace gfx {
+
+namespace shader_cache_format {
+    const char MAGIC[4] = { 'G', 'L', 'P', 'B' };
+}
+
+// Builds every shader program of the game at startup. compile() issues all
+// the compiles and links without looking at a single status, so drivers with
+// KHR_parallel_shader_compile (or the ARB version) work on them in parallel
+// while the caller does other loading; finish() then checks them.
+//
+// Linked programs are cached in cache_directory with glGetProgramBinary,
+// keyed by a hash of both sources and the driver's vendor, renderer and
+// version strings. A cached binary the driver turns down (or any program
+// whose sources or driver changed) is compiled from source and re-cached.
+//
+// Cache file: "GLPB" | key u64 | binary format u32 | length u32 | binary
+class ShaderLibrary {
+  public:
+    typedef unsigned int ProgramId;
+
+    struct Stats {
+        unsigned int n_programs;
+        unsigned int n_cached; // loaded from a binary
+        unsigned int n_stale; // had a binary the driver rejected
+        double ms; // spent in compile() and finish()
+    };
+
+    explicit ShaderLibrary(const std::string& cache_directory):
+        cache_directory_(cache_directory),
+        use_binaries_(false),
+        parallel_(false)
+    {
+        stats_ = Stats { 0, 0, 0, 0.0 };
+    }
+
+    // the program is built by the next compile() and usable after finish()
+    ProgramId add(const std::string& vertex_path, const std::string& fragment_path) {
+        programs_.push_back(Program());
+        programs_.back().vertex_path = vertex_path;
+        programs_.back().fragment_path = fragment_path;
+        return programs_.size() - 1;
+    }
+
+    // start building every program, false when a source can't be read
+    bool compile() {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::string driver;
+        for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+            const GLubyte* value = glGetString(name);
+            driver += value ? reinterpret_cast<const char*>(value) : "";
+            driver += '\n';
+        }
+        use_binaries_ = binariesSupported();
+        if (use_binaries_) {
+            mkdir(cache_directory_.c_str(), 0755);
+        }
+        parallel_ = startParallelCompile();
+
+        stats_.n_programs = programs_.size();
+        stats_.n_cached = stats_.n_stale = 0;
+        bool sources_read = true;
+        for (Program& program : programs_) {
+            if (!readFile(program.vertex_path, program.vertex_source) || !readFile(program.fragment_path, program.fragment_source)) {
+                sources_read = false;
+                continue;
+            }
+            program.key = hash(program.vertex_source + '\0' + program.fragment_source + '\0' + driver);
+            if (use_binaries_ && loadBinary(program)) {
+                stats_.n_cached++;
+            }
+        }
+        if (!sources_read) {
+            return false;
+        }
+
+        // everything that's not cached, compiles first and links after so
+        // a parallel driver sees all of them before we wait on any
+        for (Program& program : programs_) {
+            if (!program.from_cache) {
+                program.vertex = compileShader(GL_VERTEX_SHADER, program.vertex_source);
+                program.fragment = compileShader(GL_FRAGMENT_SHADER, program.fragment_source);
+            }
+        }
+        for (Program& program : programs_) {
+            if (!program.from_cache) {
+                program.id = glCreateProgram();
+                glAttachShader(program.id, program.vertex);
+                glAttachShader(program.id, program.fragment);
+#ifdef GL_ARB_get_program_binary
+                if (use_binaries_) {
+                    glProgramParameteri(program.id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+                }
+#endif
+                glLinkProgram(program.id);
+            }
+        }
+        stats_.ms = millisecondsSince(start);
+        return true;
+    }
+
+    // whether finish() would return without waiting on the driver. always
+    // true without parallel compile, where finish() is what does the waiting
+    bool ready() const {
+#if defined(GL_KHR_parallel_shader_compile) || defined(GL_ARB_parallel_shader_compile)
+        // GL_COMPLETION_STATUS_KHR, the ARB extension uses the same value
+        const GLenum COMPLETION_STATUS = 0x91B1;
+        if (parallel_) {
+            for (const Program& program : programs_) {
+                int done = GL_TRUE;
+                if (!program.from_cache) {
+                    glGetProgramiv(program.id, COMPLETION_STATUS, &done);
+                }
+                if (!done) {
+                    return false;
+                }
+            }
+        }
+#endif
+        return true;
+    }
+
+    // wait for every program, report errors and cache the new binaries.
+    // false when any program failed to build
+    bool finish() {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        bool built = true;
+        for (Program& program : programs_) {
+            if (!program.from_cache) {
+                // & rather than && so every log gets printed
+                bool linked = checkShader(program.vertex, program.vertex_path)
+                    & checkShader(program.fragment, program.fragment_path)
+                    & checkProgram(program);
+                glDetachShader(program.id, program.vertex);
+                glDetachShader(program.id, program.fragment);
+                glDeleteShader(program.vertex);
+                glDeleteShader(program.fragment);
+                if (!linked) {
+                    built = false;
+                    continue;
+                }
+                if (use_binaries_) {
+                    saveBinary(program);
+                }
+            }
+            program.shader.reset(new Shader(program.id));
+            // the sources are no longer needed
+            program.vertex_source.clear();
+            program.fragment_source.clear();
+        }
+        stats_.ms += millisecondsSince(start);
+        return built;
+    }
+
+    // only after finish()
+    Shader& program(ProgramId id) {
+        return *programs_[id].shader;
+    }
+
+    const Stats& stats() const {
+        return stats_;
+    }
+
+    void deallocate() {
+        for (Program& program : programs_) {
+            if (program.id) {
+                GLState::instance().forgetProgram(program.id);
+                glDeleteProgram(program.id);
+                program.id = 0;
+            }
+        }
+    }
+
+  private:
+    struct Program {
+        std::string vertex_path;
+        std::string fragment_path;
+        std::string vertex_source;
+        std::string fragment_source;
+        uint64_t key = 0;
+        unsigned int id = 0;
+        unsigned int vertex = 0;
+        unsigned int fragment = 0;
+        bool from_cache = false;
+        std::unique_ptr<Shader> shader;
+    };
+
+    std::string cache_directory_;
+    std::vector<Program> programs_;
+    bool use_binaries_;
+    bool parallel_;
+    Stats stats_;
+
+    static double millisecondsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    static bool readFile(const std::string& path, std::string& out) {
+        std::ifstream file(path.c_str(), std::ios::binary);
+        if (!file) {
+            std::cout << "Failed to read shader " << path << std::endl;
+            return false;
+        }
+        std::stringstream stream;
+        stream << file.rdbuf();
+        out = stream.str();
+        return true;
+    }
+
+    // FNV-1a
+    static uint64_t hash(const std::string& data) {
+        uint64_t h = 14695981039346656037ull;
+        for (unsigned char c : data) {
+            h = (h ^ c) * 1099511628211ull;
+        }
+        return h;
+    }
+
+    static bool binariesSupported() {
+#ifdef GL_ARB_get_program_binary
+        if (GLAD_GL_ARB_get_program_binary) {
+            int n_formats = 0;
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &n_formats);
+            return n_formats > 0;
+        }
+#endif
+        return false;
+    }
+
+    // let the driver use as many compiler threads as it likes
+    static bool startParallelCompile() {
+#ifdef GL_KHR_parallel_shader_compile
+        if (GLAD_GL_KHR_parallel_shader_compile) {
+            glMaxShaderCompilerThreadsKHR(0xffffffffu);
+            return true;
+        }
+#endif
+#ifdef GL_ARB_parallel_shader_compile
+        if (GLAD_GL_ARB_parallel_shader_compile) {
+            glMaxShaderCompilerThreadsARB(0xffffffffu);
+            return true;
+        }
+#endif
+        return false;
+    }
+
+    std::string cachePath(const Program& program) const {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(program.key));
+        return cache_directory_ + "/" + name;
+    }
+
+    static unsigned int compileShader(GLenum type, const std::string& source) {
+        const char* code = source.c_str();
+        unsigned int shader = glCreateShader(type);
+        glShaderSource(shader, 1, &code, NULL);
+        glCompileShader(shader);
+        return shader;
+    }
+
+    static bool checkShader(unsigned int shader, const std::string& path) {
+        int success = 0;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if (!success) {
+            char log[1024];
+            glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+            std::cout << "Failed to compile shader " << path << "\n" << log << std::endl;
+        }
+        return success;
+    }
+
+    static bool checkProgram(const Program& program) {
+        int success = 0;
+        glGetProgramiv(program.id, GL_LINK_STATUS, &success);
+        if (!success) {
+            char log[1024];
+            glGetProgramInfoLog(program.id, sizeof(log), NULL, log);
+            std::cout << "Failed to link " << program.vertex_path << " with " << program.fragment_path << "\n" << log << std::endl;
+        }
+        return success;
+    }
+
+    bool loadBinary(Program& program) {
+#ifdef GL_ARB_get_program_binary
+        std::ifstream file(cachePath(program).c_str(), std::ios::binary | std::ios::ate);
+        if (!file) {
+            return false;
+        }
+        const std::streamoff file_size = file.tellg();
+        file.seekg(0);
+        char magic[4];
+        uint64_t key = 0;
+        uint32_t format = 0;
+        uint32_t length = 0;
+        file.read(magic, 4);
+        file.read(reinterpret_cast<char*>(&key), sizeof(key));
+        file.read(reinterpret_cast<char*>(&format), sizeof(format));
+        file.read(reinterpret_cast<char*>(&length), sizeof(length));
+        std::vector<char> binary;
+        if (file && length <= file_size) {
+            binary.resize(length);
+            file.read(binary.data(), length);
+        }
+        if (!file || binary.size() != length || std::memcmp(magic, shader_cache_format::MAGIC, 4) != 0 || key != program.key) {
+            stats_.n_stale++;
+            return false;
+        }
+
+        program.id = glCreateProgram();
+        glProgramBinary(program.id, format, binary.data(), length);
+        int success = 0;
+        glGetProgramiv(program.id, GL_LINK_STATUS, &success);
+        if (!success) {
+            // e.g. the driver was updated without its version string changing
+            glDeleteProgram(program.id);
+            program.id = 0;
+            stats_.n_stale++;
+            return false;
+        }
+        program.from_cache = true;
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // written next to the final file and renamed over it, so a crash never leaves half a binary
+    void saveBinary(const Program& program) const {
+#ifdef GL_ARB_get_program_binary
+        int length = 0;
+        glGetProgramiv(program.id, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) {
+            return;
+        }
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(program.id, length, &length, &format, binary.data());
+
+        const std::string path = cachePath(program);
+        const std::string temporary = path + ".tmp";
+        {
+            std::ofstream file(temporary.c_str(), std::ios::binary | std::ios::trunc);
+            const uint32_t format32 = format;
+            const uint32_t length32 = length;
+            file.write(shader_cache_format::MAGIC, 4);
+            file.write(reinterpret_cast<const char*>(&program.key), sizeof(program.key));
+            file.write(reinterpret_cast<const char*>(&format32), sizeof(format32));
+            file.write(reinterpret_cast<const char*>(&length32), sizeof(length32));
+            file.write(binary.data(), length);
+            if (!file) {
+                std::cout << "Failed to write shader cache " << temporary << std::endl;
+                return;
+            }
+        }
+        std::rename(temporary.c_str(), path.c_str());
+#endif
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,176 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include <vector>
+#include <iostream>
+
+#include <glad/glad.h>
+
+#include <glitch/gl_state.h>
+
+namespace gfx {
+
+// Scratch GPU memory for data that changes every frame. One buffer is split
+// into n_regions regions and frame i allocates from region i % n_regions, so
+// nothing is ever reallocated by the driver. A fence at the end of each frame
+// stops the CPU from reusing a region while the GPU may still be reading it.
+// With ARB_buffer_storage the buffer is mapped once, persistently; otherwise
+// every allocation maps its own range unsynchronized, which the fences make safe.
+class StreamBuffer {
+  public:
+    // where to write and the byte offset of that in buffer(), data is NULL
+    // when the region is full
+    struct Allocation {
+        void* data;
+        unsigned int offset;
+        unsigned int size;
+    };
+
+    struct Stats {
+        unsigned int bytes_used;
+        unsigned int n_allocations;
+        unsigned int n_overflows;
+        unsigned int n_waits;
+    };
+
+    StreamBuffer(unsigned int region_bytes, unsigned int n_regions = 3):
+        region_bytes_(region_bytes),
+        n_regions_(n_regions),
+        region_(0),
+        head_(0),
+        frame_open_(false),
+        mapped_(NULL),
+        persistent_(GLAD_GL_ARB_buffer_storage != 0)
+    {
+        stats_ = Stats { 0, 0, 0, 0 };
+        fences_.resize(n_regions, (GLsync)0);
+
+        int uniform_alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniform_alignment);
+        uniform_alignment_ = uniform_alignment;
+
+        const unsigned int size = region_bytes_ * n_regions_;
+        glGenBuffers(1, &id_);
+        GLState::instance().bindBuffer(GL_COPY_WRITE_BUFFER, id_);
+        if (persistent_) {
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, flags);
+            mapped_ = static_cast<unsigned char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags));
+        } else {
+            glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STREAM_DRAW);
+        }
+    }
+
+    // move on to the next region, waiting for the GPU only if it still reads from it
+    void beginFrame() {
+        region_ = (region_ + 1) % n_regions_;
+        head_ = 0;
+        frame_open_ = true;
+        stats_ = Stats { 0, 0, 0, 0 };
+
+        GLsync fence = fences_[region_];
+        if (!fence) {
+            return;
+        }
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        if (result == GL_TIMEOUT_EXPIRED) {
+            stats_.n_waits++;
+            // flush once so the fence can signal at all, then keep waiting
+            GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+            do {
+                result = glClientWaitSync(fence, flags, 1000000);
+                flags = 0;
+            } while (result == GL_TIMEOUT_EXPIRED);
+        }
+        if (result == GL_WAIT_FAILED) {
+            std::cout << "StreamBuffer: fence wait failed" << std::endl;
+        }
+        glDeleteSync(fence);
+        fences_[region_] = (GLsync)0;
+    }
+
+    // fence the region once every draw reading from it has been issued
+    void endFrame() {
+        fences_[region_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        frame_open_ = false;
+    }
+
+    // room for bytes in this frame's region, offset aligned to alignment (a power of two).
+    // write the data, then commit before drawing with it or allocating again
+    Allocation allocate(unsigned int bytes, unsigned int alignment = 16) {
+        const unsigned int start = (head_ + alignment - 1) & ~(alignment - 1);
+        if (!frame_open_ || start + bytes > region_bytes_) {
+            stats_.n_overflows++;
+            return Allocation { NULL, 0, 0 };
+        }
+        head_ = start + bytes;
+        stats_.bytes_used = head_;
+        stats_.n_allocations++;
+
+        const unsigned int offset = region_ * region_bytes_ + start;
+        if (persistent_) {
+            return Allocation { mapped_ + offset, offset, bytes };
+        }
+        GLState::instance().bindBuffer(GL_COPY_WRITE_BUFFER, id_);
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT;
+        return Allocation { glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, bytes, flags), offset, bytes };
+    }
+
+    void commit(const Allocation& allocation) {
+        if (!persistent_ && allocation.data) {
+            GLState::instance().bindBuffer(GL_COPY_WRITE_BUFFER, id_);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        }
+    }
+
+    // offsets of uniform ranges have to be multiples of this
+    unsigned int uniformAlignment() const {
+        return uniform_alignment_;
+    }
+
+    unsigned int buffer() const {
+        return id_;
+    }
+
+    bool persistent() const {
+        return persistent_;
+    }
+
+    // for the current frame so far
+    const Stats& stats() const {
+        return stats_;
+    }
+
+    void deallocate() {
+        for (GLsync& fence : fences_) {
+            if (fence) {
+                glDeleteSync(fence);
+                fence = (GLsync)0;
+            }
+        }
+        if (mapped_) {
+            GLState::instance().bindBuffer(GL_COPY_WRITE_BUFFER, id_);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            mapped_ = NULL;
+        }
+        glDeleteBuffers(1, &id_);
+        GLState::instance().forgetBuffer(id_);
+    }
+
+  private:
+    unsigned int id_;
+    unsigned int region_bytes_;
+    unsigned int n_regions_;
+    unsigned int region_;
+    unsigned int head_;
+    unsigned int uniform_alignment_;
+    bool frame_open_;
+    unsigned char* mapped_;
+    bool persistent_;
+    std::vector<GLsync> fences_;
+    Stats stats_;
+};
+
+}
+
+#endif
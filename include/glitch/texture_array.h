@@ -0,0 +1,170 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <vector>
+#include <algorithm>
+
+#include <glad/glad.h>
+
+#include <glitch/gl_state.h>
+#include <glitch/graphics.h>
+
+namespace gfx {
+
+// resample an RGBA image to width x height with bilinear filtering
+inline void resizeRgba(const unsigned char* src, int src_width, int src_height,
+                       unsigned char* dst, int width, int height) {
+    for (int y = 0; y < height; y++) {
+        const float sy = std::max(0.0f, (y + 0.5f) * src_height / height - 0.5f);
+        const int y0 = std::min(static_cast<int>(sy), src_height - 1);
+        const int y1 = std::min(y0 + 1, src_height - 1);
+        const float fy = sy - y0;
+        for (int x = 0; x < width; x++) {
+            const float sx = std::max(0.0f, (x + 0.5f) * src_width / width - 0.5f);
+            const int x0 = std::min(static_cast<int>(sx), src_width - 1);
+            const int x1 = std::min(x0 + 1, src_width - 1);
+            const float fx = sx - x0;
+            for (int c = 0; c < 4; c++) {
+                const float top = src[(y0 * src_width + x0) * 4 + c] * (1 - fx) + src[(y0 * src_width + x1) * 4 + c] * fx;
+                const float bottom = src[(y1 * src_width + x0) * 4 + c] * (1 - fx) + src[(y1 * src_width + x1) * 4 + c] * fx;
+                dst[(y * width + x) * 4 + c] = static_cast<unsigned char>(top * (1 - fy) + bottom * fy + 0.5f);
+            }
+        }
+    }
+}
+
+// Block textures as layers of one GL_TEXTURE_2D_ARRAY, so blocks with
+// different textures share a program, a binding and an instanced draw; each
+// instance picks its layer. Every layer is width x height RGBA, images of
+// another size are resampled on the way in. Storage is allocated for
+// capacity layers up front and adding a layer only uploads that layer; when
+// the array is full it doubles, copying the old layers on the GPU.
+class TextureArray {
+  public:
+    TextureArray(int width, int height, const std::vector<Texture::Param>& params, unsigned int capacity = 8):
+        width_(width),
+        height_(height),
+        n_layers_(0),
+        capacity_(std::max(capacity, 1u)),
+        params_(params)
+    {
+        id_ = createStorage(capacity_);
+    }
+
+    // a new white layer, fill it in later with setLayer or setLayerRows
+    unsigned int addLayer() {
+        std::vector<unsigned char> white(width_ * height_ * 4, 255);
+        return addLayer(&white[0], width_, height_);
+    }
+
+    unsigned int addLayer(const unsigned char* rgba, int width, int height) {
+        if (n_layers_ == capacity_) {
+            grow(capacity_ * 2);
+        }
+        unsigned int layer = n_layers_++;
+        setLayer(layer, rgba, width, height);
+        return layer;
+    }
+
+    // replace a layer's image and rebuild mipmaps
+    void setLayer(unsigned int layer, const unsigned char* rgba, int width, int height) {
+        if (width == width_ && height == height_) {
+            setLayerRows(layer, 0, height_, rgba);
+        } else {
+            std::vector<unsigned char> resized(width_ * height_ * 4);
+            resizeRgba(rgba, width, height, &resized[0], width_, height_);
+            setLayerRows(layer, 0, height_, &resized[0]);
+        }
+        generateMipmaps();
+    }
+
+    // upload rows [first_row, first_row + n_rows) of a layer, data may be an
+    // offset into a bound pixel unpack buffer. mipmaps are left to the caller
+    void setLayerRows(unsigned int layer, int first_row, int n_rows, const void* data) {
+        GLState::instance().bindTexture(GL_TEXTURE_2D_ARRAY, id_);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, first_row, layer, width_, n_rows, 1, GL_RGBA, GL_UNSIGNED_BYTE, data);
+    }
+
+    void generateMipmaps() {
+        GLState::instance().bindTexture(GL_TEXTURE_2D_ARRAY, id_);
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    }
+
+    // unit is GL_TEXTURE0 + n
+    void activeBindTexture(int unit) {
+        GLState::instance().bindTextureUnit(unit, GL_TEXTURE_2D_ARRAY, id_);
+    }
+
+    // changes when the array grows
+    unsigned int id() const {
+        return id_;
+    }
+
+    int width() const {
+        return width_;
+    }
+
+    int height() const {
+        return height_;
+    }
+
+    unsigned int size() const {
+        return n_layers_;
+    }
+
+    unsigned int capacity() const {
+        return capacity_;
+    }
+
+    void deallocate() {
+        glDeleteTextures(1, &id_);
+        GLState::instance().forgetTexture(id_);
+    }
+
+  private:
+    unsigned int id_;
+    int width_;
+    int height_;
+    unsigned int n_layers_;
+    unsigned int capacity_;
+    std::vector<Texture::Param> params_;
+
+    unsigned int createStorage(unsigned int capacity) {
+        unsigned int id;
+        glGenTextures(1, &id);
+        GLState::instance().bindTexture(GL_TEXTURE_2D_ARRAY, id);
+        for (Texture::Param param : params_) {
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, param.param, param.value);
+        }
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width_, height_, capacity, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        return id;
+    }
+
+    // copy every layer into a bigger array through a read framebuffer, nothing goes back through the CPU
+    void grow(unsigned int capacity) {
+        unsigned int old_id = id_;
+        id_ = createStorage(capacity);
+        capacity_ = capacity;
+
+        int previous_read_fbo = 0;
+        glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previous_read_fbo);
+        unsigned int fbo;
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+        for (unsigned int layer = 0; layer < n_layers_; layer++) {
+            glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, old_id, 0, layer);
+            glCopyTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, 0, 0, width_, height_);
+        }
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, previous_read_fbo);
+        glDeleteFramebuffers(1, &fbo);
+        generateMipmaps();
+
+        glDeleteTextures(1, &old_id);
+        GLState::instance().forgetTexture(old_id);
+    }
+};
+
+}
+
+#endif
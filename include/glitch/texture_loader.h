@@ -0,0 +1,282 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <glitch/graphics.h>
+#include <glitch/texture_array.h>
+
+namespace gfx {
+
+// Loads textures without stalling the render thread. Worker threads decode
+// image files, then update() streams the decoded rows to GL through a pixel
+// buffer object, at most upload_budget bytes per frame. Until a texture is
+// fully uploaded its handle resolves to a 1x1 white placeholder, layers of a
+// TextureArray stay white.
+class TextureLoader {
+  public:
+    typedef unsigned int Handle;
+
+    TextureLoader(unsigned int n_workers = 2, unsigned int upload_budget = 4 * 1024 * 1024):
+        upload_budget_(upload_budget),
+        stopping_(false),
+        placeholder_(GL_TEXTURE_2D, {})
+    {
+        const unsigned char white[4] = { 255, 255, 255, 255 };
+        placeholder_.setImage(1, 1, 4, white);
+        glGenBuffers(1, &pbo_);
+        for (unsigned int i = 0; i < n_workers; i++) {
+            workers_.push_back(std::thread(&TextureLoader::work, this));
+        }
+    }
+
+    ~TextureLoader() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread& worker : workers_) {
+            worker.join();
+        }
+        // anything decoded but never uploaded
+        for (Image& image : decoded_) {
+            freeImage(image);
+        }
+        for (Upload& upload : uploads_) {
+            freeImage(upload.image);
+        }
+    }
+
+    // queue a file for decoding, the texture object exists right away
+    Handle load(const std::string& image_path, const std::vector<Texture::Param>& params, unsigned int type = GL_TEXTURE_2D) {
+        Handle handle = textures_.size();
+        textures_.push_back(Texture(type, params));
+        ready_.push_back(false);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.push_back(Job { handle, image_path, NULL, 0 });
+        }
+        wake_.notify_one();
+        return handle;
+    }
+
+    // queue a file for a new layer of array, returns the layer index right away.
+    // the image is converted to RGBA and resampled to the layer size on a worker
+    unsigned int loadLayer(const std::string& image_path, TextureArray& array) {
+        unsigned int layer = array.addLayer();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.push_back(Job { 0, image_path, &array, layer });
+        }
+        wake_.notify_one();
+        return layer;
+    }
+
+    // the texture if it is ready, the placeholder otherwise
+    Texture& texture(Handle handle) {
+        return ready_[handle] ? textures_[handle] : placeholder_;
+    }
+
+    bool ready(Handle handle) const {
+        return ready_[handle];
+    }
+
+    bool idle() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return jobs_.empty() && decoded_.empty() && uploads_.empty() && n_decoding_ == 0;
+    }
+
+    // call once per frame on the thread that owns the GL context
+    void update() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            while (!decoded_.empty()) {
+                uploads_.push_back(Upload { decoded_.front(), 0 });
+                decoded_.pop_front();
+            }
+        }
+
+        unsigned int budget = upload_budget_;
+        while (!uploads_.empty() && budget > 0) {
+            Upload& upload = uploads_.front();
+            budget -= uploadRows(upload, budget);
+            if (upload.rows_done == upload.image.height) {
+                finish(upload);
+                uploads_.pop_front();
+            }
+        }
+    }
+
+    void deallocate() {
+        for (Texture& texture : textures_) {
+            texture.deallocate();
+        }
+        placeholder_.deallocate();
+        glDeleteBuffers(1, &pbo_);
+        GLState::instance().forgetBuffer(pbo_);
+    }
+
+  private:
+    struct Job {
+        Handle handle;
+        std::string path;
+        TextureArray* array; // NULL unless loading a layer
+        unsigned int layer;
+    };
+
+    struct Image {
+        Handle handle;
+        TextureArray* array;
+        unsigned int layer;
+        int width;
+        int height;
+        int n_channels;
+        unsigned char* data; // owned, from stbi_load or new[] when resized
+        bool resized;
+    };
+
+    struct Upload {
+        Image image;
+        int rows_done;
+    };
+
+    unsigned int upload_budget_;
+    unsigned int pbo_;
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_;
+    unsigned int n_decoding_ = 0;
+    std::deque<Job> jobs_;
+    std::deque<Image> decoded_;
+
+    // only touched on the GL thread
+    std::deque<Upload> uploads_;
+    std::vector<Texture> textures_;
+    std::vector<bool> ready_;
+    Texture placeholder_;
+
+    void work() {
+        stbi_set_flip_vertically_on_load_thread(true);
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+                if (stopping_) {
+                    return;
+                }
+                job = jobs_.front();
+                jobs_.pop_front();
+                n_decoding_++;
+            }
+
+            Image image;
+            image.handle = job.handle;
+            image.array = job.array;
+            image.layer = job.layer;
+            image.resized = false;
+            if (!job.array) {
+                image.data = stbi_load(job.path.c_str(), &image.width, &image.height, &image.n_channels, 0);
+            } else {
+                // layers are always RGBA at the array's size
+                image.data = stbi_load(job.path.c_str(), &image.width, &image.height, &image.n_channels, 4);
+                image.n_channels = 4;
+                if (image.data && (image.width != job.array->width() || image.height != job.array->height())) {
+                    unsigned char* resized = new unsigned char[job.array->width() * job.array->height() * 4];
+                    resizeRgba(image.data, image.width, image.height, resized, job.array->width(), job.array->height());
+                    stbi_image_free(image.data);
+                    image.data = resized;
+                    image.resized = true;
+                    image.width = job.array->width();
+                    image.height = job.array->height();
+                }
+            }
+            if (!image.data) {
+                std::cout << "Failed to load texture " << job.path << std::endl;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            n_decoding_--;
+            if (image.data) {
+                decoded_.push_back(image);
+            }
+        }
+    }
+
+    void freeImage(Image& image) {
+        if (image.resized) {
+            delete[] image.data;
+        } else {
+            stbi_image_free(image.data);
+        }
+    }
+
+    // stream as many whole rows as fit in budget (at least one), returns bytes used
+    unsigned int uploadRows(Upload& upload, unsigned int budget) {
+        Image& image = upload.image;
+        int internal_format;
+        unsigned int format;
+        textureFormats(image.n_channels, internal_format, format);
+
+        if (!image.array) {
+            Texture& texture = textures_[image.handle];
+            GLState::instance().bindTexture(texture.type(), texture.id());
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            if (upload.rows_done == 0) {
+                // allocate storage, rows are filled in below
+                glTexImage2D(texture.type(), 0, internal_format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, NULL);
+            }
+        }
+
+        const unsigned int row_bytes = image.width * image.n_channels;
+        int n_rows = std::max(1u, budget / row_bytes);
+        n_rows = std::min(n_rows, image.height - upload.rows_done);
+        const unsigned int n_bytes = n_rows * row_bytes;
+
+        // orphan the pbo so we never wait on a transfer still in flight
+        GLState::instance().bindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo_);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, n_bytes, NULL, GL_STREAM_DRAW);
+        void* dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, n_bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        std::memcpy(dst, image.data + upload.rows_done * row_bytes, n_bytes);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        if (image.array) {
+            image.array->setLayerRows(image.layer, upload.rows_done, n_rows, (void*)0);
+        } else {
+            Texture& texture = textures_[image.handle];
+            glTexSubImage2D(texture.type(), 0, 0, upload.rows_done, image.width, n_rows, format, GL_UNSIGNED_BYTE, (void*)0);
+        }
+        GLState::instance().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        upload.rows_done += n_rows;
+        return std::min(n_bytes, budget);
+    }
+
+    void finish(Upload& upload) {
+        if (upload.image.array) {
+            upload.image.array->generateMipmaps();
+        } else {
+            Texture& texture = textures_[upload.image.handle];
+            GLState::instance().bindTexture(texture.type(), texture.id());
+            glGenerateMipmap(texture.type());
+            ready_[upload.image.handle] = true;
+        }
+        freeImage(upload.image);
+    }
+};
+
+}
+
+#endif
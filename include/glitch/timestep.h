@@ -0,0 +1,64 @@
+#ifndef TIMESTEP_H
+#define TIMESTEP_H
+
+#include <algorithm>
+
+// Hands out real frame time in fixed size simulation ticks.
+// Leftover time stays in the accumulator and alpha() says how far the
+// renderer is between the previous and the current simulation state.
+class FixedTimestep {
+  public:
+    FixedTimestep(double tick_rate, unsigned int max_ticks_per_frame = 8):
+        accumulator_(0.0),
+        max_ticks_per_frame_(max_ticks_per_frame),
+        ticks_this_frame_(0)
+    {
+        setTickRate(tick_rate);
+    }
+
+    void setTickRate(double tick_rate) {
+        dt_ = 1.0 / tick_rate;
+    }
+
+    // seconds per tick
+    float dt() const {
+        return static_cast<float>(dt_);
+    }
+
+    // add the real time that passed since the last frame
+    void advance(double frame_time) {
+        // spiral of death clamp: if the simulation can't keep up, drop time
+        // instead of running ever more ticks per frame
+        const double max_frame_time = max_ticks_per_frame_ * dt_;
+        accumulator_ += std::min(std::max(frame_time, 0.0), max_frame_time);
+        ticks_this_frame_ = 0;
+    }
+
+    // consume one tick if enough time has accumulated
+    bool tick() {
+        if (accumulator_ < dt_ || ticks_this_frame_ >= max_ticks_per_frame_) {
+            return false;
+        }
+        accumulator_ -= dt_;
+        ticks_this_frame_++;
+        return true;
+    }
+
+    // real time accumulated but not simulated yet, in seconds
+    double lag() const {
+        return accumulator_;
+    }
+
+    // interpolation factor between the previous and the current tick, in [0, 1]
+    float alpha() const {
+        return static_cast<float>(std::min(accumulator_ / dt_, 1.0));
+    }
+
+  private:
+    double dt_;
+    double accumulator_;
+    unsigned int max_ticks_per_frame_;
+    unsigned int ticks_this_frame_;
+};
+
+#endif
@@ -0,0 +1,489 @@
+#ifndef TRANSFORMS_H
+#define TRANSFORMS_H
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#ifdef __SSE2__
+#define GLITCH_TRANSFORM_SSE
+#include <emmintrin.h>
+#endif
+#ifdef __AVX__
+#define GLITCH_TRANSFORM_AVX
+#include <immintrin.h>
+#endif
+
+namespace gfx {
+
+// Model matrix of a unit cube mesh scaled to scale, turned by yaw radians
+// around +y about pivot (in unit cube coordinates, 0 is the min corner) and
+// moved so pivot ends up at position. The per object reference path.
+inline glm::mat4 modelMatrix(glm::vec3 position, float yaw, glm::vec3 scale, glm::vec3 pivot) {
+    glm::mat4 model = glm::translate(glm::mat4(1.0f), position);
+    model = glm::rotate(model, yaw, glm::vec3(0.0f, 1.0f, 0.0f));
+    model = glm::translate(model, -pivot * scale);
+    return glm::scale(model, scale);
+}
+
+// which kernel Transforms::update() builds matrices with, 4 or 8 per
+// iteration or one at a time
+inline const char* transformPath() {
+#if defined(GLITCH_TRANSFORM_AVX)
+    return "avx";
+#elif defined(GLITCH_TRANSFORM_SSE)
+    return "sse";
+#else
+    return "scalar";
+#endif
+}
+
+#ifdef GLITCH_TRANSFORM_SSE
+// sin and cos of four angles: reduce to [-pi/4, pi/4] around the nearest
+// multiple of pi/2, then the cephes sinf/cosf polynomials. about 1e-7 off
+// std::sin/std::cos for the angles a camera or a model turns through
+inline void sinCosSse(__m128 x, __m128& sin_x, __m128& cos_x) {
+    const __m128i q = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(0.63661977236758134f)));
+    const __m128 qf = _mm_cvtepi32_ps(q);
+    // pi/2 in three parts so q * part stays exact
+    __m128 r = _mm_sub_ps(x, _mm_mul_ps(qf, _mm_set1_ps(1.5703125f)));
+    r = _mm_sub_ps(r, _mm_mul_ps(qf, _mm_set1_ps(4.837512969970703125e-4f)));
+    r = _mm_sub_ps(r, _mm_mul_ps(qf, _mm_set1_ps(7.54978995489188216e-8f)));
+
+    const __m128 r2 = _mm_mul_ps(r, r);
+    __m128 sin_r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-1.9515295891e-4f), r2), _mm_set1_ps(8.3321608736e-3f));
+    sin_r = _mm_add_ps(_mm_mul_ps(sin_r, r2), _mm_set1_ps(-1.6666654611e-1f));
+    sin_r = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sin_r, r2), r), r);
+    __m128 cos_r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.443315711809948e-5f), r2), _mm_set1_ps(-1.388731625493765e-3f));
+    cos_r = _mm_add_ps(_mm_mul_ps(cos_r, r2), _mm_set1_ps(4.166664568298827e-2f));
+    cos_r = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(cos_r, r2), r2), _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(0.5f), r2)));
+
+    // quadrant q mod 4: odd swaps sin and cos, 2 and 3 negate sin, 1 and 2 negate cos
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i two = _mm_set1_epi32(2);
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, one), one));
+    const __m128 sin_negative = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, two), two));
+    const __m128 cos_negative = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_add_epi32(q, one), two), two));
+    sin_x = _mm_or_ps(_mm_and_ps(swap, cos_r), _mm_andnot_ps(swap, sin_r));
+    cos_x = _mm_or_ps(_mm_and_ps(swap, sin_r), _mm_andnot_ps(swap, cos_r));
+    sin_x = _mm_xor_ps(sin_x, _mm_and_ps(sin_negative, sign));
+    cos_x = _mm_xor_ps(cos_x, _mm_and_ps(cos_negative, sign));
+}
+#endif
+
+#ifdef GLITCH_TRANSFORM_AVX
+// eight lane version of sinCosSse, the quadrant is kept in floats since
+// integer ymm ops need avx2
+inline void sinCosAvx(__m256 x, __m256& sin_x, __m256& cos_x) {
+    const __m256 qf = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(0.63661977236758134f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 r = _mm256_sub_ps(x, _mm256_mul_ps(qf, _mm256_set1_ps(1.5703125f)));
+    r = _mm256_sub_ps(r, _mm256_mul_ps(qf, _mm256_set1_ps(4.837512969970703125e-4f)));
+    r = _mm256_sub_ps(r, _mm256_mul_ps(qf, _mm256_set1_ps(7.54978995489188216e-8f)));
+
+    const __m256 r2 = _mm256_mul_ps(r, r);
+    __m256 sin_r = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(-1.9515295891e-4f), r2), _mm256_set1_ps(8.3321608736e-3f));
+    sin_r = _mm256_add_ps(_mm256_mul_ps(sin_r, r2), _mm256_set1_ps(-1.6666654611e-1f));
+    sin_r = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(sin_r, r2), r), r);
+    __m256 cos_r = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(2.443315711809948e-5f), r2), _mm256_set1_ps(-1.388731625493765e-3f));
+    cos_r = _mm256_add_ps(_mm256_mul_ps(cos_r, r2), _mm256_set1_ps(4.166664568298827e-2f));
+    cos_r = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(cos_r, r2), r2), _mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(_mm256_set1_ps(0.5f), r2)));
+
+    const __m256 quadrant = _mm256_sub_ps(qf, _mm256_mul_ps(_mm256_set1_ps(4.0f), _mm256_floor_ps(_mm256_mul_ps(qf, _mm256_set1_ps(0.25f)))));
+    const __m256 is_one = _mm256_cmp_ps(quadrant, _mm256_set1_ps(1.0f), _CMP_EQ_OQ);
+    const __m256 is_two = _mm256_cmp_ps(quadrant, _mm256_set1_ps(2.0f), _CMP_EQ_OQ);
+    const __m256 is_three = _mm256_cmp_ps(quadrant, _mm256_set1_ps(3.0f), _CMP_EQ_OQ);
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 swap = _mm256_or_ps(is_one, is_three);
+    sin_x = _mm256_blendv_ps(sin_r, cos_r, swap);
+    cos_x = _mm256_blendv_ps(cos_r, sin_r, swap);
+    sin_x = _mm256_xor_ps(sin_x, _mm256_and_ps(_mm256_or_ps(is_two, is_three), sign));
+    cos_x = _mm256_xor_ps(cos_x, _mm256_and_ps(_mm256_or_ps(is_one, is_two), sign));
+}
+#endif
+
+// Transforms of the instances of one batch, stored as structure of arrays
+// (x of every transform, then y, ...) so the matrices of four or eight
+// transforms come out of one pass of SIMD instructions. Setters only mark
+// the transform dirty, update() computes the dirty ones and writes them
+// straight into the instance data of the batch.
+//
+// A model matrix here only has eight interesting numbers:
+//   | sx*cos  0   sz*sin  tx |
+//   |   0     sy    0     ty |
+//   | -sx*sin 0   sz*cos  tz |
+//   |   0     0     0     1  |
+// those are kept per transform as well, for modelViewProjection().
+class Transforms {
+  public:
+    typedef unsigned int TransformId;
+
+    Transforms() {}
+
+    // instance is the batch instance the matrix is written to
+    TransformId add(unsigned int instance, glm::vec3 position, float yaw, glm::vec3 scale, glm::vec3 pivot = glm::vec3(0.0f)) {
+        TransformId id;
+        if (free_ids_.empty()) {
+            id = slot_of_id_.size();
+            slot_of_id_.push_back(0);
+        } else {
+            id = free_ids_.back();
+            free_ids_.pop_back();
+        }
+        const unsigned int slot = instance_.size();
+        instance_.push_back(instance);
+        id_of_slot_.push_back(id);
+        slot_of_id_[id] = slot;
+        if (slot >= x_.size()) {
+            grow();
+        }
+        x_[slot] = position.x;
+        y_[slot] = position.y;
+        z_[slot] = position.z;
+        yaw_[slot] = yaw;
+        scale_x_[slot] = scale.x;
+        scale_y_[slot] = scale.y;
+        scale_z_[slot] = scale.z;
+        pivot_x_[slot] = pivot.x * scale.x;
+        pivot_y_[slot] = pivot.y * scale.y;
+        pivot_z_[slot] = pivot.z * scale.z;
+        pivot_[slot] = pivot;
+        markDirty(slot);
+        return id;
+    }
+
+    // the batch instance is the caller's to remove
+    void remove(TransformId id) {
+        const unsigned int slot = slot_of_id_[id];
+        const unsigned int last = instance_.size() - 1;
+        const bool last_dirty = isDirty(last);
+        clearDirty(last);
+        if (slot != last) {
+            moveSlot(last, slot);
+            if (last_dirty) {
+                markDirty(slot);
+            }
+        }
+        instance_.pop_back();
+        id_of_slot_.pop_back();
+        free_ids_.push_back(id);
+    }
+
+    // room for n transforms, so adding that many in a row doesn't reallocate
+    void reserve(unsigned int n) {
+        instance_.reserve(n);
+        id_of_slot_.reserve(n);
+        slot_of_id_.reserve(n);
+        dirty_chunks_.reserve((n + CHUNK - 1) / CHUNK);
+        const unsigned int padded = (n + CHUNK - 1) / CHUNK * CHUNK;
+        if (padded > x_.size()) {
+            resize(padded);
+        }
+    }
+
+    void setPosition(TransformId id, glm::vec3 position) {
+        const unsigned int slot = slot_of_id_[id];
+        x_[slot] = position.x;
+        y_[slot] = position.y;
+        z_[slot] = position.z;
+        markDirty(slot);
+    }
+
+    // radians around +y
+    void setYaw(TransformId id, float yaw) {
+        const unsigned int slot = slot_of_id_[id];
+        yaw_[slot] = yaw;
+        markDirty(slot);
+    }
+
+    void setScale(TransformId id, glm::vec3 scale) {
+        const unsigned int slot = slot_of_id_[id];
+        scale_x_[slot] = scale.x;
+        scale_y_[slot] = scale.y;
+        scale_z_[slot] = scale.z;
+        pivot_x_[slot] = pivot_[slot].x * scale.x;
+        pivot_y_[slot] = pivot_[slot].y * scale.y;
+        pivot_z_[slot] = pivot_[slot].z * scale.z;
+        markDirty(slot);
+    }
+
+    glm::vec3 position(TransformId id) const {
+        const unsigned int slot = slot_of_id_[id];
+        return glm::vec3(x_[slot], y_[slot], z_[slot]);
+    }
+
+    unsigned int size() const {
+        return instance_.size();
+    }
+
+    // transforms are packed like batch instances, mvps from modelViewProjection are in slot order
+    unsigned int slotOf(TransformId id) const {
+        return slot_of_id_[id];
+    }
+
+    // Compute the model matrix of every dirty transform and write it to
+    // models.model(instance), which returns a glm::mat4& and takes care of
+    // uploading it (InstancedBatch does).
+    template<typename Models>
+    void update(Models& models) {
+        const unsigned int n = size();
+        for (unsigned int chunk : dirty_chunks_) {
+            updateChunk(chunk, n, models);
+        }
+        dirty_chunks_.clear();
+    }
+
+    // update() with the dirty chunks spread over a jobs::Scheduler's workers,
+    // grain chunks to a job. chunks are listed once and own their slots, but
+    // models.model() is called from several threads at once, for different
+    // instances: pass an InstancedBatch::ModelWriter, not the batch
+    template<typename Models, typename Scheduler>
+    void update(Models& models, Scheduler& scheduler, unsigned int grain = 256) {
+        const unsigned int n = size();
+        scheduler.parallelFor(0, dirty_chunks_.size(), grain, [&](unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; i++) {
+                updateChunk(dirty_chunks_[i], n, models);
+            }
+        });
+        dirty_chunks_.clear();
+    }
+
+    // view_projection * model of every transform, in slot order. call after
+    // update(), the camera moves every frame so this covers all of them
+    void modelViewProjection(const glm::mat4& view_projection, std::vector<glm::mat4>& mvps) const {
+        const unsigned int n = size();
+        mvps.resize(n);
+#ifdef GLITCH_TRANSFORM_SSE
+        // only columns 0 and 2 of the model mix two columns of view_projection
+        const __m128 vp0 = _mm_loadu_ps(&view_projection[0][0]);
+        const __m128 vp1 = _mm_loadu_ps(&view_projection[1][0]);
+        const __m128 vp2 = _mm_loadu_ps(&view_projection[2][0]);
+        const __m128 vp3 = _mm_loadu_ps(&view_projection[3][0]);
+        for (unsigned int slot = 0; slot < n; slot++) {
+            float* out = &mvps[slot][0][0];
+            _mm_storeu_ps(out, _mm_add_ps(_mm_mul_ps(vp0, _mm_set1_ps(m00_[slot])), _mm_mul_ps(vp2, _mm_set1_ps(m02_[slot]))));
+            _mm_storeu_ps(out + 4, _mm_mul_ps(vp1, _mm_set1_ps(m11_[slot])));
+            _mm_storeu_ps(out + 8, _mm_add_ps(_mm_mul_ps(vp0, _mm_set1_ps(m20_[slot])), _mm_mul_ps(vp2, _mm_set1_ps(m22_[slot]))));
+            _mm_storeu_ps(out + 12, _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(vp0, _mm_set1_ps(m30_[slot])), _mm_mul_ps(vp1, _mm_set1_ps(m31_[slot]))),
+                _mm_add_ps(_mm_mul_ps(vp2, _mm_set1_ps(m32_[slot])), vp3)
+            ));
+        }
+#else
+        for (unsigned int slot = 0; slot < n; slot++) {
+            mvps[slot] = view_projection * cachedModel(slot);
+        }
+#endif
+    }
+
+  private:
+    // dirty flags are a bit per transform in chunks of eight, the widest
+    // SIMD step, plus a bit for whether the chunk is in dirty_chunks_
+    static const unsigned int CHUNK = 8;
+    static const uint16_t LANES = 0xff;
+    static const uint16_t LISTED = 0x100;
+
+    std::vector<unsigned int> instance_;
+    std::vector<TransformId> id_of_slot_;
+    std::vector<unsigned int> slot_of_id_;
+    std::vector<TransformId> free_ids_;
+
+    // inputs, padded to a multiple of CHUNK so SIMD loads never run off the end
+    std::vector<float> x_, y_, z_;
+    std::vector<float> yaw_;
+    std::vector<float> scale_x_, scale_y_, scale_z_;
+    std::vector<float> pivot_x_, pivot_y_, pivot_z_; // pivot * scale
+    std::vector<glm::vec3> pivot_;
+
+    // the computed model matrices, m<column><row>
+    std::vector<float> m00_, m02_, m11_, m20_, m22_, m30_, m31_, m32_;
+
+    std::vector<uint16_t> chunk_dirty_;
+    std::vector<unsigned int> dirty_chunks_;
+
+    void grow() {
+        resize(x_.size() + CHUNK);
+    }
+
+    // n is a multiple of CHUNK
+    void resize(unsigned int n) {
+        std::vector<float>* arrays[] = {
+            &x_, &y_, &z_, &yaw_, &scale_x_, &scale_y_, &scale_z_, &pivot_x_, &pivot_y_, &pivot_z_,
+            &m00_, &m02_, &m11_, &m20_, &m22_, &m30_, &m31_, &m32_
+        };
+        for (std::vector<float>* array : arrays) {
+            array->resize(n, 0.0f);
+        }
+        pivot_.resize(n, glm::vec3(0.0f));
+        chunk_dirty_.resize(n / CHUNK, 0);
+    }
+
+    void moveSlot(unsigned int from, unsigned int to) {
+        std::vector<float>* arrays[] = {
+            &x_, &y_, &z_, &yaw_, &scale_x_, &scale_y_, &scale_z_, &pivot_x_, &pivot_y_, &pivot_z_,
+            &m00_, &m02_, &m11_, &m20_, &m22_, &m30_, &m31_, &m32_
+        };
+        for (std::vector<float>* array : arrays) {
+            (*array)[to] = (*array)[from];
+        }
+        pivot_[to] = pivot_[from];
+        instance_[to] = instance_[from];
+        id_of_slot_[to] = id_of_slot_[from];
+        slot_of_id_[id_of_slot_[to]] = to;
+    }
+
+    void markDirty(unsigned int slot) {
+        uint16_t& mask = chunk_dirty_[slot / CHUNK];
+        if (!(mask & LISTED)) {
+            dirty_chunks_.push_back(slot / CHUNK);
+        }
+        mask |= LISTED | (1u << (slot % CHUNK));
+    }
+
+    bool isDirty(unsigned int slot) const {
+        return (chunk_dirty_[slot / CHUNK] >> (slot % CHUNK)) & 1u;
+    }
+
+    // the chunk stays listed, update skips it once its lanes are clear
+    void clearDirty(unsigned int slot) {
+        chunk_dirty_[slot / CHUNK] &= ~(1u << (slot % CHUNK));
+    }
+
+    // n is size(), chunks past it belong to removed transforms
+    template<typename Models>
+    void updateChunk(unsigned int chunk, unsigned int n, Models& models) {
+        const unsigned int base = chunk * CHUNK;
+        unsigned int mask = chunk_dirty_[chunk] & LANES;
+        chunk_dirty_[chunk] = 0;
+        // lanes past the end belong to removed transforms
+        if (base >= n) {
+            return;
+        } else if (n - base < CHUNK) {
+            mask &= (1u << (n - base)) - 1;
+        }
+#if defined(GLITCH_TRANSFORM_AVX)
+        computeAvx(base, mask, models);
+#elif defined(GLITCH_TRANSFORM_SSE)
+        if (mask & 0xF) {
+            computeSse(base, mask & 0xF, models);
+        }
+        if (mask >> 4) {
+            computeSse(base + 4, mask >> 4, models);
+        }
+#else
+        while (mask) {
+            const unsigned int lane = __builtin_ctz(mask);
+            computeScalar(base + lane, models);
+            mask &= mask - 1;
+        }
+#endif
+    }
+
+    glm::mat4 cachedModel(unsigned int slot) const {
+        glm::mat4 model(1.0f);
+        model[0] = glm::vec4(m00_[slot], 0.0f, m02_[slot], 0.0f);
+        model[1] = glm::vec4(0.0f, m11_[slot], 0.0f, 0.0f);
+        model[2] = glm::vec4(m20_[slot], 0.0f, m22_[slot], 0.0f);
+        model[3] = glm::vec4(m30_[slot], m31_[slot], m32_[slot], 1.0f);
+        return model;
+    }
+
+    template<typename Models>
+    void computeScalar(unsigned int slot, Models& models) {
+        const float sin_yaw = std::sin(yaw_[slot]);
+        const float cos_yaw = std::cos(yaw_[slot]);
+        m00_[slot] = scale_x_[slot] * cos_yaw;
+        m02_[slot] = -scale_x_[slot] * sin_yaw;
+        m11_[slot] = scale_y_[slot];
+        m20_[slot] = scale_z_[slot] * sin_yaw;
+        m22_[slot] = scale_z_[slot] * cos_yaw;
+        m30_[slot] = x_[slot] - (cos_yaw * pivot_x_[slot] + sin_yaw * pivot_z_[slot]);
+        m31_[slot] = y_[slot] - pivot_y_[slot];
+        m32_[slot] = z_[slot] - (cos_yaw * pivot_z_[slot] - sin_yaw * pivot_x_[slot]);
+        models.model(instance_[slot]) = cachedModel(slot);
+    }
+
+#ifdef GLITCH_TRANSFORM_SSE
+    // four cached rows (one number of four matrices each) into four columns per matrix
+    template<typename Models>
+    void writeModels(unsigned int base, unsigned int mask, Models& models) {
+        const __m128 zero = _mm_setzero_ps();
+        __m128 col0_x = _mm_loadu_ps(&m00_[base]), col0_y = zero, col0_z = _mm_loadu_ps(&m02_[base]), col0_w = zero;
+        __m128 col1_x = zero, col1_y = _mm_loadu_ps(&m11_[base]), col1_z = zero, col1_w = zero;
+        __m128 col2_x = _mm_loadu_ps(&m20_[base]), col2_y = zero, col2_z = _mm_loadu_ps(&m22_[base]), col2_w = zero;
+        __m128 col3_x = _mm_loadu_ps(&m30_[base]), col3_y = _mm_loadu_ps(&m31_[base]), col3_z = _mm_loadu_ps(&m32_[base]), col3_w = _mm_set1_ps(1.0f);
+        _MM_TRANSPOSE4_PS(col0_x, col0_y, col0_z, col0_w);
+        _MM_TRANSPOSE4_PS(col1_x, col1_y, col1_z, col1_w);
+        _MM_TRANSPOSE4_PS(col2_x, col2_y, col2_z, col2_w);
+        _MM_TRANSPOSE4_PS(col3_x, col3_y, col3_z, col3_w);
+        // after transposing, col<c>_x holds column c of lane 0, col<c>_y of lane 1, ...
+        const __m128 lanes[4][4] = {
+            { col0_x, col1_x, col2_x, col3_x },
+            { col0_y, col1_y, col2_y, col3_y },
+            { col0_z, col1_z, col2_z, col3_z },
+            { col0_w, col1_w, col2_w, col3_w }
+        };
+        while (mask) {
+            const unsigned int lane = __builtin_ctz(mask);
+            float* out = &models.model(instance_[base + lane])[0][0];
+            for (unsigned int col = 0; col < 4; col++) {
+                _mm_storeu_ps(out + col * 4, lanes[lane][col]);
+            }
+            mask &= mask - 1;
+        }
+    }
+
+    template<typename Models>
+    void computeSse(unsigned int base, unsigned int mask, Models& models) {
+        __m128 sin_yaw, cos_yaw;
+        sinCosSse(_mm_loadu_ps(&yaw_[base]), sin_yaw, cos_yaw);
+        const __m128 scale_x = _mm_loadu_ps(&scale_x_[base]);
+        const __m128 scale_z = _mm_loadu_ps(&scale_z_[base]);
+        const __m128 pivot_x = _mm_loadu_ps(&pivot_x_[base]);
+        const __m128 pivot_z = _mm_loadu_ps(&pivot_z_[base]);
+        _mm_storeu_ps(&m00_[base], _mm_mul_ps(scale_x, cos_yaw));
+        _mm_storeu_ps(&m02_[base], _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(scale_x, sin_yaw)));
+        _mm_storeu_ps(&m11_[base], _mm_loadu_ps(&scale_y_[base]));
+        _mm_storeu_ps(&m20_[base], _mm_mul_ps(scale_z, sin_yaw));
+        _mm_storeu_ps(&m22_[base], _mm_mul_ps(scale_z, cos_yaw));
+        _mm_storeu_ps(&m30_[base], _mm_sub_ps(_mm_loadu_ps(&x_[base]), _mm_add_ps(_mm_mul_ps(cos_yaw, pivot_x), _mm_mul_ps(sin_yaw, pivot_z))));
+        _mm_storeu_ps(&m31_[base], _mm_sub_ps(_mm_loadu_ps(&y_[base]), _mm_loadu_ps(&pivot_y_[base])));
+        _mm_storeu_ps(&m32_[base], _mm_sub_ps(_mm_loadu_ps(&z_[base]), _mm_sub_ps(_mm_mul_ps(cos_yaw, pivot_z), _mm_mul_ps(sin_yaw, pivot_x))));
+        writeModels(base, mask, models);
+    }
+#endif
+
+#ifdef GLITCH_TRANSFORM_AVX
+    // eight transforms, written out as two groups of four
+    template<typename Models>
+    void computeAvx(unsigned int base, unsigned int mask, Models& models) {
+        __m256 sin_yaw, cos_yaw;
+        sinCosAvx(_mm256_loadu_ps(&yaw_[base]), sin_yaw, cos_yaw);
+        const __m256 scale_x = _mm256_loadu_ps(&scale_x_[base]);
+        const __m256 scale_z = _mm256_loadu_ps(&scale_z_[base]);
+        const __m256 pivot_x = _mm256_loadu_ps(&pivot_x_[base]);
+        const __m256 pivot_z = _mm256_loadu_ps(&pivot_z_[base]);
+        _mm256_storeu_ps(&m00_[base], _mm256_mul_ps(scale_x, cos_yaw));
+        _mm256_storeu_ps(&m02_[base], _mm256_sub_ps(_mm256_setzero_ps(), _mm256_mul_ps(scale_x, sin_yaw)));
+        _mm256_storeu_ps(&m11_[base], _mm256_loadu_ps(&scale_y_[base]));
+        _mm256_storeu_ps(&m20_[base], _mm256_mul_ps(scale_z, sin_yaw));
+        _mm256_storeu_ps(&m22_[base], _mm256_mul_ps(scale_z, cos_yaw));
+        _mm256_storeu_ps(&m30_[base], _mm256_sub_ps(_mm256_loadu_ps(&x_[base]), _mm256_add_ps(_mm256_mul_ps(cos_yaw, pivot_x), _mm256_mul_ps(sin_yaw, pivot_z))));
+        _mm256_storeu_ps(&m31_[base], _mm256_sub_ps(_mm256_loadu_ps(&y_[base]), _mm256_loadu_ps(&pivot_y_[base])));
+        _mm256_storeu_ps(&m32_[base], _mm256_sub_ps(_mm256_loadu_ps(&z_[base]), _mm256_sub_ps(_mm256_mul_ps(cos_yaw, pivot_z), _mm256_mul_ps(sin_yaw, pivot_x))));
+        if (mask & 0xF) {
+            writeModels(base, mask & 0xF, models);
+        }
+        if (mask >> 4) {
+            writeModels(base + 4, mask >> 4, models);
+        }
+    }
+#endif
+};
+
+}
+
+#endif
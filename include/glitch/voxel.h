@@ -0,0 +1,775 @@
+#ifndef VOXEL_H
+#define VOXEL_H
+
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <chrono>
+#include <cstdint>
+#include <cmath>
+
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+
+#include <glitch/graphics.h>
+#include <glitch/culling.h>
+#include <glitch/lod.h>
+#include <glitch/jobs.h>
+
+namespace vox {
+
+typedef uint16_t BlockType;
+const BlockType AIR = 0;
+
+// 32^3 block types, stored as indices into a per chunk palette. Indices are
+// bit packed with just enough bits for the palette (0 bits while the chunk
+// holds a single type), so mostly uniform chunks stay tiny.
+class Chunk {
+  public:
+    static const int SIZE = 32;
+    static const int VOLUME = SIZE * SIZE * SIZE;
+
+    Chunk():
+        bits_(0),
+        n_solid_(0)
+    {
+        palette_.push_back(AIR);
+    }
+
+    BlockType get(int x, int y, int z) const {
+        if (bits_ == 0) {
+            return palette_[0];
+        }
+        return palette_[readIndex(index(x, y, z))];
+    }
+
+    void set(int x, int y, int z, BlockType type) {
+        BlockType old = get(x, y, z);
+        if (old == type) {
+            return;
+        }
+        unsigned int palette_index = paletteIndex(type);
+        writeIndex(index(x, y, z), palette_index);
+        n_solid_ += (type != AIR) - (old != AIR);
+    }
+
+    unsigned int solidCount() const {
+        return n_solid_;
+    }
+
+    unsigned int paletteSize() const {
+        return palette_.size();
+    }
+
+    unsigned int bitsPerBlock() const {
+        return bits_;
+    }
+
+    unsigned int memoryBytes() const {
+        return palette_.size() * sizeof(BlockType) + data_.size() * sizeof(uint64_t);
+    }
+
+  private:
+    std::vector<BlockType> palette_;
+    std::vector<uint64_t> data_;
+    unsigned int bits_; // 0, 1, 2, 4, 8 or 16 so entries never straddle words
+    unsigned int n_solid_;
+
+    static unsigned int index(int x, int y, int z) {
+        return x + SIZE * (y + SIZE * z);
+    }
+
+    unsigned int readIndex(unsigned int i) const {
+        const unsigned int per_word = 64 / bits_;
+        const uint64_t mask = (uint64_t(1) << bits_) - 1;
+        return (data_[i / per_word] >> ((i % per_word) * bits_)) & mask;
+    }
+
+    void writeIndex(unsigned int i, unsigned int value) {
+        const unsigned int per_word = 64 / bits_;
+        const unsigned int shift = (i % per_word) * bits_;
+        const uint64_t mask = ((uint64_t(1) << bits_) - 1) << shift;
+        uint64_t& word = data_[i / per_word];
+        word = (word & ~mask) | (uint64_t(value) << shift);
+    }
+
+    unsigned int paletteIndex(BlockType type) {
+        for (unsigned int i = 0; i < palette_.size(); i++) {
+            if (palette_[i] == type) {
+                return i;
+            }
+        }
+        palette_.push_back(type);
+        if (palette_.size() > (1u << bits_)) {
+            repack(bits_ == 0 ? 1 : bits_ * 2);
+        }
+        return palette_.size() - 1;
+    }
+
+    void repack(unsigned int new_bits) {
+        std::vector<uint64_t> old_data;
+        old_data.swap(data_);
+        const unsigned int old_bits = bits_;
+
+        bits_ = new_bits;
+        data_.assign((VOLUME + 64 / bits_ - 1) / (64 / bits_), 0);
+        if (old_bits == 0) {
+            return; // everything was palette entry 0, which is what zeroed data means
+        }
+        const unsigned int old_per_word = 64 / old_bits;
+        const uint64_t old_mask = (uint64_t(1) << old_bits) - 1;
+        for (unsigned int i = 0; i < VOLUME; i++) {
+            unsigned int value = (old_data[i / old_per_word] >> ((i % old_per_word) * old_bits)) & old_mask;
+            writeIndex(i, value);
+        }
+    }
+};
+
+// vertex layout of chunk meshes: world position + color, see v_voxel.glsl
+const unsigned int N_VOXEL_VERTEX_FLOATS = 7;
+
+struct ChunkMesh {
+    std::vector<float> vertices;
+    std::vector<unsigned int> indices;
+
+    unsigned int triangleCount() const {
+        return indices.size() / 3;
+    }
+};
+
+struct MeshStats {
+    unsigned int n_triangles; // greedy meshed output
+    unsigned int n_proxy_triangles; // the coarse level of detail mesh
+    unsigned int n_naive_triangles; // 12 per solid block, as if drawn cube by cube
+    double mesh_ms; // summed over chunks, not wall clock when meshed in parallel
+};
+
+// Sparse grid of chunks. Edits mark the chunk (and neighbours when on a
+// border) dirty, and remeshDirty rebuilds only those with greedy meshing:
+// faces between two solid blocks are dropped and coplanar faces of the same
+// type are merged into as few quads as possible.
+//
+// Each chunk also gets two levels of detail for when it's far away: a proxy
+// mesh of PROXY_SCALE^3 cells (solid when at least half their blocks are),
+// and an impostor, a flat colored billboard over its solid blocks' bounds.
+class VoxelWorld {
+  public:
+    static const int PROXY_SCALE = 4;
+
+    // colors[type] is the color of that block type, 0 is air
+    VoxelWorld(const std::vector<glm::vec4>& colors):
+        colors_(colors),
+        impostor_vao_(NULL)
+    {}
+
+    ~VoxelWorld() {
+        for (std::unordered_map<uint64_t, Entry>::iterator it = chunks_.begin(); it != chunks_.end(); ++it) {
+            for (GpuMesh& mesh : it->second.meshes) {
+                delete mesh.vao;
+            }
+        }
+        delete impostor_vao_;
+    }
+
+    BlockType get(int x, int y, int z) const {
+        glm::ivec3 chunk_coord = chunkCoord(x, y, z);
+        std::unordered_map<uint64_t, Entry>::const_iterator it = chunks_.find(key(chunk_coord));
+        if (it == chunks_.end()) {
+            return AIR;
+        }
+        return it->second.chunk.get(x - chunk_coord.x * Chunk::SIZE, y - chunk_coord.y * Chunk::SIZE, z - chunk_coord.z * Chunk::SIZE);
+    }
+
+    void set(int x, int y, int z, BlockType type) {
+        glm::ivec3 chunk_coord = chunkCoord(x, y, z);
+        glm::ivec3 local(x - chunk_coord.x * Chunk::SIZE, y - chunk_coord.y * Chunk::SIZE, z - chunk_coord.z * Chunk::SIZE);
+        Entry& entry = chunks_[key(chunk_coord)];
+        entry.coord = chunk_coord;
+        if (entry.chunk.get(local.x, local.y, local.z) == type) {
+            return;
+        }
+        entry.chunk.set(local.x, local.y, local.z, type);
+        entry.dirty = true;
+
+        // faces on the border depend on the neighbouring chunk too
+        for (int axis = 0; axis < 3; axis++) {
+            if (local[axis] == 0 || local[axis] == Chunk::SIZE - 1) {
+                glm::ivec3 neighbour = chunk_coord;
+                neighbour[axis] += (local[axis] == 0) ? -1 : 1;
+                std::unordered_map<uint64_t, Entry>::iterator it = chunks_.find(key(neighbour));
+                if (it != chunks_.end()) {
+                    it->second.dirty = true;
+                }
+            }
+        }
+    }
+
+    // rebuild and upload the meshes of dirty chunks, returns how many were rebuilt
+    unsigned int remeshDirty() {
+        scratch_.resize(std::max<size_t>(scratch_.size(), 1));
+        unsigned int n_remeshed = 0;
+        for (std::unordered_map<uint64_t, Entry>::iterator it = chunks_.begin(); it != chunks_.end(); ++it) {
+            Entry& entry = it->second;
+            if (!entry.dirty) {
+                continue;
+            }
+            remesh(entry, scratch_[0].mesh, scratch_[0].proxy, scratch_[0]);
+            upload(entry, scratch_[0].mesh, scratch_[0].proxy);
+            entry.dirty = false;
+            n_remeshed++;
+        }
+        return n_remeshed;
+    }
+
+    // same, meshing the chunks on the scheduler's workers. meshing only
+    // reads the world, the uploads happen after on the calling thread,
+    // which has to own the GL context
+    unsigned int remeshDirty(jobs::Scheduler& scheduler) {
+        dirty_.clear();
+        for (std::unordered_map<uint64_t, Entry>::iterator it = chunks_.begin(); it != chunks_.end(); ++it) {
+            if (it->second.dirty) {
+                dirty_.push_back(&it->second);
+            }
+        }
+        scratch_.resize(std::max<size_t>(scratch_.size(), scheduler.threadCount()));
+        if (meshes_.size() < dirty_.size()) {
+            meshes_.resize(dirty_.size());
+            proxies_.resize(dirty_.size());
+        }
+
+        scheduler.parallelFor(0, dirty_.size(), 1, [this](unsigned int begin, unsigned int end) {
+            Scratch& scratch = scratch_[jobs::currentWorker()];
+            for (unsigned int i = begin; i < end; i++) {
+                remesh(*dirty_[i], meshes_[i], proxies_[i], scratch);
+            }
+        });
+
+        for (unsigned int i = 0; i < dirty_.size(); i++) {
+            upload(*dirty_[i], meshes_[i], proxies_[i]);
+            dirty_[i]->dirty = false;
+        }
+        return dirty_.size();
+    }
+
+    // calls f(item, chunk_center) for every chunk in the frustum with
+    // something to draw, always at full detail
+    template<typename F>
+    void forEachDraw(const gfx::Frustum& frustum, F f) {
+        const float half = Chunk::SIZE / 2.0f;
+        for (std::unordered_map<uint64_t, Entry>::iterator it = chunks_.begin(); it != chunks_.end(); ++it) {
+            Entry& entry = it->second;
+            const GpuMesh& mesh = entry.meshes[gfx::LOD_FULL];
+            if (mesh.n_indices == 0) {
+                continue;
+            }
+            const glm::vec3 center = 0.5f * (entry.bounds_min + entry.bounds_max);
+            const glm::vec3 extent = 0.5f * (entry.bounds_max - entry.bounds_min);
+            if (gfx::boxOutside(frustum, center.x, center.y, center.z, extent.x, extent.y, extent.z)) {
+                continue;
+            }
+            f(gfx::DrawItem(mesh.vao, mesh.n_indices), glm::vec3(entry.coord) * float(Chunk::SIZE) + half);
+        }
+    }
+
+    // calls f(item, level, center) for every chunk in the frustum and the
+    // view distance, at the level lod picks for its solid blocks' bounds,
+    // and once more at the outgoing level while it cross-fades. LOD_IMPOSTOR
+    // items are billboards for v_billboard.glsl, the others chunk meshes
+    // for v_voxel.glsl
+    template<typename F>
+    void forEachLodDraw(gfx::LodSelector& lod, const gfx::Frustum& frustum, F f) {
+        for (std::unordered_map<uint64_t, Entry>::iterator it = chunks_.begin(); it != chunks_.end(); ++it) {
+            Entry& entry = it->second;
+            if (entry.meshes[gfx::LOD_FULL].n_indices == 0) {
+                continue;
+            }
+            const glm::vec3 center = 0.5f * (entry.bounds_min + entry.bounds_max);
+            const glm::vec3 extent = 0.5f * (entry.bounds_max - entry.bounds_min);
+            if (gfx::boxOutside(frustum, center.x, center.y, center.z, extent.x, extent.y, extent.z)) {
+                lod.hide(entry.lod);
+                continue;
+            }
+            if (!lod.select(entry.lod, center, glm::length(extent))) {
+                continue;
+            }
+            lodDraw(entry, entry.lod.level, gfx::LodSelector::fade(entry.lod, false), lod, f);
+            if (entry.lod.fading()) {
+                lodDraw(entry, entry.lod.previous, gfx::LodSelector::fade(entry.lod, true), lod, f);
+            }
+        }
+    }
+
+    // totals over every chunk, as of each chunk's last remesh
+    MeshStats stats() const {
+        MeshStats total = { 0, 0, 0, 0.0 };
+        for (std::unordered_map<uint64_t, Entry>::const_iterator it = chunks_.begin(); it != chunks_.end(); ++it) {
+            total.n_triangles += it->second.stats.n_triangles;
+            total.n_proxy_triangles += it->second.stats.n_proxy_triangles;
+            total.n_naive_triangles += it->second.stats.n_naive_triangles;
+            total.mesh_ms += it->second.stats.mesh_ms;
+        }
+        return total;
+    }
+
+    // calls f(chunk_coord, stats) for every chunk
+    template<typename F>
+    void forEachChunkStats(F f) const {
+        for (std::unordered_map<uint64_t, Entry>::const_iterator it = chunks_.begin(); it != chunks_.end(); ++it) {
+            f(it->second.coord, it->second.stats);
+        }
+    }
+
+    unsigned int chunkCount() const {
+        return chunks_.size();
+    }
+
+    void deallocate() {
+        for (std::unordered_map<uint64_t, Entry>::iterator it = chunks_.begin(); it != chunks_.end(); ++it) {
+            for (GpuMesh& mesh : it->second.meshes) {
+                if (mesh.vao) {
+                    mesh.vao->deallocate();
+                    delete mesh.vao;
+                    mesh.vao = NULL;
+                }
+            }
+        }
+        if (impostor_vao_) {
+            impostor_vao_->deallocate();
+            delete impostor_vao_;
+            impostor_vao_ = NULL;
+        }
+    }
+
+  private:
+    // gpu side, created on first upload
+    struct GpuMesh {
+        gfx::VAO* vao;
+        unsigned int vbo;
+        unsigned int ebo;
+        unsigned int n_indices;
+
+        GpuMesh(): vao(NULL), vbo(0), ebo(0), n_indices(0) {}
+    };
+
+    struct Entry {
+        Chunk chunk;
+        glm::ivec3 coord;
+        bool dirty;
+        MeshStats stats;
+
+        // world space bounds of the solid blocks, and the impostor's color
+        glm::vec3 bounds_min;
+        glm::vec3 bounds_max;
+        glm::vec4 impostor_color;
+        gfx::LodState lod;
+
+        GpuMesh meshes[gfx::LOD_PROXY + 1]; // LOD_FULL and LOD_PROXY
+
+        Entry(): dirty(true), bounds_min(0.0f), bounds_max(0.0f), impostor_color(1.0f) {
+            stats.n_triangles = stats.n_proxy_triangles = stats.n_naive_triangles = 0;
+            stats.mesh_ms = 0.0;
+        }
+    };
+
+    static const int PADDED = Chunk::SIZE + 2;
+    static const int CELLS = Chunk::SIZE / PROXY_SCALE;
+
+    // how many of a cell's blocks have each type
+    struct Tally {
+        BlockType types[PROXY_SCALE * PROXY_SCALE * PROXY_SCALE];
+        unsigned int counts[PROXY_SCALE * PROXY_SCALE * PROXY_SCALE];
+        unsigned int n_types;
+        int n_blocks;
+
+        Tally(): n_types(0), n_blocks(0) {}
+
+        void add(BlockType type) {
+            unsigned int k = 0;
+            while (k < n_types && types[k] != type) {
+                k++;
+            }
+            if (k == n_types) {
+                types[n_types] = type;
+                counts[n_types++] = 0;
+            }
+            counts[k]++;
+            n_blocks++;
+        }
+
+        BlockType mostCommon() const {
+            unsigned int best = 0;
+            for (unsigned int k = 1; k < n_types; k++) {
+                if (counts[k] > counts[best]) {
+                    best = k;
+                }
+            }
+            return n_types ? types[best] : AIR;
+        }
+    };
+
+    // per meshing thread, reused across remeshes
+    struct Scratch {
+        ChunkMesh mesh;
+        ChunkMesh proxy;
+        std::vector<BlockType> padded;
+        std::vector<BlockType> cells;
+        std::vector<int> mask;
+    };
+
+    std::unordered_map<uint64_t, Entry> chunks_;
+    std::vector<glm::vec4> colors_;
+    std::vector<Scratch> scratch_;
+    // the parallel remesh's chunks and their meshes until uploaded
+    std::vector<Entry*> dirty_;
+    std::vector<ChunkMesh> meshes_;
+    std::vector<ChunkMesh> proxies_;
+    // unit quad every impostor is drawn with, see v_billboard.glsl
+    gfx::VAO* impostor_vao_;
+
+    static int floorDiv(int a, int b) {
+        return (a >= 0) ? a / b : -((-a + b - 1) / b);
+    }
+
+    static glm::ivec3 chunkCoord(int x, int y, int z) {
+        return glm::ivec3(floorDiv(x, Chunk::SIZE), floorDiv(y, Chunk::SIZE), floorDiv(z, Chunk::SIZE));
+    }
+
+    static uint64_t key(glm::ivec3 c) {
+        const uint64_t mask = (uint64_t(1) << 21) - 1;
+        return (uint64_t(c.x) & mask) | ((uint64_t(c.y) & mask) << 21) | ((uint64_t(c.z) & mask) << 42);
+    }
+
+    // copy the chunk plus a one block border from its neighbours, so the
+    // mesher never has to look up other chunks
+    void fillPadded(const Entry& entry, std::vector<BlockType>& padded) const {
+        padded.assign(PADDED * PADDED * PADDED, AIR);
+        const glm::ivec3 origin = entry.coord * Chunk::SIZE;
+        for (int z = -1; z <= Chunk::SIZE; z++) {
+            for (int y = -1; y <= Chunk::SIZE; y++) {
+                for (int x = -1; x <= Chunk::SIZE; x++) {
+                    bool inside = x >= 0 && y >= 0 && z >= 0 && x < Chunk::SIZE && y < Chunk::SIZE && z < Chunk::SIZE;
+                    BlockType type = inside ? entry.chunk.get(x, y, z) : get(origin.x + x, origin.y + y, origin.z + z);
+                    padded[(x + 1) + PADDED * ((y + 1) + PADDED * (z + 1))] = type;
+                }
+            }
+        }
+    }
+
+    template<typename F>
+    void lodDraw(Entry& entry, unsigned int level, float fade, gfx::LodSelector& lod, F& f) {
+        // too thin for any cell to be half solid, there's no proxy
+        if (level == gfx::LOD_PROXY && entry.meshes[gfx::LOD_PROXY].n_indices == 0) {
+            level = gfx::LOD_IMPOSTOR;
+        }
+        const glm::vec3 center = 0.5f * (entry.bounds_min + entry.bounds_max);
+        gfx::DrawItem item;
+        if (level == gfx::LOD_IMPOSTOR) {
+            // wide enough to cover the bounds from any side
+            const glm::vec3 size = entry.bounds_max - entry.bounds_min;
+            item = gfx::DrawItem(impostor_vao_, 6);
+            item.model[0][0] = 0.5f * glm::length(glm::vec2(size.x, size.z));
+            item.model[1][1] = 0.5f * size.y;
+            item.model[3] = glm::vec4(center, 1.0f);
+            item.color = entry.impostor_color;
+        } else {
+            item = gfx::DrawItem(entry.meshes[level].vao, entry.meshes[level].n_indices);
+        }
+        item.fade = fade;
+        lod.countDraw(level, item.n_indices / 3);
+        f(item, level, center);
+    }
+
+    // p is in [-1, n] on every axis, grids carry a one block border
+    static BlockType padded(const std::vector<BlockType>& padded, int n, const int p[3]) {
+        const int side = n + 2;
+        return padded[(p[0] + 1) + side * ((p[1] + 1) + side * (p[2] + 1))];
+    }
+
+    glm::vec4 color(BlockType type) const {
+        return (type < colors_.size()) ? colors_[type] : glm::vec4(1.0f, 0.0f, 1.0f, 1.0f);
+    }
+
+    void remesh(Entry& entry, ChunkMesh& mesh, ChunkMesh& proxy, Scratch& scratch) const {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        mesh.vertices.clear();
+        mesh.indices.clear();
+        proxy.vertices.clear();
+        proxy.indices.clear();
+        if (entry.chunk.solidCount() > 0) {
+            const glm::vec3 origin = glm::vec3(entry.coord * Chunk::SIZE);
+            fillPadded(entry, scratch.padded);
+            greedyMesh(scratch.padded, Chunk::SIZE, 1, origin, mesh, scratch.mask);
+            downsample(entry, scratch.padded, scratch.cells);
+            greedyMesh(scratch.cells, CELLS, PROXY_SCALE, origin, proxy, scratch.mask);
+        }
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+        entry.stats.n_triangles = mesh.triangleCount();
+        entry.stats.n_proxy_triangles = proxy.triangleCount();
+        entry.stats.n_naive_triangles = 12 * entry.chunk.solidCount();
+        entry.stats.mesh_ms = std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    // the proxy's cells from the padded chunk, with a border of air so the
+    // proxy keeps its faces on chunk borders: they cover the cracks next to
+    // neighbours drawn at another level. a cell is solid when at least half
+    // its blocks are, and takes their most common type. cells with air above
+    // take the most common type on top of their columns instead, looking into
+    // the cell above, since that's where the surface often is. also the solid
+    // blocks' bounds and the impostor's color, the average on top of every column
+    void downsample(Entry& entry, const std::vector<BlockType>& padded, std::vector<BlockType>& cells) const {
+        const int n = CELLS;
+        const int side = n + 2;
+        cells.assign(side * side * side, AIR);
+        glm::ivec3 min(Chunk::SIZE);
+        glm::ivec3 max(0);
+
+        int c[3];
+        int p[3];
+        for (c[2] = 0; c[2] < n; c[2]++) {
+            for (c[1] = 0; c[1] < n; c[1]++) {
+                for (c[0] = 0; c[0] < n; c[0]++) {
+                    Tally tally;
+                    for (p[2] = c[2] * PROXY_SCALE; p[2] < (c[2] + 1) * PROXY_SCALE; p[2]++) {
+                        for (p[1] = c[1] * PROXY_SCALE; p[1] < (c[1] + 1) * PROXY_SCALE; p[1]++) {
+                            for (p[0] = c[0] * PROXY_SCALE; p[0] < (c[0] + 1) * PROXY_SCALE; p[0]++) {
+                                BlockType type = VoxelWorld::padded(padded, Chunk::SIZE, p);
+                                if (type != AIR) {
+                                    tally.add(type);
+                                    min = glm::min(min, glm::ivec3(p[0], p[1], p[2]));
+                                    max = glm::max(max, glm::ivec3(p[0], p[1], p[2]) + 1);
+                                }
+                            }
+                        }
+                    }
+                    if (2 * tally.n_blocks >= PROXY_SCALE * PROXY_SCALE * PROXY_SCALE) {
+                        cells[(c[0] + 1) + side * ((c[1] + 1) + side * (c[2] + 1))] = tally.mostCommon();
+                    }
+                }
+            }
+        }
+
+        for (c[2] = 0; c[2] < n; c[2]++) {
+            for (c[1] = 0; c[1] < n; c[1]++) {
+                for (c[0] = 0; c[0] < n; c[0]++) {
+                    BlockType& cell = cells[(c[0] + 1) + side * ((c[1] + 1) + side * (c[2] + 1))];
+                    if (cell == AIR || cells[(c[0] + 1) + side * ((c[1] + 2) + side * (c[2] + 1))] != AIR) {
+                        continue;
+                    }
+                    Tally tally;
+                    const int top = std::min((c[1] + 2) * PROXY_SCALE, int(Chunk::SIZE)) - 1;
+                    for (p[2] = c[2] * PROXY_SCALE; p[2] < (c[2] + 1) * PROXY_SCALE; p[2]++) {
+                        for (p[0] = c[0] * PROXY_SCALE; p[0] < (c[0] + 1) * PROXY_SCALE; p[0]++) {
+                            for (p[1] = top; p[1] >= c[1] * PROXY_SCALE; p[1]--) {
+                                BlockType type = VoxelWorld::padded(padded, Chunk::SIZE, p);
+                                if (type != AIR) {
+                                    tally.add(type);
+                                    break;
+                                }
+                            }
+                        }
+                    }
+                    cell = tally.mostCommon();
+                }
+            }
+        }
+        const glm::ivec3 origin = entry.coord * Chunk::SIZE;
+        entry.bounds_min = glm::vec3(origin + min);
+        entry.bounds_max = glm::vec3(origin + max);
+
+        glm::vec3 sum(0.0f);
+        unsigned int n_columns = 0;
+        for (p[2] = 0; p[2] < Chunk::SIZE; p[2]++) {
+            for (p[0] = 0; p[0] < Chunk::SIZE; p[0]++) {
+                for (p[1] = max.y - 1; p[1] >= min.y; p[1]--) {
+                    BlockType type = VoxelWorld::padded(padded, Chunk::SIZE, p);
+                    if (type != AIR) {
+                        sum += glm::vec3(color(type));
+                        n_columns++;
+                        break;
+                    }
+                }
+            }
+        }
+        entry.impostor_color = glm::vec4(sum / float(std::max(n_columns, 1u)), 1.0f);
+    }
+
+    // meshes the n^3 grid inside padded, each of its blocks scale blocks wide.
+    // const, runs on several threads at once
+    void greedyMesh(const std::vector<BlockType>& grid, int n, int scale, glm::vec3 origin, ChunkMesh& mesh, std::vector<int>& mask) const {
+        mask.resize(n * n);
+
+        for (int d = 0; d < 3; d++) {
+            const int u = (d + 1) % 3;
+            const int v = (d + 2) % 3;
+            int x[3] = { 0, 0, 0 };
+            int q[3] = { 0, 0, 0 };
+            q[d] = 1;
+
+            // slice between layer x[d] and x[d] + 1
+            for (x[d] = -1; x[d] < n; x[d]++) {
+                // mask holds +type for faces pointing along +d, -type along -d
+                int m = 0;
+                for (x[v] = 0; x[v] < n; x[v]++) {
+                    for (x[u] = 0; x[u] < n; x[u]++, m++) {
+                        int next[3] = { x[0] + q[0], x[1] + q[1], x[2] + q[2] };
+                        BlockType a = padded(grid, n, x);
+                        BlockType b = padded(grid, n, next);
+                        if (a != AIR && b == AIR && x[d] >= 0) {
+                            mask[m] = a;
+                        } else if (b != AIR && a == AIR && x[d] + 1 < n) {
+                            mask[m] = -int(b);
+                        } else {
+                            mask[m] = 0;
+                        }
+                    }
+                }
+
+                // grow each face into the widest, then tallest, rectangle of the same type
+                m = 0;
+                for (int j = 0; j < n; j++) {
+                    for (int i = 0; i < n; ) {
+                        int c = mask[m];
+                        if (c == 0) {
+                            i++;
+                            m++;
+                            continue;
+                        }
+                        int w = 1;
+                        while (i + w < n && mask[m + w] == c) {
+                            w++;
+                        }
+                        int h = 1;
+                        for (; j + h < n; h++) {
+                            bool row_matches = true;
+                            for (int k = 0; k < w; k++) {
+                                if (mask[m + k + h * n] != c) {
+                                    row_matches = false;
+                                    break;
+                                }
+                            }
+                            if (!row_matches) {
+                                break;
+                            }
+                        }
+
+                        int corner[3] = { 0, 0, 0 };
+                        corner[d] = (x[d] + 1) * scale;
+                        corner[u] = i * scale;
+                        corner[v] = j * scale;
+                        int du[3] = { 0, 0, 0 };
+                        int dv[3] = { 0, 0, 0 };
+                        du[u] = w * scale;
+                        dv[v] = h * scale;
+                        addQuad(mesh, origin, corner, du, dv, d, c);
+
+                        for (int l = 0; l < h; l++) {
+                            for (int k = 0; k < w; k++) {
+                                mask[m + k + l * n] = 0;
+                            }
+                        }
+                        i += w;
+                        m += w;
+                    }
+                }
+            }
+        }
+    }
+
+    void addQuad(ChunkMesh& mesh, glm::vec3 origin, const int corner[3], const int du[3], const int dv[3], int axis, int c) const {
+        BlockType type = (c > 0) ? c : -c;
+        // cheap directional shading so faces read apart without lighting
+        float shade = (axis == 1) ? ((c > 0) ? 1.0f : 0.55f) : ((axis == 0) ? 0.8f : 0.7f);
+        glm::vec4 type_color = color(type);
+        glm::vec4 shaded = glm::vec4(glm::vec3(type_color) * shade, type_color.w);
+
+        glm::vec3 p0 = origin + glm::vec3(corner[0], corner[1], corner[2]);
+        glm::vec3 eu(du[0], du[1], du[2]);
+        glm::vec3 ev(dv[0], dv[1], dv[2]);
+        glm::vec3 corners[4] = { p0, p0 + eu, p0 + eu + ev, p0 + ev };
+
+        unsigned int base = mesh.vertices.size() / N_VOXEL_VERTEX_FLOATS;
+        for (unsigned int k = 0; k < 4; k++) {
+            const float vertex[N_VOXEL_VERTEX_FLOATS] = {
+                corners[k].x, corners[k].y, corners[k].z,
+                shaded.x, shaded.y, shaded.z, shaded.w
+            };
+            mesh.vertices.insert(mesh.vertices.end(), vertex, vertex + N_VOXEL_VERTEX_FLOATS);
+        }
+        // counter clockwise seen from outside, u x v points along +axis
+        static const unsigned int FRONT[6] = { 0, 1, 2, 2, 3, 0 };
+        static const unsigned int BACK[6] = { 0, 3, 2, 2, 1, 0 };
+        const unsigned int* order = (c > 0) ? FRONT : BACK;
+        for (unsigned int k = 0; k < 6; k++) {
+            mesh.indices.push_back(base + order[k]);
+        }
+    }
+
+    void upload(Entry& entry, const ChunkMesh& mesh, const ChunkMesh& proxy) {
+        if (!impostor_vao_) {
+            createImpostorQuad();
+        }
+        upload(entry.meshes[gfx::LOD_FULL], mesh);
+        upload(entry.meshes[gfx::LOD_PROXY], proxy);
+    }
+
+    void upload(GpuMesh& gpu, const ChunkMesh& mesh) {
+        gpu.n_indices = mesh.indices.size();
+        if (gpu.n_indices == 0) {
+            return;
+        }
+        const unsigned int vertex_bytes = mesh.vertices.size() * sizeof(float);
+        const unsigned int index_bytes = mesh.indices.size() * sizeof(unsigned int);
+        if (!gpu.vao) {
+            gpu.vao = new gfx::VAO();
+            gpu.vao->bind();
+            gpu.vbo = gpu.vao->addVertexBuffer(vertex_bytes, mesh.vertices.data(), GL_STATIC_DRAW);
+            gpu.ebo = gpu.vao->addElementBuffer(index_bytes, mesh.indices.data(), GL_STATIC_DRAW);
+            gpu.vao->addVertexAttribute(0, 3, N_VOXEL_VERTEX_FLOATS, 0);
+            gpu.vao->addVertexAttribute(1, 4, N_VOXEL_VERTEX_FLOATS, 3);
+            return;
+        }
+        // respecify the existing buffers, the vao keeps pointing at them
+        gpu.vao->bind();
+        gfx::GLState::instance().bindBuffer(GL_ARRAY_BUFFER, gpu.vbo);
+        glBufferData(GL_ARRAY_BUFFER, vertex_bytes, mesh.vertices.data(), GL_STATIC_DRAW);
+        gfx::GLState::instance().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, gpu.ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_bytes, mesh.indices.data(), GL_STATIC_DRAW);
+    }
+
+    // a quad in the xy plane from -1 to 1, v_billboard.glsl scales and turns it
+    void createImpostorQuad() {
+        static const float vertices[] = {
+            -1.0f, -1.0f, 0.0f,
+             1.0f, -1.0f, 0.0f,
+             1.0f,  1.0f, 0.0f,
+            -1.0f,  1.0f, 0.0f,
+        };
+        static const unsigned int indices[] = { 0, 1, 2, 2, 3, 0 };
+        impostor_vao_ = new gfx::VAO();
+        impostor_vao_->bind();
+        impostor_vao_->addVertexBuffer(sizeof(vertices), vertices, GL_STATIC_DRAW);
+        impostor_vao_->addElementBuffer(sizeof(indices), indices, GL_STATIC_DRAW);
+        impostor_vao_->addVertexAttribute(0, 3, 3, 0);
+    }
+};
+
+// rolling hills from origin, width by depth blocks, rising into mountains
+// towards +x to have something to see far away
+inline void generateHills(VoxelWorld& voxels, const glm::ivec3& origin, int width, int depth) {
+    for (int z = 0; z < depth; z++) {
+        for (int x = 0; x < width; x++) {
+            float mountains = 12.0f * (1.0f - std::cos(x * 0.01f)) * (1.0f + 0.3f * std::sin(z * 0.013f));
+            float height = 4.0f + 3.0f * std::sin(x * 0.15f) * std::cos(z * 0.1f) + 2.0f * std::sin((x + z) * 0.05f) + mountains;
+            int top = static_cast<int>(height);
+            for (int y = 0; y <= top; y++) {
+                BlockType type = (y == top) ? 1 : (y > top - 3) ? 2 : 3;
+                voxels.set(origin.x + x, origin.y + y, origin.z + z, type);
+            }
+        }
+    }
+}
+
+}
+
+#endif
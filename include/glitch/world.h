@@ -0,0 +1,150 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <glitch/graphics.h>
+#include <glitch/aabb_tree.h>
+#include <glitch/ecs.h>
+#include <glitch/components.h>
+
+inline Aabb blockAabb(const gfx::Block& block) {
+    return Aabb(block.position(), block.position() + block.size());
+}
+
+// The world's blocks as entities with a Transform and a Collider, kept in
+// an AabbTree so "what is near here" queries don't have to scan every
+// block. Other systems attach their own components to the same entities
+// through registry(). Blocks must be moved through setBlockPosition so the
+// tree stays in sync.
+class World {
+  public:
+    typedef ecs::Entity BlockId;
+
+    BlockId add(const gfx::Block& block) {
+        BlockId id = registry_.create();
+        registry_.add(id, ecs::Transform { block.position(), block.size() });
+        registry_.add(id, ecs::Collider());
+        registry_.add(id, TreeProxy { tree_.createProxy(blockAabb(block), id.index) });
+        return id;
+    }
+
+    // n blocks given as arrays, ids[i] is the block at positions[i]. the
+    // tree is built in one go while the world has no blocks yet, so loading
+    // a level doesn't pay for n inserts
+    void addBlocks(const glm::vec3* positions, const glm::vec3* sizes, unsigned int n, std::vector<BlockId>& ids) {
+        ids.resize(n);
+        registry_.reserve<ecs::Transform>(size() + n);
+        registry_.reserve<ecs::Collider>(size() + n);
+        registry_.reserve<TreeProxy>(size() + n);
+        std::vector<Aabb> boxes(n);
+        std::vector<unsigned int> indices(n);
+        for (unsigned int i = 0; i < n; i++) {
+            ids[i] = registry_.create();
+            registry_.add(ids[i], ecs::Transform { positions[i], sizes[i] });
+            registry_.add(ids[i], ecs::Collider());
+            boxes[i] = Aabb(positions[i], positions[i] + sizes[i]);
+            indices[i] = ids[i].index;
+        }
+        std::vector<int> proxies(n);
+        if (n > 0) {
+            tree_.build(&boxes[0], &indices[0], n, &proxies[0]);
+        }
+        for (unsigned int i = 0; i < n; i++) {
+            registry_.add(ids[i], TreeProxy { proxies[i] });
+        }
+    }
+
+    void remove(BlockId id) {
+        tree_.destroyProxy(registry_.get<TreeProxy>(id).node);
+        registry_.destroy(id);
+    }
+
+    bool contains(BlockId id) const {
+        return registry_.has<TreeProxy>(id);
+    }
+
+    gfx::Block block(BlockId id) const {
+        const ecs::Transform& transform = registry_.get<ecs::Transform>(id);
+        return gfx::Block(transform.position, transform.size);
+    }
+
+    void setBlockPosition(BlockId id, glm::vec3 position) {
+        ecs::Transform& transform = registry_.get<ecs::Transform>(id);
+        transform.position = position;
+        tree_.moveProxy(registry_.get<TreeProxy>(id).node, transformAabb(transform));
+    }
+
+    unsigned int size() const {
+        return registry_.pool<TreeProxy>().size();
+    }
+
+    ecs::Registry& registry() {
+        return registry_;
+    }
+
+    const ecs::Registry& registry() const {
+        return registry_;
+    }
+
+    // calls f(id, block) for every block
+    template<typename F>
+    void forEachBlock(F f) const {
+        registry_.each<TreeProxy, ecs::Transform>([&](BlockId id, const TreeProxy&, const ecs::Transform& transform) {
+            f(id, gfx::Block(transform.position, transform.size));
+        });
+    }
+
+    // blocks whose box overlaps box
+    void overlapping(const Aabb& box, std::vector<BlockId>& out) const {
+        out.clear();
+        tree_.query(box, [&](unsigned int index) {
+            // the tree stores fattened boxes, confirm against the real one
+            BlockId id = registry_.entityAt(index);
+            if (transformAabb(registry_.get<ecs::Transform>(id)).overlaps(box)) {
+                out.push_back(id);
+            }
+        });
+    }
+
+    // blocks with any point within radius of center
+    void withinRadius(glm::vec3 center, float radius, std::vector<BlockId>& out) const {
+        out.clear();
+        const float radius2 = radius * radius;
+        tree_.queryRadius(center, radius, [&](unsigned int index) {
+            BlockId id = registry_.entityAt(index);
+            if (transformAabb(registry_.get<ecs::Transform>(id)).distance2(center) <= radius2) {
+                out.push_back(id);
+            }
+        });
+    }
+
+    // the k blocks closest to point, nearest first
+    void nearest(glm::vec3 point, unsigned int k, std::vector<BlockId>& out) const {
+        std::vector<unsigned int> indices;
+        tree_.nearest(point, k, [&](unsigned int index) {
+            return transformAabb(registry_.get<ecs::Transform>(registry_.entityAt(index))).distance2(point);
+        }, indices);
+        out.clear();
+        for (unsigned int index : indices) {
+            out.push_back(registry_.entityAt(index));
+        }
+    }
+
+  private:
+    // the block's leaf in tree_
+    struct TreeProxy {
+        int node;
+    };
+
+    ecs::Registry registry_;
+    AabbTree tree_;
+
+    static Aabb transformAabb(const ecs::Transform& transform) {
+        return Aabb(transform.position, transform.position + transform.size);
+    }
+};
+
+#endif
@@ -8,32 +8,33 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
-#include <btBulletDynamicsCommon.h>
-
 #include <glitch/shader.h>
+#include <glitch/shader_library.h>
 #include <glitch/camera.h>
 #include <glitch/graphics.h>
 #include <glitch/player.h>
+#include <glitch/timestep.h>
+#include <glitch/physics.h>
+#include <glitch/world.h>
+#include <glitch/culling.h>
+#include <glitch/transforms.h>
+#include <glitch/jobs.h>
+#include <glitch/voxel.h>
+#include <glitch/lod.h>
+#include <glitch/texture_loader.h>
+#include <glitch/profiler.h>
+#include <glitch/render_queue.h>
+#include <glitch/input.h>
+#include <glitch/replay.h>
+#include <glitch/rollback.h>
+#include <glitch/scene.h>
 
 #include <iostream>
 #include <vector>
+#include <string>
 #include <algorithm>
-
-// define types
-enum class CameraMode {
-    FirstPerson,
-    ThirdPerson
-};
-enum class PlayerMovement {
-    Forward,
-    ForwardLeft,
-    ForwardRight,
-    Back,
-    BackLeft,
-    BackRight,
-    Left,
-    Right
-};
+#include <chrono>
+#include <thread>
 
 // define function signatures
 // window input callbacks
@@ -42,12 +43,23 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
 void processInput(GLFWwindow *window);
+ecs::PlayerMovement playerMovement(const input::State& state);
+input::TickRecord tickRecord(const input::State& state);
 
 // game logic from inputs
-void toggleCameraMode();
-void movePlayer(PlayerMovement move);
-void turnPlayer(float xoffset, float yoffset, bool constrain_pitch = true);
-void updateCamera();
+void toggleCameraMode(ecs::FollowCamera& follow);
+void toggleLatencyMeasurement();
+void simulateTick(ecs::Registry& registry, const input::TickRecord& input);
+void movePlayer(const ecs::PlayerController& player);
+void turnPlayer(ecs::PlayerController& player, ecs::CameraMode mode, float xoffset, float yoffset, bool constrain_pitch = true);
+glm::vec2 lookAngles(const ecs::PlayerController& player, glm::vec2 mouse_delta, bool constrain_pitch = true);
+glm::vec3 renderPosition(const ecs::PlayerController& player, float alpha);
+void updateCameras(ecs::Registry& registry, float alpha, glm::vec2 mouse_delta);
+ecs::Entity addPlayer(ecs::Registry& registry);
+void addSceneBlocks(const scene::Scene& level, World& world, std::vector<World::BlockId>& ids);
+void addPhysics(const World& world);
+uint32_t stateChecksum(const ecs::Registry& registry);
+int runReplay(const std::string& path, bool paced, const std::string& scene_path);
 
 // config game context
 // basic window settings
@@ -57,41 +69,110 @@ const char* WINDOW_TITLE = "Glitch Game";
 const glm::vec4 BG_COL = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
 
 // shaders
-const std::string VERTEX_SHADER_PATH = "src/shaders/vertex.glsl";
-const std::string FRAGMENT_SHADER_SOLID_COLOR_PATH = "src/shaders/f_color.glsl";
-const std::string FRAGMENT_SHADER_TEXTURE_PATH = "src/shaders/fragment.glsl";
+const std::string VERTEX_SHADER_PATH = "src/shaders/v_instanced.glsl";
+const std::string FRAGMENT_SHADER_SOLID_COLOR_PATH = "src/shaders/f_instanced_color.glsl";
+const std::string FRAGMENT_SHADER_TEXTURE_PATH = "src/shaders/f_instanced_texture_array.glsl";
+const std::string VERTEX_SHADER_VOXEL_PATH = "src/shaders/v_voxel.glsl";
+const std::string VERTEX_SHADER_BILLBOARD_PATH = "src/shaders/v_billboard.glsl";
+const std::string FRAGMENT_SHADER_DITHERED_PATH = "src/shaders/f_dithered_color.glsl";
+
+// linked program binaries, keyed by source and driver
+const std::string SHADER_CACHE_PATH = "shader_cache";
 
 // images/textures
 const std::string AWESOMEFACE_IMAGE_PATH = "src/images/awesomeface.png";
-const std::string CONTAINER_IMAGE_PATH = "src/images/container.jpg";
+const int BLOCK_TEXTURE_SIZE = 512; // every block texture is resampled to this
+
+// the static blocks, the same in the game and in headless replays. text or
+// compiled with glitch_scene_compile, see scene.h
+const std::string DEFAULT_SCENE_PATH = "src/scenes/arena.scene";
+
+// boxes per culling job, small scenes stay on one thread
+const unsigned int CULL_GRAIN = 16384;
+
+// bytes of per frame GPU data, triple buffered
+const unsigned int FRAME_STREAM_BYTES = 1024 * 1024;
+
+// profiling
+const std::string TRACE_PATH = "trace.json";
+const unsigned int TRACE_FRAMES = 120;
+
+// terrain level of detail, chunks switch by their size on screen and
+// nothing past the view distance (the far plane) is drawn
+const float VIEW_DISTANCE = 1000.0f;
+gfx::LodSelector terrain_lod(gfx::LodSettings {
+    { 120.0f, 48.0f }, // pixels: full mesh above the first, impostor below the second
+    0.15f, // hysteresis
+    0.3f, // fade seconds
+    VIEW_DISTANCE
+});
+
+// near planes, as far out as each camera allows. with a 24 bit depth buffer
+// two surfaces at distance d need about d * d / (near * 2^24) between them,
+// 0.2 units at the view distance in first person and 0.06 in third. the
+// first person eye can be 0.35 from a wall it touches, see player_hurtbox_size
+const float NEAR_PLANE_FIRST_PERSON = 0.3f;
+const float NEAR_PLANE_THIRD_PERSON = 1.0f;
 
 // camera
-Camera camera(glm::vec3(0.0f, 0.5f, 3.0f));
 const float third_person_pitch = -30.0f;
 const glm::vec3 third_person_displacement = glm::vec3(-4.0f, 2.0f, 0.0f);
-CameraMode camera_mode = CameraMode::ThirdPerson;
 
 // mouse
 const float mouse_sensitivity = 0.1f;
-float lastX = SCR_WIDTH / 2.0f;
-float lastY = SCR_HEIGHT / 2.0f;
-bool firstMouse = true;
-
-// create player
-Player player(
-    glm::vec3(0.0f, 0.5f, 3.0f), // position
-    -90.0f, // yaw
-    0.0f, // pitch
-    glm::vec3(0.7f, 0.7f, 0.7f) // hurtbox_size
-);
+
+// input
+// callbacks only queue timestamped events, every tick folds in the ones before it
+input::Queue input_queue;
+input::State tick_input;
+// input to swap latency, toggled with L
+bool measure_latency = false;
+input::LatencyStats input_latency;
+// oldest mouse event not on screen yet, negative when there is none
+double oldest_unshown_input = -1.0;
+
+// player, an entity of the world once it exists, see addPlayer()
+const glm::vec3 player_start_position = glm::vec3(0.0f, 0.5f, 3.0f);
+const float player_start_yaw = -90.0f;
+const glm::vec3 player_hurtbox_size = glm::vec3(0.7f, 0.7f, 0.7f);
 const float player_move_speed = 2.5f;
 
+// physics, blocks and the player are added once they exist
+phys::PhysicsWorld physics;
+
 // timing
-float delta_time = 0.0f;	// time between current frame and last frame
-float lastFrame = 0.0f;
+// the simulation runs at a fixed tick rate, rendering runs as fast as it can
+const double SIM_TICK_RATE = 120.0;
+FixedTimestep sim_timestep(SIM_TICK_RATE);
+double lastFrame = 0.0;
 
-int main()
+int main(int argc, char** argv)
 {
+    // --record writes every tick's input to a file, --replay runs one
+    // without a window, as fast as possible unless --paced
+    std::string record_path;
+    std::string replay_path;
+    std::string scene_path = DEFAULT_SCENE_PATH;
+    bool paced = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--record" && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (arg == "--replay" && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (arg == "--paced") {
+            paced = true;
+        } else if (arg == "--scene" && i + 1 < argc) {
+            scene_path = argv[++i];
+        } else {
+            std::cout << "usage: glitch_game [--scene FILE] [--record FILE] [--replay FILE [--paced]]" << std::endl;
+            return 1;
+        }
+    }
+    if (!replay_path.empty()) {
+        return runReplay(replay_path, paced, scene_path);
+    }
+
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
@@ -130,216 +211,338 @@ int main()
 
     // configure global opengl state
     // -----------------------------
-    glEnable(GL_DEPTH_TEST);
+    gfx::GLState::instance().enable(GL_DEPTH_TEST);
 
-    // build and compile our shader zprogram
+    // build and compile our shader programs
     // ------------------------------------
-    // Shader ourShader(VERTEX_SHADER_PATH.c_str(), FRAGMENT_SHADER_PATH.c_str());
-    Shader ourShader(VERTEX_SHADER_PATH.c_str(), FRAGMENT_SHADER_TEXTURE_PATH.c_str());
-    Shader solidShader(VERTEX_SHADER_PATH.c_str(), FRAGMENT_SHADER_SOLID_COLOR_PATH.c_str());
+    // all at once and in the background where the driver can, or from the
+    // binary cache, they're waited on once the rest of the level is loaded
+    gfx::ShaderLibrary shaders(SHADER_CACHE_PATH);
+    gfx::ShaderLibrary::ProgramId texture_program = shaders.add(VERTEX_SHADER_PATH, FRAGMENT_SHADER_TEXTURE_PATH);
+    gfx::ShaderLibrary::ProgramId solid_program = shaders.add(VERTEX_SHADER_PATH, FRAGMENT_SHADER_SOLID_COLOR_PATH);
+    gfx::ShaderLibrary::ProgramId voxel_program = shaders.add(VERTEX_SHADER_VOXEL_PATH, FRAGMENT_SHADER_DITHERED_PATH);
+    gfx::ShaderLibrary::ProgramId impostor_program = shaders.add(VERTEX_SHADER_BILLBOARD_PATH, FRAGMENT_SHADER_DITHERED_PATH);
+    std::chrono::steady_clock::time_point shaders_start = std::chrono::steady_clock::now();
+    if (!shaders.compile()) {
+        return -1;
+    }
+
+    // load and create a texture 
+    // -------------------------
+    // every block texture is a layer of one texture array, so blocks with
+    // different textures still share a batch. decoded on worker threads and
+    // uploaded a slice per frame, the layers stay white until then
+    const std::vector<gfx::Texture::Param> texture_params = {
+        { GL_TEXTURE_WRAP_S, GL_REPEAT },
+        { GL_TEXTURE_WRAP_T, GL_REPEAT },
+        { GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR },
+        { GL_TEXTURE_MAG_FILTER, GL_LINEAR },
+    };
+    gfx::TextureArray block_textures(BLOCK_TEXTURE_SIZE, BLOCK_TEXTURE_SIZE, texture_params);
+    gfx::TextureLoader textures;
+    unsigned int awesomeface_layer = textures.loadLayer(AWESOMEFACE_IMAGE_PATH, block_textures);
+
+    // worker threads for loading and frame work, this thread keeps the GL context
+    jobs::Scheduler scheduler(std::thread::hardware_concurrency());
+
+    // the world's entities: the player and the static blocks
+    World world;
+    ecs::Registry& registry = world.registry();
+    const ecs::Entity player_entity = addPlayer(registry);
 
     // Create blocks
 
     // player block
     gfx::TextureBlock player_block(
-        player.position(),
-        player.hurtboxSize()
+        player_start_position,
+        player_hurtbox_size
+    );
+    // the player is in its own batch so it can be skipped in first person mode
+    gfx::InstancedBatch player_batch(gfx::BlockLayout::Texture, 1);
+    gfx::InstancedBatch::InstanceId player_instance = player_batch.add(glm::mat4(1.0f), glm::vec4(1.0f), awesomeface_layer);
+    // turns around its center
+    gfx::Transforms player_transform;
+    gfx::Transforms::TransformId player_transform_id = player_transform.add(
+        player_instance, player_block.position(), 0.0f, player_block.size(), glm::vec3(0.5f)
     );
-    gfx::VAO player_vao;
-    player_vao.initFromBlock(player_block);
 
+    // static blocks are entities of the world, a RenderMesh says which batch instance draws one
+    std::chrono::steady_clock::time_point scene_start = std::chrono::steady_clock::now();
+    scene::Scene level;
+    if (!level.load(scene_path)) {
+        return -1;
+    }
+    std::vector<World::BlockId> block_ids;
+    addSceneBlocks(level, world, block_ids);
 
-    // sample texture block
-    gfx::TextureBlock sample_cube(
-        glm::vec3(-0.5f, 0.5f, -1.0f),
-        glm::vec3(1.0f, 1.0f, 1.0f)
-    );
-    gfx::VAO vao;
-    vao.initFromBlock(sample_cube);
-
-    // solid color cube
-    float length = 0.8f;
-    gfx::SolidColorBlock orange_cube(
-        glm::vec3(-2.0f, 0.0f, 0.0f),
-        glm::vec3(length, length, length)
-    );
-    gfx::VAO orange_vao;
-    orange_vao.initFromBlock(orange_cube);
-
-    // ground
-    float ground_length = 5.0f;
-    gfx::SolidColorBlock ground_block(
-        glm::vec3(-ground_length/2, -ground_length/5, -ground_length/2),
-        glm::vec3(ground_length, ground_length/5, ground_length)
-    );
-    gfx::VAO ground_vao;
-    ground_vao.initFromBlock(ground_block);
-
-    // purple
-    float purple_length = 1.0f;
-    gfx::SolidColorBlock purple_block(
-        glm::vec3(0.0f, 0.0f, 10.0f),
-        glm::vec3(purple_length, purple_length, purple_length)
-    );
-    gfx::VAO purple_vao;
-    purple_vao.initFromBlock(purple_block);
-
-    // green
-    float green_length = 1.0f;
-    gfx::SolidColorBlock green_block(
-        glm::vec3(-10.0f, 0.0f, 0.0f),
-        glm::vec3(green_length, green_length, green_length)
-    );
-    gfx::VAO green_vao;
-    green_vao.initFromBlock(green_block);
-
-    // blue
-    float blue_length = 1.0f;
-    gfx::SolidColorBlock blue_block(
-        glm::vec3(10.0f, 0.0f, 0.0f),
-        glm::vec3(blue_length, blue_length, blue_length)
-    );
-    gfx::VAO blue_vao;
-    blue_vao.initFromBlock(blue_block);
+    // the scene's textures are layers of the block texture array too
+    std::vector<unsigned int> scene_layers;
+    for (unsigned int i = 0; i < level.textureCount(); i++) {
+        scene_layers.push_back(textures.loadLayer(level.texturePath(i), block_textures));
+    }
+    unsigned int n_textured = 0;
+    for (unsigned int i = 0; i < level.blockCount(); i++) {
+        n_textured += level.textures()[i] != scene::NO_TEXTURE;
+    }
 
-    // // add blocks to vector to render
-    // std::vector<gfx::VAO*> world_objects;
-    // world_objects.push_back(orange_vao);
+    // textured blocks and solid color blocks, instance data comes straight
+    // from the scene's arrays, model matrices from the batch's transforms
+    gfx::InstancedBatch texture_batch(gfx::BlockLayout::Texture, n_textured);
+    gfx::Transforms texture_transforms;
+    gfx::InstancedBatch solid_batch(gfx::BlockLayout::SolidColor, level.blockCount() - n_textured);
+    gfx::Transforms solid_transforms;
+    texture_transforms.reserve(n_textured);
+    solid_transforms.reserve(level.blockCount() - n_textured);
+    registry.reserve<ecs::RenderMesh>(level.blockCount());
+    for (unsigned int i = 0; i < level.blockCount(); i++) {
+        const int32_t texture = level.textures()[i];
+        gfx::InstancedBatch& batch = (texture == scene::NO_TEXTURE) ? solid_batch : texture_batch;
+        gfx::Transforms& transforms = (texture == scene::NO_TEXTURE) ? solid_transforms : texture_transforms;
+        const unsigned int layer = (texture == scene::NO_TEXTURE) ? 0 : scene_layers[texture];
+        ecs::RenderMesh mesh = { &batch, batch.add(glm::mat4(1.0f), level.colors()[i], layer) };
+        transforms.add(mesh.instance, level.positions()[i], 0.0f, level.sizes()[i]);
+        registry.add(block_ids[i], mesh);
+    }
+    gfx::InstancedBatch::ModelWriter texture_models(texture_batch);
+    texture_transforms.update(texture_models, scheduler);
+    gfx::InstancedBatch::ModelWriter solid_models(solid_batch);
+    solid_transforms.update(solid_models, scheduler);
+    std::cout << "scene: " << level.blockCount() << " blocks from " << scene_path << " in "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - scene_start).count() << " ms" << std::endl;
+
+    addPhysics(world);
+
+    // culling boxes, box i is the entity in slot i of the RenderMesh pool
+    gfx::CullingBoxes cull_boxes;
+    // per chunk of CULL_GRAIN boxes, filled by the scheduler's workers
+    std::vector<std::vector<unsigned int> > visible_boxes;
+    const ecs::Pool<ecs::RenderMesh>& render_meshes = registry.pool<ecs::RenderMesh>();
+    for (unsigned int slot = 0; slot < render_meshes.size(); slot++) {
+        const ecs::Transform& transform = registry.get<ecs::Transform>(render_meshes.entities()[slot]);
+        cull_boxes.add(transform.position, transform.position + transform.size);
+    }
 
-    // load and create a texture 
-    // -------------------------
-    gfx::Texture container_tx(
-        GL_TEXTURE_2D,
-        {
-            { GL_TEXTURE_WRAP_S, GL_REPEAT },
-            { GL_TEXTURE_WRAP_T, GL_REPEAT },
-            { GL_TEXTURE_MIN_FILTER, GL_LINEAR },
-            { GL_TEXTURE_MAG_FILTER, GL_LINEAR },
-        },
-        CONTAINER_IMAGE_PATH,
-        false
-    );
-    gfx::Texture awesomeface_tx(
-        GL_TEXTURE_2D,
-        {
-            { GL_TEXTURE_WRAP_S, GL_REPEAT },
-            { GL_TEXTURE_WRAP_T, GL_REPEAT },
-            { GL_TEXTURE_MIN_FILTER, GL_LINEAR },
-            { GL_TEXTURE_MAG_FILTER, GL_LINEAR },
-        },
-        AWESOMEFACE_IMAGE_PATH,
-        true
-    );
+    // voxel terrain for exploring, drawn as one greedy mesh per chunk up
+    // close and a coarser proxy mesh or a billboard further away
+    vox::VoxelWorld voxels({
+        glm::vec4(0.0f), // air
+        glm::vec4(0.35f, 0.7f, 0.3f, 1.0f), // grass
+        glm::vec4(0.55f, 0.4f, 0.25f, 1.0f), // dirt
+        glm::vec4(0.5f, 0.5f, 0.55f, 1.0f), // stone
+    });
+    // rolling hills east of the arena
+    vox::generateHills(voxels, glm::ivec3(16, -4, -384), 768, 768);
+    std::chrono::steady_clock::time_point mesh_start = std::chrono::steady_clock::now();
+    voxels.remeshDirty(scheduler);
+    const double mesh_wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mesh_start).count();
+    vox::MeshStats voxel_stats = voxels.stats();
+    std::cout << "terrain: " << voxels.chunkCount() << " chunks, "
+              << voxel_stats.n_triangles << " triangles (" << voxel_stats.n_proxy_triangles << " as proxies, "
+              << voxel_stats.n_naive_triangles << " cube by cube), "
+              << "meshed in " << mesh_wall_ms << " ms on " << scheduler.threadCount() << " threads ("
+              << voxel_stats.mesh_ms << " ms cpu)" << std::endl;
+    std::cout << "simd: " << gfx::cullPath() << " culling, " << gfx::transformPath() << " transforms" << std::endl;
+
+    if (!shaders.finish()) {
+        return -1;
+    }
+    Shader& ourShader = shaders.program(texture_program);
+    Shader& solidShader = shaders.program(solid_program);
+    Shader& voxelShader = shaders.program(voxel_program);
+    Shader& impostorShader = shaders.program(impostor_program);
+    gfx::ShaderLibrary::Stats shader_stats = shaders.stats();
+    std::cout << "shaders: " << shader_stats.n_programs << " programs, " << shader_stats.n_cached << " from the cache"
+              << (shader_stats.n_stale ? " (" + std::to_string(shader_stats.n_stale) + " stale)" : std::string())
+              << ", " << shader_stats.ms << " ms building, ready "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - shaders_start).count()
+              << " ms after starting" << std::endl;
 
     // tell opengl for each sampler to which texture unit it belongs to (only has to be done once)
     // -------------------------------------------------------------------------------------------
     ourShader.use();
-    ourShader.setInt("texture1", 0);
-    ourShader.setInt("texture2", 1);
+    ourShader.setInt("blockTextures", 0);
+
+    // camera matrices shared by both programs
+    CameraUniforms camera_uniforms;
+
+    // per frame instance data and uniforms, written straight into mapped GPU memory
+    gfx::StreamBuffer frame_stream(FRAME_STREAM_BYTES);
+
+    // draws are submitted in any order and sorted by program, material and depth
+    gfx::RenderQueue render_queue(VIEW_DISTANCE);
+    gfx::RenderQueue::MaterialId textured_material = render_queue.addMaterial(ourShader);
+    gfx::RenderQueue::MaterialId solid_material = render_queue.addMaterial(solidShader);
+    gfx::RenderQueue::MaterialId voxel_material = render_queue.addMaterial(voxelShader);
+    gfx::RenderQueue::MaterialId impostor_material = render_queue.addMaterial(impostorShader);
+
+    // every tick's input, for replaying this session later
+    input::Recorder recorder;
+    if (!record_path.empty() && recorder.open(record_path, SIM_TICK_RATE)) {
+        std::cout << "recording input to " << record_path << std::endl;
+    }
 
     // render loop
     // -----------
     while (!glfwWindowShouldClose(window))
     {
+        PROFILE_BEGIN_FRAME();
+
         // per-frame time logic
         // --------------------
-        float currentFrame = static_cast<float>(glfwGetTime());
-        delta_time = currentFrame - lastFrame;
+        double currentFrame = glfwGetTime();
+        double frame_time = currentFrame - lastFrame;
+        sim_timestep.advance(frame_time);
         lastFrame = currentFrame;
 
-        // input + game logic
-        // ------------------
-        processInput(window);
-        player_block.setPosition(player.position());
+        // input
+        // -----
+        {
+            PROFILE_SCOPE("input");
+            processInput(window);
+        }
+
+        // game logic, in fixed ticks
+        // --------------------------
+        {
+            PROFILE_SCOPE("simulation");
+            // each tick gets the input that happened before the end of its time slice
+            double tick_end = currentFrame - sim_timestep.lag();
+            while (sim_timestep.tick()) {
+                tick_end += sim_timestep.dt();
+                input_queue.coalesce(tick_end, tick_input);
+                input::TickRecord tick = tickRecord(tick_input);
+                if (recorder.isOpen()) {
+                    recorder.record(tick);
+                }
+                simulateTick(registry, tick);
+            }
+        }
+
+        // place the player between the last two ticks so motion stays smooth at any frame rate
+        player_block.setPosition(renderPosition(registry.get<ecs::PlayerController>(player_entity), sim_timestep.alpha()));
 
         // render
         // ------
-        glClearColor(BG_COL.x, BG_COL.y, BG_COL.z, BG_COL.w);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); 
-
-        // bind textures on corresponding texture units
-        container_tx.activeBindTexture(GL_TEXTURE0);
-        awesomeface_tx.activeBindTexture(GL_TEXTURE1);
-
-        // pass projection matrix to shader (note that in this case it could change every frame)
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-
-        // camera/view transformation
-        glm::mat4 view = camera.GetViewMatrix();
-
-        // render blocks
-        ourShader.use();
-        ourShader.setMat4("projection", projection);
-        ourShader.setMat4("view", view);
-
-        // don't draw player if in first person mode
-        if (camera_mode == CameraMode::ThirdPerson) {
-            player_vao.bind();
-            glm::mat4 player_model = glm::mat4(1.0f);
-            player_model = glm::translate(player_model, player_block.position());
-            player_model = glm::rotate(player_model, -glm::radians(player.yaw()), glm::vec3(0.0f, 1.0f, 0.0f));
-            player_model = glm::translate(player_model, - 0.5f * player_block.size());
-            ourShader.setMat4("model", player_model);
-            vao.drawElements(36);
+        double shown_input = -1.0; // oldest mouse event this frame shows
+        {
+            PROFILE_SCOPE("render");
+            PROFILE_GPU_SCOPE("render");
+            frame_stream.beginFrame();
+            glClearColor(BG_COL.x, BG_COL.y, BG_COL.z, BG_COL.w);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); 
+
+            // finish pending texture uploads within this frame's budget, the
+            // array is re-created when it grows so keep the material up to date
+            textures.update();
+            render_queue.setTexture(textured_material, 0, GL_TEXTURE_2D_ARRAY, block_textures.id());
+
+            // late latch: poll once more and aim the camera with mouse movement
+            // no tick has seen yet, the next tick turns the player for real
+            {
+                PROFILE_SCOPE("latch");
+                glfwPollEvents();
+                updateCameras(registry, sim_timestep.alpha(), input_queue.pendingMouseDelta());
+                shown_input = oldest_unshown_input;
+                oldest_unshown_input = -1.0;
+            }
+
+            ecs::FollowCamera& follow = registry.get<ecs::FollowCamera>(player_entity);
+            Camera& camera = follow.camera;
+
+            // pass projection matrix to shader (note that in this case it could change every frame)
+            const float near_plane = (follow.mode == ecs::CameraMode::ThirdPerson) ? NEAR_PLANE_THIRD_PERSON : NEAR_PLANE_FIRST_PERSON;
+            glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, near_plane, VIEW_DISTANCE);
+
+            // camera/view transformation
+            glm::mat4 view = camera.GetViewMatrix();
+
+            // upload once, every program reads them from the Camera block
+            camera_uniforms.update(projection, view, frame_stream);
+
+            // cull blocks outside the view
+            const gfx::Frustum frustum = gfx::Frustum::fromMatrix(projection * view);
+            {
+                PROFILE_SCOPE("culling");
+                gfx::cullParallel(frustum, cull_boxes, scheduler, CULL_GRAIN, visible_boxes);
+                texture_batch.clearVisible();
+                solid_batch.clearVisible();
+                const ecs::RenderMesh* meshes = render_meshes.data();
+                for (const std::vector<unsigned int>& chunk_visible : visible_boxes) {
+                    for (unsigned int box : chunk_visible) {
+                        meshes[box].batch->addVisible(meshes[box].instance);
+                    }
+                }
+            }
+
+            // submit blocks
+            render_queue.clear();
+
+            // don't draw player if in first person mode
+            if (follow.mode == ecs::CameraMode::ThirdPerson) {
+                player_transform.setPosition(player_transform_id, player_block.position());
+                player_transform.setYaw(player_transform_id, -glm::radians(camera.Yaw));
+                player_transform.update(player_batch);
+                render_queue.submit(textured_material, player_batch.prepare(frame_stream), glm::distance(camera.Position, player_block.position()));
+            }
+
+            // Texture blocks and solid color blocks, one instanced draw each
+            render_queue.submit(textured_material, texture_batch.prepareVisible(frame_stream), 0.0f);
+            render_queue.submit(solid_material, solid_batch.prepareVisible(frame_stream), 0.0f);
+
+            // Terrain, only chunks edited since last frame are remeshed
+            {
+                PROFILE_SCOPE("remesh");
+                voxels.remeshDirty(scheduler);
+            }
+            {
+                PROFILE_SCOPE("lod");
+                terrain_lod.begin(camera.Position, glm::radians(camera.Zoom), (float)SCR_HEIGHT, frame_time);
+                voxels.forEachLodDraw(terrain_lod, frustum, [&](const gfx::DrawItem& item, unsigned int level, glm::vec3 center) {
+                    gfx::RenderQueue::MaterialId material = (level == gfx::LOD_IMPOSTOR) ? impostor_material : voxel_material;
+                    render_queue.submit(material, item, glm::distance(camera.Position, center));
+                });
+            }
+
+            {
+                PROFILE_SCOPE("submission");
+                render_queue.flush();
+            }
+            frame_stream.endFrame();
         }
 
-        // Texture block
-        vao.bind();
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, sample_cube.position());
-        ourShader.setMat4("model", model);
-        vao.drawElements(36);
-
-        // Config solid color shader
-        solidShader.use();
-        solidShader.setMat4("projection", projection);
-        solidShader.setMat4("view", view);
-
-        // Set color and draw blocks
-        solidShader.setVec4("color", glm::vec4(1.0f, 0.5f, 0.2f, 1.0f));
-        orange_vao.bind();
-        glm::mat4 orange_model = glm::mat4(1.0f);
-        orange_model = glm::translate(orange_model, orange_cube.position());
-        solidShader.setMat4("model", orange_model);
-        orange_vao.drawElements(36);
-
-        solidShader.setVec4("color", glm::vec4(0.8f, 0.8f, 0.8f, 1.0f));
-        ground_vao.bind();
-        glm::mat4 ground_model = glm::mat4(1.0f);
-        ground_model = glm::translate(ground_model, ground_block.position());
-        solidShader.setMat4("model", ground_model);
-        ground_vao.drawElements(36);
-
-        solidShader.setVec4("color", glm::vec4(0.8f, 0.0f, 0.8f, 1.0f));
-        purple_vao.bind();
-        glm::mat4 purple_model = glm::mat4(1.0f);
-        purple_model = glm::translate(purple_model, purple_block.position());
-        solidShader.setMat4("model", purple_model);
-        purple_vao.drawElements(36);
-
-        solidShader.setVec4("color", glm::vec4(0.0f, 0.8f, 0.5f, 1.0f));
-        green_vao.bind();
-        glm::mat4 green_model = glm::mat4(1.0f);
-        green_model = glm::translate(green_model, green_block.position());
-        solidShader.setMat4("model", green_model);
-        green_vao.drawElements(36);
-
-        solidShader.setVec4("color", glm::vec4(0.0f, 0.2f, 0.8f, 1.0f));
-        blue_vao.bind();
-        glm::mat4 blue_model = glm::mat4(1.0f);
-        blue_model = glm::translate(blue_model, blue_block.position());
-        solidShader.setMat4("model", blue_model);
-        blue_vao.drawElements(36);
-
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
+        {
+            PROFILE_SCOPE("swap");
+            glfwSwapBuffers(window);
+        }
+        if (measure_latency && shown_input >= 0.0) {
+            // wait for the frame to actually finish so the sample covers the GPU too
+            glFinish();
+            input_latency.record((glfwGetTime() - shown_input) * 1000.0);
+        }
         glfwPollEvents();
+
+        PROFILE_END_FRAME();
+    }
+
+    if (recorder.isOpen()) {
+        recorder.close(stateChecksum(registry));
+        std::cout << "recorded " << recorder.size() << " ticks to " << record_path << std::endl;
     }
 
     // optional: de-allocate all resources once they've outlived their purpose:
     // ------------------------------------------------------------------------
-    vao.deallocate();
+    player_batch.deallocate();
+    texture_batch.deallocate();
+    solid_batch.deallocate();
+    voxels.deallocate();
+    textures.deallocate();
+    block_textures.deallocate();
+    camera_uniforms.deallocate();
+    shaders.deallocate();
+    frame_stream.deallocate();
+    prof::Profiler::instance().deallocate();
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
@@ -349,10 +552,41 @@ int main()
 
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
-    // toggle camera mode
-    if (key == GLFW_KEY_C && action == GLFW_PRESS) {
-        toggleCameraMode();
-        updateCamera();
+    // held keys are read by the simulation ticks
+    input_queue.push(input::Event::keyEvent(glfwGetTime(), key, action));
+
+    // print physics stats
+    if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+        phys::Stats stats = physics.stats();
+        std::cout << "physics: step " << stats.step_ms << " ms, "
+                  << stats.n_overlapping_pairs << " broadphase pairs, "
+                  << stats.n_collision_objects << " objects" << std::endl;
+    }
+
+    // print where frames went since the last print
+    if (key == GLFW_KEY_F && action == GLFW_PRESS) {
+        prof::Profiler::instance().printStages(std::cout);
+        prof::Profiler::instance().reset();
+        gfx::GLState::Counters gl_calls = gfx::GLState::instance().counters();
+        std::cout << "gl state: " << gl_calls.issued << " calls issued, " << gl_calls.skipped << " skipped" << std::endl;
+        gfx::GLState::instance().resetCounters();
+        const char* lod_names[gfx::N_LODS] = { "full", "proxy", "impostor" };
+        const gfx::LodStats& lod = terrain_lod.stats();
+        std::cout << "terrain lod (last frame):";
+        for (unsigned int level = 0; level < gfx::N_LODS; level++) {
+            std::cout << " " << lod_names[level] << " " << lod.n_draws[level] << " draws " << lod.n_triangles[level] << " triangles,";
+        }
+        std::cout << " " << lod.n_fading << " fading, " << lod.n_culled << " culled" << std::endl;
+    }
+
+    // capture the next frames as a chrome trace
+    if (key == GLFW_KEY_T && action == GLFW_PRESS && !prof::Profiler::instance().capturing()) {
+        prof::Profiler::instance().capture(TRACE_FRAMES, TRACE_PATH);
+    }
+
+    // measure input to swap latency until pressed again
+    if (key == GLFW_KEY_L && action == GLFW_PRESS) {
+        toggleLatencyMeasurement();
     }
 }
 
@@ -363,27 +597,39 @@ void processInput(GLFWwindow *window)
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
         glfwSetWindowShouldClose(window, true);
     }
+}
 
-    // player movement
-    bool forward = glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS;
-    bool backward = glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS;
-    bool left = glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS;
-    bool right = glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS;
+// player movement from the keys held during a tick
+ecs::PlayerMovement playerMovement(const input::State& state)
+{
+    bool forward = state.held(GLFW_KEY_W);
+    bool backward = state.held(GLFW_KEY_S);
+    bool left = state.held(GLFW_KEY_A);
+    bool right = state.held(GLFW_KEY_D);
+    ecs::PlayerMovement player_movement = ecs::PlayerMovement::None;
     if ((forward && backward) || (!forward && !backward)) {
-        if      (left && !right) movePlayer(PlayerMovement::Left);
-        else if (right && !left) movePlayer(PlayerMovement::Right);
+        if      (left && !right) player_movement = ecs::PlayerMovement::Left;
+        else if (right && !left) player_movement = ecs::PlayerMovement::Right;
     } else if (forward) {
-        if      (left && !right) movePlayer(PlayerMovement::ForwardLeft);
-        else if (right && !left) movePlayer(PlayerMovement::ForwardRight);
-        else                     movePlayer(PlayerMovement::Forward);
+        if      (left && !right) player_movement = ecs::PlayerMovement::ForwardLeft;
+        else if (right && !left) player_movement = ecs::PlayerMovement::ForwardRight;
+        else                     player_movement = ecs::PlayerMovement::Forward;
     } else if (backward) {
-        if      (left && !right) movePlayer(PlayerMovement::BackLeft);
-        else if (right && !left) movePlayer(PlayerMovement::BackRight);
-        else                     movePlayer(PlayerMovement::Back);
+        if      (left && !right) player_movement = ecs::PlayerMovement::BackLeft;
+        else if (right && !left) player_movement = ecs::PlayerMovement::BackRight;
+        else                     player_movement = ecs::PlayerMovement::Back;
     }
+    return player_movement;
+}
 
-    // update camera to follow player
-    updateCamera();
+// what a tick reads, the same whether it comes from the window or a recording
+input::TickRecord tickRecord(const input::State& state)
+{
+    input::TickRecord tick;
+    tick.movement = static_cast<uint8_t>(playerMovement(state));
+    tick.toggle_camera = state.pressed(GLFW_KEY_C);
+    tick.mouse_delta = state.mouseDelta();
+    return tick;
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -400,59 +646,96 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 // -------------------------------------------------------
 void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
 {
-    float xpos = static_cast<float>(xposIn);
-    float ypos = static_cast<float>(yposIn);
-
-    if (firstMouse)
-    {
-        lastX = xpos;
-        lastY = ypos;
-        firstMouse = false;
+    double time = glfwGetTime();
+    input_queue.push(input::Event::mouseMove(time, static_cast<float>(xposIn), static_cast<float>(yposIn)));
+    if (oldest_unshown_input < 0.0) {
+        oldest_unshown_input = time;
     }
+}
 
-    float xoffset = xpos - lastX;
-    float yoffset = lastY - ypos; // reversed since y-coordinates go from bottom to top
-
-    lastX = xpos;
-    lastY = ypos;
-
-    turnPlayer(xoffset, yoffset);
-    updateCamera();
+void toggleCameraMode(ecs::FollowCamera& follow) {
+    if (follow.mode == ecs::CameraMode::ThirdPerson) {
+        follow.mode = ecs::CameraMode::FirstPerson;
+    } else if (follow.mode == ecs::CameraMode::FirstPerson) {
+        follow.mode = ecs::CameraMode::ThirdPerson;
+    }
 }
 
-void toggleCameraMode() {
-    if (camera_mode == CameraMode::ThirdPerson) {
-        camera_mode = CameraMode::FirstPerson;
-    } else if (camera_mode == CameraMode::FirstPerson) {
-        camera_mode = CameraMode::ThirdPerson;
+void toggleLatencyMeasurement() {
+    measure_latency = !measure_latency;
+    if (measure_latency) {
+        input_latency.clear();
+        std::cout << "measuring input latency, press L again to stop" << std::endl;
+        return;
     }
+    std::cout << "input to swap latency over " << input_latency.size() << " frames: "
+              << "p50 " << input_latency.percentile(0.5) << " ms, "
+              << "p99 " << input_latency.percentile(0.99) << " ms, "
+              << "max " << input_latency.percentile(1.0) << " ms, "
+              << input_queue.droppedEvents() << " input events dropped" << std::endl;
 }
 
-void movePlayer(PlayerMovement move) {
+// advance the game by one fixed tick
+void simulateTick(ecs::Registry& registry, const input::TickRecord& input) {
+    registry.each<ecs::PlayerController, ecs::FollowCamera>([&](ecs::Entity, ecs::PlayerController& player, ecs::FollowCamera& follow) {
+        player.previous_position = player.body.position();
+        if (input.toggle_camera) {
+            toggleCameraMode(follow);
+        }
+        // all mouse movement of the tick turns the player once
+        if (input.mouse_delta != glm::vec2(0.0f)) {
+            turnPlayer(player, follow.mode, input.mouse_delta.x, input.mouse_delta.y);
+        }
+        player.movement = static_cast<ecs::PlayerMovement>(input.movement);
+        if (player.movement != ecs::PlayerMovement::None) {
+            movePlayer(player);
+        } else {
+            physics.setCharacterWalk(glm::vec3(0.0f));
+        }
+    });
+    physics.step(sim_timestep.dt());
+    // physics has the one character controller
+    registry.each<ecs::PlayerController>([](ecs::Entity, ecs::PlayerController& player) {
+        player.body.go(physics.characterPosition());
+    });
+}
+
+void movePlayer(const ecs::PlayerController& player) {
 
-    float speed = player_move_speed * delta_time;
+    float speed = player.move_speed * sim_timestep.dt();
 
+    const ecs::PlayerMovement move = player.movement;
+    const Player& body = player.body;
     glm::vec3 move_dir = glm::vec3(0.0f);
-    if (move == PlayerMovement::Forward) move_dir = player.front();
-    else if (move == PlayerMovement::ForwardLeft) move_dir = player.front() - player.right();
-    else if (move == PlayerMovement::ForwardRight) move_dir = player.front() + player.right();
-    else if (move == PlayerMovement::Back) move_dir = -player.front();
-    else if (move == PlayerMovement::BackLeft) move_dir = -player.front() - player.right();
-    else if (move == PlayerMovement::BackRight) move_dir = -player.front() + player.right();
-    else if (move == PlayerMovement::Left) move_dir = - player.right();
-    else if (move == PlayerMovement::Right) move_dir = player.right();
-
-    // project to xz plane
+    if (move == ecs::PlayerMovement::Forward) move_dir = body.front();
+    else if (move == ecs::PlayerMovement::ForwardLeft) move_dir = body.front() - body.right();
+    else if (move == ecs::PlayerMovement::ForwardRight) move_dir = body.front() + body.right();
+    else if (move == ecs::PlayerMovement::Back) move_dir = -body.front();
+    else if (move == ecs::PlayerMovement::BackLeft) move_dir = -body.front() - body.right();
+    else if (move == ecs::PlayerMovement::BackRight) move_dir = -body.front() + body.right();
+    else if (move == ecs::PlayerMovement::Left) move_dir = - body.right();
+    else if (move == ecs::PlayerMovement::Right) move_dir = body.right();
+
+    // project to xz plane, the character controller resolves collisions on the next step
     move_dir.y = 0.0f;
-    player.move(glm::normalize(move_dir) * speed);
+    physics.setCharacterWalk(glm::normalize(move_dir) * speed);
 }
 
-void turnPlayer(float xoffset, float yoffset, bool constrain_pitch) {
-    xoffset *= mouse_sensitivity;
-    yoffset *= mouse_sensitivity;
+void turnPlayer(ecs::PlayerController& player, ecs::CameraMode mode, float xoffset, float yoffset, bool constrain_pitch) {
+    glm::vec2 look = lookAngles(player, glm::vec2(xoffset, yoffset), constrain_pitch);
+
+    // Execute turn
+    if (mode == ecs::CameraMode::FirstPerson) {
+        player.body.turn(look.x, look.y);
+    } else if (mode == ecs::CameraMode::ThirdPerson) {
+        player.body.turnh(look.x);
+    }
+}
 
-    float yaw   = player.yaw() + xoffset;
-    float pitch = player.pitch() + yoffset;
+// yaw and pitch the player would have after turning by mouse_delta
+glm::vec2 lookAngles(const ecs::PlayerController& player, glm::vec2 mouse_delta, bool constrain_pitch) {
+    float yaw   = player.body.yaw() + mouse_delta.x * mouse_sensitivity;
+    float pitch = player.body.pitch() + mouse_delta.y * mouse_sensitivity;
 
     // make sure that when pitch is out of bounds, screen doesn't get flipped
     if (constrain_pitch)
@@ -460,26 +743,122 @@ void turnPlayer(float xoffset, float yoffset, bool constrain_pitch) {
         if (pitch > 89.0f) pitch = 89.0f;
         if (pitch < -89.0f) pitch = -89.0f;
     }
+    return glm::vec2(yaw, pitch);
+}
 
-    // Execute turn
-    if (camera_mode == CameraMode::FirstPerson) {
-        player.turn(yaw, pitch);
-    } else if (camera_mode == CameraMode::ThirdPerson) {
-        player.turnh(yaw);
-    }
+// between the last two ticks so motion stays smooth at any frame rate
+glm::vec3 renderPosition(const ecs::PlayerController& player, float alpha) {
+    return glm::mix(player.previous_position, player.body.position(), alpha);
+}
+
+// aim every camera at its player's render position, turned by mouse_delta
+// that no tick has seen yet
+void updateCameras(ecs::Registry& registry, float alpha, glm::vec2 mouse_delta) {
+    registry.each<ecs::FollowCamera, ecs::PlayerController>([&](ecs::Entity, ecs::FollowCamera& follow, const ecs::PlayerController& player) {
+        glm::vec2 look = lookAngles(player, mouse_delta);
+        glm::vec3 player_position = renderPosition(player, alpha);
+
+        // move position + update camera
+        if (follow.mode == ecs::CameraMode::FirstPerson) {
+            follow.camera.turn(look.x, look.y);
+            follow.camera.go(player_position);
+        } else if (follow.mode == ecs::CameraMode::ThirdPerson) {
+            follow.camera.turn(look.x, third_person_pitch);
+            glm::mat4 rotate = glm::rotate(glm::mat4(1.0f), -glm::radians(look.x), glm::vec3(0.0f, 1.0f, 0.0f));
+            glm::vec3 rotated = glm::vec3(rotate * glm::vec4(third_person_displacement, 0.0f));
+            follow.camera.go(player_position + rotated);
+        }
+    });
+}
+
+// the player entity, standing at the start with the camera behind it
+ecs::Entity addPlayer(ecs::Registry& registry) {
+    const ecs::Entity entity = registry.create();
+    const Player body(player_start_position, player_start_yaw, 0.0f, player_hurtbox_size);
+    registry.add(entity, ecs::PlayerController { body, ecs::PlayerMovement::None, body.position(), player_move_speed });
+    registry.add(entity, ecs::FollowCamera { Camera(player_start_position), ecs::CameraMode::ThirdPerson });
+    return entity;
+}
+
+// one world block per scene block, ids[i] is block i of the scene
+void addSceneBlocks(const scene::Scene& level, World& world, std::vector<World::BlockId>& ids) {
+    world.addBlocks(level.positions(), level.sizes(), level.blockCount(), ids);
 }
 
-void updateCamera() {
-
-    // move position + update camera
-    if (camera_mode == CameraMode::FirstPerson) {
-        camera.turn(player.yaw(), player.pitch());
-        camera.go(player.position());
-    } else if (camera_mode == CameraMode::ThirdPerson) {
-        camera.turn(player.yaw(), third_person_pitch);
-        glm::mat4 rotate = glm::rotate(glm::mat4(1.0f), -glm::radians(player.yaw()), glm::vec3(0.0f, 1.0f, 0.0f));
-        glm::vec3 rotated = glm::vec3(rotate * glm::vec4(third_person_displacement, 0.0f));
-        camera.go(player.position() + rotated);
+// mirror the world in physics: the colliders and the player
+void addPhysics(const World& world) {
+    const ecs::Registry& registry = world.registry();
+    registry.each<ecs::Collider, ecs::Transform>([](ecs::Entity, const ecs::Collider&, const ecs::Transform& transform) {
+        physics.addStaticBlock(gfx::Block(transform.position, transform.size));
+    });
+    registry.each<ecs::PlayerController>([](ecs::Entity, const ecs::PlayerController& player) {
+        physics.addCharacter(player.body.position(), player.body.hurtboxSize());
+    });
+}
+
+// fingerprint of the simulation, a replay must end with the one its recording did
+uint32_t stateChecksum(const ecs::Registry& registry) {
+    uint32_t checksum = 0;
+    registry.each<ecs::PlayerController>([&](ecs::Entity, const ecs::PlayerController& player) {
+        checksum ^= net::checksum(player.body.state());
+    });
+    return checksum;
+}
+
+// run a recording without a window, as fast as possible or at the recorded tick rate
+int runReplay(const std::string& path, bool paced, const std::string& scene_path) {
+    input::Replay replay;
+    scene::Scene level;
+    if (!replay.load(path) || !level.load(scene_path)) {
+        return 1;
     }
+    sim_timestep.setTickRate(replay.tickRate());
+
+    World world;
+    addPlayer(world.registry());
+    std::vector<World::BlockId> block_ids;
+    addSceneBlocks(level, world, block_ids);
+    addPhysics(world);
+
+    std::vector<double> tick_ms;
+    tick_ms.reserve(replay.size());
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < replay.size(); i++) {
+        if (paced) {
+            std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(i / replay.tickRate())
+            ));
+        }
+        std::chrono::steady_clock::time_point tick_start = std::chrono::steady_clock::now();
+        simulateTick(world.registry(), replay.tick(i));
+        std::chrono::steady_clock::time_point tick_end = std::chrono::steady_clock::now();
+        tick_ms.push_back(std::chrono::duration<double, std::milli>(tick_end - tick_start).count());
+    }
+    double total_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
 
-}
\ No newline at end of file
+    double sum_ms = 0.0;
+    for (double ms : tick_ms) {
+        sum_ms += ms;
+    }
+    std::sort(tick_ms.begin(), tick_ms.end());
+    std::cout << "replay: " << replay.size() << " ticks in " << total_ms << " ms";
+    if (!tick_ms.empty()) {
+        std::cout << ", tick ms: mean " << sum_ms / tick_ms.size()
+                  << " p50 " << tick_ms[tick_ms.size() / 2]
+                  << " p99 " << tick_ms[std::min<size_t>(tick_ms.size() - 1, tick_ms.size() * 99 / 100)]
+                  << " max " << tick_ms.back();
+    }
+    std::cout << std::endl;
+
+    uint32_t checksum = stateChecksum(world.registry());
+    if (!replay.hasChecksum()) {
+        std::cout << "final state " << std::hex << checksum << std::dec << ", the recording has none to compare with" << std::endl;
+        return 0;
+    }
+    if (checksum != replay.checksum()) {
+        std::cout << "final state " << std::hex << checksum << " differs from the recording's " << replay.checksum() << std::dec << std::endl;
+        return 1;
+    }
+    std::cout << "final state matches the recording" << std::endl;
+    return 0;
+}
@@ -0,0 +1,27 @@
+#version 330 core
+out vec4 FragColor;
+in vec4 Color;
+
+// 1 draws everything. while a level of detail cross-fades, [0, 1) keeps
+// that share of the pixels of a 4x4 ordered dither and [-1, 0) keeps the
+// rest, so the incoming and outgoing levels never cover the same pixel
+uniform float fade = 1.0;
+
+const float BAYER[16] = float[16](
+     0.0,  8.0,  2.0, 10.0,
+    12.0,  4.0, 14.0,  6.0,
+     3.0, 11.0,  1.0,  9.0,
+    15.0,  7.0, 13.0,  5.0
+);
+
+void main()
+{
+    if (fade < 1.0) {
+        ivec2 p = ivec2(gl_FragCoord.xy) & 3;
+        float threshold = (BAYER[p.y * 4 + p.x] + 0.5) / 16.0;
+        if (fade >= 0.0 ? threshold >= fade : threshold < fade + 1.0) {
+            discard;
+        }
+    }
+    FragColor = Color;
+}
@@ -0,0 +1,13 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoord;
+in vec4 Color;
+flat in float Layer;
+
+uniform sampler2DArray blockTextures;
+
+void main()
+{
+    FragColor = texture(blockTextures, vec3(TexCoord, Layer)) * Color;
+}
@@ -0,0 +1,25 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+out vec4 Color;
+
+layout (std140) uniform Camera
+{
+    mat4 projection;
+    mat4 view;
+};
+
+// translation = billboard center, x and y scale = half width and height
+uniform mat4 model;
+uniform vec4 color;
+
+void main()
+{
+    // turns around the vertical axis to face the camera, the camera's
+    // right vector is the first row of the view matrix
+    vec3 right = normalize(vec3(view[0][0], 0.0, view[2][0]));
+    vec3 center = model[3].xyz;
+    vec3 position = center + right * aPos.x * model[0][0] + vec3(0.0, aPos.y * model[1][1], 0.0);
+    gl_Position = projection * view * vec4(position, 1.0);
+    Color = color;
+}
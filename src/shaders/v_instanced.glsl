@@ -0,0 +1,25 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+// per instance attributes
+layout (location = 2) in mat4 aModel;
+layout (location = 6) in vec4 aColor;
+layout (location = 7) in float aLayer;
+
+out vec2 TexCoord;
+out vec4 Color;
+flat out float Layer;
+
+layout (std140) uniform Camera
+{
+    mat4 projection;
+    mat4 view;
+};
+
+void main()
+{
+    gl_Position = projection * view * aModel * vec4(aPos, 1.0);
+    TexCoord = aTexCoord;
+    Color = aColor;
+    Layer = aLayer;
+}
@@ -0,0 +1,32 @@
+// Compiles a text scene to the binary form the game maps, see scene.h.
+//
+// usage: glitch_scene_compile IN.scene OUT.glsc
+
+#include <glitch/scene.h>
+
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <string>
+
+int main(int argc, char** argv)
+{
+    if (argc != 3) {
+        std::cout << "usage: glitch_scene_compile IN.scene OUT.glsc" << std::endl;
+        return 1;
+    }
+    std::ifstream file(argv[1], std::ios::binary);
+    if (!file) {
+        std::cout << "Failed to open scene " << argv[1] << std::endl;
+        return 1;
+    }
+    std::vector<char> text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    scene::SceneDesc desc;
+    if (!scene::parse(text.data(), text.size(), desc, argv[1]) || !scene::save(argv[2], desc)) {
+        return 1;
+    }
+    std::cout << argv[2] << ": " << desc.blockCount() << " blocks, " << desc.texture_paths.size() << " textures" << std::endl;
+    return 0;
+}